@@ -1,154 +1,52 @@
-#include <vulkan/vulkan.h>
-#include <cassert>
+#include "vk_context.h"
+#include "vk_profiler.h"
+
 #include <cstdio>
+#include <cstring>
 #include <vector>
 #include <iostream>
 
-#define VK_CHECK(x) do { VkResult err = (x); assert(err == VK_SUCCESS); } while(0)
-
-static std::vector<uint32_t> readSpirvU32(const char *filename) {
-  FILE *f = std::fopen(filename, "rb");
-  assert(f);
-
-  std::fseek(f, 0, SEEK_END);
-  size_t sizeBytes = std::ftell(f);
-  std::rewind(f);
-
-  assert(sizeBytes % 4 == 0);
-
-  std::vector<uint32_t> words(sizeBytes / 4);
-  size_t read = std::fread(words.data(), 1, sizeBytes, f);
-  assert(read == sizeBytes);
-
-  std::fclose(f);
-  return words;
-}
-
-static uint32_t findQueueFamily(VkPhysicalDevice phys, VkQueueFlags required) {
-  uint32_t count = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(phys, &count, nullptr);
-  assert(count > 0);
-
-  std::vector<VkQueueFamilyProperties> props(count);
-  vkGetPhysicalDeviceQueueFamilyProperties(phys, &count, props.data());
-
-  for (uint32_t i = 0; i < count; i++)
-    if ((props[i].queueFlags & required) == required)
-      return i;
-
-  assert(false);
-  return 0;
-}
-
-static uint32_t findMemoryType(VkPhysicalDevice phys, uint32_t typeBits, VkMemoryPropertyFlags props) {
-  VkPhysicalDeviceMemoryProperties mp{};
-  vkGetPhysicalDeviceMemoryProperties(phys, &mp);
-
-  for (uint32_t i = 0; i < mp.memoryTypeCount; i++) {
-    if ((typeBits & (1u << i)) && ((mp.memoryTypes[i].propertyFlags & props) == props))
-      return i;
-  }
-  assert(false);
-  return 0;
-}
+// Usage: VkPrimer10k [--profile=F.json|F.csv]
+int main(int argc, char **argv) {
+  const char *profileFile = nullptr;
+  for (int i = 1; i < argc; i++)
+    if (std::strncmp(argv[i], "--profile=", 10) == 0) profileFile = argv[i] + 10;
 
-int main() {
   const uint32_t N = 10000;
 
   const uint32_t threadsPerGroup = 1024;
   const uint32_t numWorkgroups = (N + threadsPerGroup - 1) / threadsPerGroup;
   const uint32_t totalThreads = threadsPerGroup * numWorkgroups;
 
-  // ---- Instance ----
-  VkInstance instance = VK_NULL_HANDLE;
-  VkInstanceCreateInfo ici{};
-  ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-  VK_CHECK(vkCreateInstance(&ici, nullptr, &instance));
-
-  // ---- Physical device ----
-  uint32_t gpuCount = 0;
-  VK_CHECK(vkEnumeratePhysicalDevices(instance, &gpuCount, nullptr));
-  assert(gpuCount > 0);
-
-  std::vector<VkPhysicalDevice> gpus(gpuCount);
-  VK_CHECK(vkEnumeratePhysicalDevices(instance, &gpuCount, gpus.data()));
-  VkPhysicalDevice phys = gpus[0];
-
-  // ---- Queue ----
-  uint32_t queueFamilyIndex = findQueueFamily(phys, VK_QUEUE_COMPUTE_BIT);
-
-  float prio = 1.0f;
-  VkDeviceQueueCreateInfo qci{};
-  qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  qci.queueFamilyIndex = queueFamilyIndex;
-  qci.queueCount = 1;
-  qci.pQueuePriorities = &prio;
-
-  VkDeviceCreateInfo dci{};
-  dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  dci.queueCreateInfoCount = 1;
-  dci.pQueueCreateInfos = &qci;
-
-  VkDevice device = VK_NULL_HANDLE;
-  VK_CHECK(vkCreateDevice(phys, &dci, nullptr, &device));
-
-  VkQueue queue = VK_NULL_HANDLE;
-  vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+  // ---- Shared context (instance/device/queue) ----
+  VkContext &ctx = getContext();
+  VkDevice device = ctx.dev;
+  VkQueue queue = ctx.queue;
+  uint32_t queueFamilyIndex = ctx.qfam;
 
   // ---- Command pool/buffer ----
-  VkCommandPool pool = VK_NULL_HANDLE;
-  VkCommandPoolCreateInfo pci{};
-  pci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  pci.queueFamilyIndex = queueFamilyIndex;
-  VK_CHECK(vkCreateCommandPool(device, &pci, nullptr, &pool));
-
-  VkCommandBuffer cmd = VK_NULL_HANDLE;
-  VkCommandBufferAllocateInfo cbai{};
-  cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cbai.commandPool = pool;
-  cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cbai.commandBufferCount = 1;
-  VK_CHECK(vkAllocateCommandBuffers(device, &cbai, &cmd));
+  VkCommandPool pool = createCmdPool(device, queueFamilyIndex);
+  VkCommandBuffer cmd = createCmdBuffer(device, pool);
+  GpuProfiler prof;
+  initProfiler(ctx, prof);
 
   // ---- Buffers ----
-  VkBuffer buf[3]{};
-  VkDeviceMemory mem[3]{};
-
-  auto makeBuffer = [&](int idx) {
-    VkBufferCreateInfo bci{};
-    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bci.size = sizeof(float) * N;
-    bci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    VK_CHECK(vkCreateBuffer(device, &bci, nullptr, &buf[idx]));
-
-    VkMemoryRequirements req{};
-    vkGetBufferMemoryRequirements(device, buf[idx], &req);
-
-    VkMemoryAllocateInfo mai{};
-    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    mai.allocationSize = req.size;
-    mai.memoryTypeIndex = findMemoryType(
-      phys, req.memoryTypeBits,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    VK_CHECK(vkAllocateMemory(device, &mai, nullptr, &mem[idx]));
-    VK_CHECK(vkBindBufferMemory(device, buf[idx], mem[idx], 0));
-  };
-
-  makeBuffer(0);
-  makeBuffer(1);
-  makeBuffer(2);
+  Buffer buf[3]{};
+  for (auto &b: buf)
+    b = createBuffer(ctx, sizeof(float) * N, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     false);
 
   // ---- Init A and B (1..10000) ----
   float *p = nullptr;
 
-  VK_CHECK(vkMapMemory(device, mem[0], 0, VK_WHOLE_SIZE, 0, (void**)&p));
+  p = (float *) mapBuffer(ctx, buf[0]);
   for (uint32_t i = 0; i < N; i++) p[i] = float(i + 1);
-  vkUnmapMemory(device, mem[0]);
+  unmapBuffer(ctx, buf[0]);
 
-  VK_CHECK(vkMapMemory(device, mem[1], 0, VK_WHOLE_SIZE, 0, (void**)&p));
+  p = (float *) mapBuffer(ctx, buf[1]);
   for (uint32_t i = 0; i < N; i++) p[i] = float(i + 1) * 10.0f;
-  vkUnmapMemory(device, mem[1]);
+  unmapBuffer(ctx, buf[1]);
 
   // ---- Descriptor set layout ----
   VkDescriptorSetLayoutBinding bindings[3]{};
@@ -204,7 +102,7 @@ int main() {
 
   VkDescriptorBufferInfo dbi[3]{};
   for (int i = 0; i < 3; i++) {
-    dbi[i].buffer = buf[i];
+    dbi[i].buffer = buf[i].buf;
     dbi[i].offset = 0;
     dbi[i].range = VK_WHOLE_SIZE;
   }
@@ -221,14 +119,8 @@ int main() {
   vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
 
   // ---- Shader module ----
-  auto spirv = readSpirvU32("add_10k.spv");
-  VkShaderModule shader = VK_NULL_HANDLE;
-
-  VkShaderModuleCreateInfo smci{};
-  smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  smci.codeSize = spirv.size() * sizeof(uint32_t);
-  smci.pCode = spirv.data();
-  VK_CHECK(vkCreateShaderModule(device, &smci, nullptr, &shader));
+  auto spirv = loadSpv("add_10k.spv");
+  VkShaderModule shader = createShaderModule(device, spirv);
 
   VkPipelineShaderStageCreateInfo stage{};
   stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -241,8 +133,7 @@ int main() {
   cpci.stage = stage;
   cpci.layout = pipelineLayout;
 
-  VkPipeline pipeline = VK_NULL_HANDLE;
-  VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &cpci, nullptr, &pipeline));
+  VkPipeline pipeline = createComputePipeline(ctx, cpci, "vec_add");
 
   // ---- Record/submit ----
   VkCommandBufferBeginInfo bi{};
@@ -261,23 +152,32 @@ int main() {
                      VK_SHADER_STAGE_COMPUTE_BIT,
                      0, sizeof(push), &push);
 
+  uint32_t scope = profilerBegin(prof, cmd, "dispatch", true);
   vkCmdDispatch(cmd, numWorkgroups, 1, 1);
+  profilerEnd(prof, cmd, scope);
 
-  VK_CHECK(vkEndCommandBuffer(cmd));
-
-  VkSubmitInfo si{};
-  si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  si.commandBufferCount = 1;
-  si.pCommandBuffers = &cmd;
-
-  VK_CHECK(vkQueueSubmit(queue, 1, &si, VK_NULL_HANDLE));
-  VK_CHECK(vkQueueWaitIdle(queue));
+  submitAndWait(device, queue, cmd);
+  profilerResolve(ctx, prof);
+  printProfile(prof);
+  if (profileFile) writeProfile(profileFile, ctx.caps, prof);
 
   // ---- Read Out ----
-  VK_CHECK(vkMapMemory(device, mem[2], 0, VK_WHOLE_SIZE, 0, (void**)&p));
+  p = (float *) mapBuffer(ctx, buf[2]);
   std::cout << "Result (first 16):\n";
   for (uint32_t i = 0; i < 16; i++) std::cout << p[i] << "\n";
-  vkUnmapMemory(device, mem[2]);
+  unmapBuffer(ctx, buf[2]);
+
+  // ---- Cleanup ----
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyShaderModule(device, shader, nullptr);
+  vkDestroyDescriptorPool(device, poolDesc, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, layout, nullptr);
+  destroyProfiler(ctx, prof);
+  vkDestroyCommandPool(device, pool, nullptr);
+  for (auto &b: buf) destroyBuffer(ctx, b);
+  printPipelineCacheStats(ctx.pipelineCache);
+  releaseContext();
 
   std::cout << "Done\n";
   return 0;
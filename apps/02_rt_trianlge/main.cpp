@@ -1,9 +1,12 @@
 // file: main.cpp
 // Minimal headless Vulkan RT sample:
-// - Builds BLAS/TLAS for a couple triangles in XY plane at Z=0
+// - Builds BLAS/TLAS for a couple triangles in XY plane at Z=0, or for a mesh loaded
+//   from OBJ / binary PLY (--mesh, see mesh_io.h)
 // - Traces orthographic rays along -Z
 // - Writes hit world coords to an RGBA32F storage image
 // - Copies image back and prints a few pixels
+// - Or (--rays) traces a batch of rays read from an SSBO and writes one compact hit
+//   record per ray to another SSBO, with 2D/3D launches past the width limit
 //
 // Build deps:
 //   - Vulkan SDK (headers + loader)
@@ -16,121 +19,37 @@
 // Runtime requires precompiled SPIR-V (from the Slang file):
 //   raygen.spv, miss.spv, chit.spv in working dir.
 
-#define VOLK_IMPLEMENTATION
-#include <volk/volk.h>
+#include "mesh_io.h"
 
+#include "vk_accel.h"
+#include "vk_context.h"
+#include "vk_profiler.h"
+#include "vk_staging.h"
+
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <numeric>
 #include <optional>
 #include <string>
 #include <vector>
 
-#define VK_CHECK(x) do { VkResult _r = (x); if (_r != VK_SUCCESS) { \
-  std::cerr << "Vulkan error " << _r << " at " << __FILE__ << ":" << __LINE__ << "\n"; std::exit(1); } } while(0)
-
-static std::vector<uint32_t> loadSpv(const char *path) {
-  std::ifstream f(path, std::ios::binary);
-  if (!f) {
-    std::cerr << "Failed to open " << path << "\n";
-    std::exit(1);
-  }
-
-  f.seekg(0, std::ios::end);
-  size_t sz = (size_t) f.tellg();
-  f.seekg(0, std::ios::beg);
-  if (sz % 4) {
-    std::cerr << "Bad SPV size " << path << "\n";
-    std::exit(1);
-  }
-  std::vector<uint32_t> out(sz / 4);
-  f.read((char *) out.data(), (std::streamsize) sz);
-  return out;
-}
-
-static uint32_t findMemoryType(VkPhysicalDevice phys, uint32_t typeBits, VkMemoryPropertyFlags req) {
-  VkPhysicalDeviceMemoryProperties mp{};
-  vkGetPhysicalDeviceMemoryProperties(phys, &mp);
-  for (uint32_t i = 0; i < mp.memoryTypeCount; i++)
-    if ((typeBits & (1u << i)) && (mp.memoryTypes[i].propertyFlags & req) == req)
-      return i;
-  std::cerr << "No suitable memory type\n";
-  std::exit(1);
-}
-
-struct Buffer {
-  VkBuffer buf{}; // low-level handler
-  VkDeviceMemory mem{}; // device memory
-  VkDeviceAddress addr{}; // device memory address
-  VkDeviceSize size{};
-};
-
-static Buffer createBuffer(
-  VkDevice dev, VkPhysicalDevice phys,
-  VkDeviceSize size, VkBufferUsageFlags usage,
-  VkMemoryPropertyFlags memProps,
-  bool deviceAddress) {
-  Buffer b{};
-  b.size = size;
-
-  VkBufferCreateInfo ci{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-  ci.size = size;
-  ci.usage = usage | (deviceAddress ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
-  ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  VK_CHECK(vkCreateBuffer(dev, &ci, nullptr, &b.buf));
-
-  VkMemoryRequirements mr{};
-  vkGetBufferMemoryRequirements(dev, b.buf, &mr);
-
-  VkMemoryAllocateFlagsInfo flags{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
-  flags.flags = deviceAddress ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
-
-  VkMemoryAllocateInfo ai{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-  ai.allocationSize = mr.size;
-  ai.memoryTypeIndex = findMemoryType(phys, mr.memoryTypeBits, memProps);
-  if (deviceAddress) ai.pNext = &flags;
-
-  VK_CHECK(vkAllocateMemory(dev, &ai, nullptr, &b.mem));
-  VK_CHECK(vkBindBufferMemory(dev, b.buf, b.mem, 0));
-
-  if (deviceAddress) {
-    VkBufferDeviceAddressInfo bai{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
-    bai.buffer = b.buf;
-    b.addr = vkGetBufferDeviceAddress(dev, &bai);
-  }
-  return b;
-}
-
-static void *mapBuffer(VkDevice dev, const Buffer &b) {
-  void *p = nullptr;
-  VK_CHECK(vkMapMemory(dev, b.mem, 0, b.size, 0, &p));
-  return p;
-}
-
-static void unmapBuffer(VkDevice dev, const Buffer &b) {
-  vkUnmapMemory(dev, b.mem);
-}
-
-static void destroyBuffer(VkDevice dev, Buffer &b) {
-  if (b.buf) vkDestroyBuffer(dev, b.buf, nullptr);
-  if (b.mem) vkFreeMemory(dev, b.mem, nullptr);
-  b = {};
-}
-
 struct Image {
   VkImage img{}; // handler for C++ program to access GPU resource
-  VkDeviceMemory mem{}; // the GPU resource / memory location on GPU
+  Allocation alloc; // the GPU resource / memory location on GPU
   VkImageView view{}; // handler for shader program to access GPU resource
   VkFormat format{}; // pixel format
   uint32_t w{}, h{}; // # of pixels
 };
 
 // create an image of certain format
-static Image createStorageImageRGBA32F(VkDevice dev, VkPhysicalDevice phys, uint32_t w, uint32_t h) {
+static Image createStorageImageRGBA32F(VkContext &ctx, uint32_t w, uint32_t h) {
+  VkDevice dev = ctx.dev;
   Image im{};
   im.w = w;
   im.h = h;
@@ -150,11 +69,8 @@ static Image createStorageImageRGBA32F(VkDevice dev, VkPhysicalDevice phys, uint
 
   VkMemoryRequirements mr{};
   vkGetImageMemoryRequirements(dev, im.img, &mr);
-  VkMemoryAllocateInfo ai{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-  ai.allocationSize = mr.size;
-  ai.memoryTypeIndex = findMemoryType(phys, mr.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK(vkAllocateMemory(dev, &ai, nullptr, &im.mem));
-  VK_CHECK(vkBindImageMemory(dev, im.img, im.mem, 0));
+  im.alloc = allocateMemory(ctx.allocator, mr, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocKind::Optimal);
+  VK_CHECK(vkBindImageMemory(dev, im.img, im.alloc.mem, im.alloc.offset));
 
   VkImageViewCreateInfo vi{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
   vi.image = im.img;
@@ -168,41 +84,13 @@ static Image createStorageImageRGBA32F(VkDevice dev, VkPhysicalDevice phys, uint
   return im;
 }
 
-static void destroyImage(VkDevice dev, Image &im) {
-  if (im.view) vkDestroyImageView(dev, im.view, nullptr);
-  if (im.img) vkDestroyImage(dev, im.img, nullptr);
-  if (im.mem) vkFreeMemory(dev, im.mem, nullptr);
+static void destroyImage(VkContext &ctx, Image &im) {
+  if (im.view) vkDestroyImageView(ctx.dev, im.view, nullptr);
+  if (im.img) vkDestroyImage(ctx.dev, im.img, nullptr);
+  freeMemory(ctx.allocator, im.alloc);
   im = {};
 }
 
-static VkCommandPool createCmdPool(VkDevice dev, uint32_t qfam) {
-  VkCommandPoolCreateInfo ci{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
-  ci.queueFamilyIndex = qfam;
-  ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  VkCommandPool pool{};
-  VK_CHECK(vkCreateCommandPool(dev, &ci, nullptr, &pool));
-  return pool;
-}
-
-static VkCommandBuffer createCmdBuffer(VkDevice dev, VkCommandPool pool) {
-  VkCommandBufferAllocateInfo ai{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-  ai.commandPool = pool;
-  ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  ai.commandBufferCount = 1;
-  VkCommandBuffer cmd{};
-  VK_CHECK(vkAllocateCommandBuffers(dev, &ai, &cmd));
-  return cmd;
-}
-
-static void submitAndWait(VkDevice dev, VkQueue q, VkCommandBuffer cmd) {
-  VK_CHECK(vkEndCommandBuffer(cmd)); // End Recoding Command
-  VkSubmitInfo si{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-  si.commandBufferCount = 1;
-  si.pCommandBuffers = &cmd;
-  VK_CHECK(vkQueueSubmit(q, 1, &si, VK_NULL_HANDLE)); // Submit to Queue
-  VK_CHECK(vkQueueWaitIdle(q)); // Wait for Completion
-}
-
 // It changes the image’s layout and synchronizes GPU access so the image can be used safely for a specific purpose (storage, transfer, sampling, etc.).
 // In Vulkan, an image must be in the correct layout before you use it, and you must insert pipeline barriers to avoid race conditions.
 static void cmdTransitionImage(VkCommandBuffer cmd, VkImage img, VkImageLayout oldL, VkImageLayout newL) {
@@ -222,196 +110,35 @@ static void cmdTransitionImage(VkCommandBuffer cmd, VkImage img, VkImageLayout o
   vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &b);
 }
 
-// ---- Acceleration Structure Helpers ----
-
-// Accel struct represents exactly one acceleration structure object — either a BLAS or a TLAS node — not an entire AS tree.
-// Accel = one BLAS or TLAS node
-struct Accel {
-  VkAccelerationStructureKHR as{}; // handle
-  Buffer backing; // buffer, the actual memory that S
-  VkDeviceAddress addr{};
-};
-
-static VkDeviceAddress getASAddress(VkDevice dev, VkAccelerationStructureKHR as) {
-  VkAccelerationStructureDeviceAddressInfoKHR ai{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
-  ai.accelerationStructure = as;
-  return vkGetAccelerationStructureDeviceAddressKHR(dev, &ai);
-}
-
-// Create one BLAS node from Triangles
-static Accel createBLAS_Triangles(
-  VkDevice dev, VkPhysicalDevice phys, VkCommandBuffer cmd,
-  const Buffer &vbo, uint32_t vertexCount, VkDeviceSize vertexStride,
-  const Buffer &ibo, uint32_t indexCount) {
-  // Geometry
-  VkAccelerationStructureGeometryTrianglesDataKHR tri{
-    VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR
-  };
-  tri.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-  tri.vertexData.deviceAddress = vbo.addr;
-  tri.vertexStride = vertexStride;
-  tri.maxVertex = vertexCount;
-  tri.indexType = VK_INDEX_TYPE_UINT32;
-  tri.indexData.deviceAddress = ibo.addr;
-
-  VkAccelerationStructureGeometryKHR geom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
-  geom.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-  // geom.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-  geom.flags = 0; // allow any-hit
-  geom.geometry.triangles = tri;
-
-  uint32_t primCount = indexCount / 3;
-
-  VkAccelerationStructureBuildGeometryInfoKHR bgi{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
-  bgi.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-  bgi.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-  bgi.geometryCount = 1;
-  bgi.pGeometries = &geom;
-
-  VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
-  vkGetAccelerationStructureBuildSizesKHR(dev, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bgi, &primCount,
-                                          &sizes);
-
-  Accel out{};
-  out.backing = createBuffer(
-    dev, phys, sizes.accelerationStructureSize,
-    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    true);
-
-  VkAccelerationStructureCreateInfoKHR asci{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
-  asci.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-  asci.size = sizes.accelerationStructureSize;
-  asci.buffer = out.backing.buf;
-  VK_CHECK(vkCreateAccelerationStructureKHR(dev, &asci, nullptr, &out.as));
-
-  Buffer scratch = createBuffer(
-    dev, phys, sizes.buildScratchSize,
-    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    true);
-
-  bgi.dstAccelerationStructure = out.as;
-  bgi.scratchData.deviceAddress = scratch.addr;
-
-  VkAccelerationStructureBuildRangeInfoKHR range{};
-  range.primitiveCount = primCount;
-  const VkAccelerationStructureBuildRangeInfoKHR *pRange = &range;
-
-  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &bgi, &pRange);
-
-  // Barrier so AS build is visible for trace
-  VkMemoryBarrier mb{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
-  mb.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
-  mb.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-  vkCmdPipelineBarrier(cmd,
-                       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-                       VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
-                       0, 1, &mb, 0, nullptr, 0, nullptr);
-
-  // cleanup scratch after submit (we'll destroy later after queue idle)
-  destroyBuffer(dev, scratch);
-
-  out.addr = getASAddress(dev, out.as);
-  return out;
-}
-
-// Create one TLAS node
-// blasAddr: device address of the entire BLAS acceleration structure
-static Accel createTLAS_OneInstance(
-  VkDevice dev, VkPhysicalDevice phys, VkCommandBuffer cmd,
-  VkDeviceAddress blasAddr) {
-  VkAccelerationStructureInstanceKHR inst{};
-  // identity
-  inst.transform.matrix[0][0] = 1.f;
-  inst.transform.matrix[1][1] = 1.f;
-  inst.transform.matrix[2][2] = 1.f;
-  inst.instanceCustomIndex = 0;
-  inst.mask = 0xFF;
-  inst.instanceShaderBindingTableRecordOffset = 0;
-  inst.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-  inst.accelerationStructureReference = blasAddr;
-
-  Buffer instBuf = createBuffer(
-    dev, phys, sizeof(inst),
-    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    true);
-
-  std::memcpy(mapBuffer(dev, instBuf), &inst, sizeof(inst));
-  unmapBuffer(dev, instBuf);
-
-  VkAccelerationStructureGeometryInstancesDataKHR idata{
-    VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR
-  };
-  idata.arrayOfPointers = VK_FALSE;
-  idata.data.deviceAddress = instBuf.addr;
-
-  VkAccelerationStructureGeometryKHR geom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
-  geom.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-  geom.geometry.instances = idata;
-
-  uint32_t primCount = 1;
-
-  VkAccelerationStructureBuildGeometryInfoKHR bgi{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
-  bgi.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-  bgi.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-  bgi.geometryCount = 1;
-  bgi.pGeometries = &geom;
-
-  VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
-  vkGetAccelerationStructureBuildSizesKHR(dev, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bgi, &primCount,
-                                          &sizes);
-
-  Accel out{};
-  out.backing = createBuffer(
-    dev, phys, sizes.accelerationStructureSize,
-    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    true);
-
-  VkAccelerationStructureCreateInfoKHR asci{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
-  asci.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-  asci.size = sizes.accelerationStructureSize;
-  asci.buffer = out.backing.buf;
-  VK_CHECK(vkCreateAccelerationStructureKHR(dev, &asci, nullptr, &out.as));
-
-  Buffer scratch = createBuffer(
-    dev, phys, sizes.buildScratchSize,
-    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    true);
-
-  bgi.dstAccelerationStructure = out.as;
-  bgi.scratchData.deviceAddress = scratch.addr;
-
-  VkAccelerationStructureBuildRangeInfoKHR range{};
-  range.primitiveCount = 1;
-  const VkAccelerationStructureBuildRangeInfoKHR *pRange = &range;
-
-  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &bgi, &pRange);
-
-  VkMemoryBarrier mb{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
-  mb.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
-  mb.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-  vkCmdPipelineBarrier(cmd,
-                       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-                       VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
-                       0, 1, &mb, 0, nullptr, 0, nullptr);
-
-  // The scratch buffer must stay alive until after vkQueueWaitIdle.
-  // destroyBuffer(dev, scratch);
-  // destroyBuffer(dev, instBuf);
-
-  out.addr = getASAddress(dev, out.as);
-  return out;
-}
+// Loaded mesh -> device-local VBO/IBO for the BLAS. writeMesh fills persistently mapped
+// memory directly: the buffers themselves on UMA/ReBAR, otherwise one host-visible staging
+// buffer whose copy into them is recorded into cmd (followed by a barrier for the AS
+// build). staging must live until cmd has executed.
+static void uploadMesh(VkContext &ctx, VkCommandBuffer cmd, const ParsedMesh &mesh, ThreadPool &pool,
+                       Buffer &vbo, Buffer &ibo, Buffer &staging, MeshLoadStats &stats) {
+  const VkDeviceSize vboSize = sizeof(float) * 3 * std::max(meshVertexCount(mesh), 1u);
+  const VkDeviceSize iboSize = sizeof(uint32_t) * std::max(meshIndexCount(mesh), 1u);
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  vbo = createDeviceLocalBuffer(ctx, nullptr, vboSize, usage, true);
+  ibo = createDeviceLocalBuffer(ctx, nullptr, iboSize, usage, true);
+
+  if (ctx.caps.deviceLocalHostVisible) {
+    writeMesh(mesh, pool, (float *) mapBuffer(ctx, vbo), (uint32_t *) mapBuffer(ctx, ibo), &stats);
+    return;
+  }
 
-static void destroyAccel(VkDevice dev, Accel &a) {
-  if (a.as) vkDestroyAccelerationStructureKHR(dev, a.as, nullptr);
-  destroyBuffer(dev, a.backing);
-  a = {};
+  staging = createBuffer(ctx, vboSize + iboSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
+  uint8_t *mapped = (uint8_t *) mapBuffer(ctx, staging);
+  writeMesh(mesh, pool, (float *) mapped, (uint32_t *) (mapped + vboSize), &stats);
+
+  VkBufferCopy copy{0, 0, vboSize};
+  vkCmdCopyBuffer(cmd, staging.buf, vbo.buf, 1, &copy);
+  copy = {vboSize, 0, iboSize};
+  vkCmdCopyBuffer(cmd, staging.buf, ibo.buf, 1, &copy);
+  cmdMemoryBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_SHADER_READ_BIT);
 }
 
 // ---- Main ----
@@ -428,161 +155,105 @@ struct Push {
   int rayCount;
   float originBase[3];
   float dir[3];
+  uint32_t rayOffset; // batch mode, see raygenBatchMain
+  uint32_t launchWidth;
+  uint32_t launchHeight;
+  uint32_t traceMode; // TraceMode
+  float xMin, xMax; // raygenMain: rays spread over [xMin, xMax] around originBase.x
+  float tMax; // raygenMain
 };
 
-int main() {
-  VK_CHECK(volkInitialize());
-
-  // Instance
-  VkApplicationInfo app{VK_STRUCTURE_TYPE_APPLICATION_INFO};
-  app.pApplicationName = "rt2d";
-  app.apiVersion = VK_API_VERSION_1_3;
+// Must match TRACE_* in rt_triangles.slang
+enum TraceMode : uint32_t {
+  TRACE_ALL_HITS = 0, // any-hit counts every crossing
+  TRACE_CLOSEST = 1, // opaque traversal, closest hit via chitMain, no any-hit
+  TRACE_OCCLUSION = 2, // opaque, first hit ends the ray, one bit per batch ray
+};
 
-  const char *instExts[] = {VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME};
+static const char *traceModeName(TraceMode m) {
+  return m == TRACE_OCCLUSION ? "occlusion" : m == TRACE_CLOSEST ? "closest hit" : "all hits";
+}
 
-  VkInstanceCreateInfo ici{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
-  ici.pApplicationInfo = &app;
-  ici.enabledExtensionCount = 1;
-  ici.ppEnabledExtensionNames = instExts;
+// ---- Ray batch (mirrors rt_triangles.slang) ----
+struct BatchRay {
+  float origin[3];
+  float tMin;
+  float dir[3];
+  float tMax;
+};
 
-  VkInstance instance{};
-  VK_CHECK(vkCreateInstance(&ici, nullptr, &instance));
-  volkLoadInstance(instance);
+struct RayHit {
+  float t; // closest hit, -1 on a miss
+  uint32_t primitive; // closest triangle, ~0u on a miss
+  uint32_t hitCount; // 0 or 1 with TRACE_CLOSEST
+};
 
-  // ---- Pick RT-capable physical device ----
-  uint32_t pdCount = 0;
-  VK_CHECK(vkEnumeratePhysicalDevices(instance, &pdCount, nullptr));
-  if (!pdCount) {
-    std::cerr << "No GPU\n";
-    return 1;
+// count rays along +Z from just below lo.z through to just above hi.z, origins on a grid
+// over [lo.x, hi.x] x [lo.y, hi.y] (a single row when the y range is empty).
+static std::vector<BatchRay> makeProbeRays(uint32_t count, const float lo[3], const float hi[3]) {
+  const uint32_t cols = hi[1] > lo[1] ? (uint32_t) std::ceil(std::sqrt((double) count)) : count;
+  const uint32_t rows = (count + cols - 1) / cols;
+  std::vector<BatchRay> rays(count);
+  for (uint32_t i = 0; i < count; i++) {
+    BatchRay &r = rays[i];
+    const float u = cols > 1 ? (float) (i % cols) / (cols - 1) : 0.5f;
+    const float v = rows > 1 ? (float) (i / cols) / (rows - 1) : 0.5f;
+    r.origin[0] = lo[0] + u * (hi[0] - lo[0]);
+    r.origin[1] = lo[1] + v * (hi[1] - lo[1]);
+    r.origin[2] = lo[2] - 1e-3f;
+    r.dir[0] = 0.0f;
+    r.dir[1] = 0.0f;
+    r.dir[2] = 1.0f;
+    r.tMin = 0.0f;
+    r.tMax = hi[2] - lo[2] + 2e-3f;
   }
+  return rays;
+}
 
-  std::vector<VkPhysicalDevice> pds(pdCount);
-  VK_CHECK(vkEnumeratePhysicalDevices(instance, &pdCount, pds.data()));
-
-  VkPhysicalDevice phys = VK_NULL_HANDLE;
-
-  std::cout << "Available GPUs:\n";
-
-  for (auto pd: pds) {
-    VkPhysicalDeviceProperties props{};
-    vkGetPhysicalDeviceProperties(pd, &props);
-    std::cout << "  " << props.deviceName << "\n";
-
-    // Query RT support
-    VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtFeat{
-      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR
-    };
-
-    VkPhysicalDeviceFeatures2 feats{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
-    feats.pNext = &rtFeat;
-    vkGetPhysicalDeviceFeatures2(pd, &feats);
-
-    if (rtFeat.rayTracingPipeline) {
-      phys = pd;
-      std::cout << "  -> Selected for RT\n";
-      break;
-    }
+// Usage: VkPrimerRtTriangle [--mesh=F.obj|F.ply] [--rays=N] [--closest | --occlusion]
+//                           [--profile=F.json|F.csv]
+//   --mesh  trace a loaded mesh; the probe rays start just below its lowest z, across
+//           its X extent at its Y center, and run through to just above its highest z
+//   --rays  ray batch mode: N rays along +Z on a grid over the geometry's XY bounds,
+//           hit records in an SSBO instead of the 5x1 image
+//   --closest  nearest hit only: OPAQUE geometry + RAY_FLAG_FORCE_OPAQUE, so the any-hit
+//              shader never runs; default counts every crossing
+//   --occlusion  with --rays: only whether each ray hits anything, first hit ends the
+//                search, results as a packed bitmask instead of hit records
+int main(int argc, char **argv) {
+  const char *profileFile = nullptr;
+  const char *meshFile = nullptr;
+  uint32_t batchRays = 0;
+  TraceMode traceMode = TRACE_ALL_HITS;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--profile=", 10) == 0) profileFile = argv[i] + 10;
+    else if (std::strncmp(argv[i], "--mesh=", 7) == 0) meshFile = argv[i] + 7;
+    else if (std::strncmp(argv[i], "--rays=", 7) == 0) batchRays = (uint32_t) std::strtoul(argv[i] + 7, nullptr, 10);
+    else if (std::strcmp(argv[i], "--closest") == 0) traceMode = TRACE_CLOSEST;
+    else if (std::strcmp(argv[i], "--occlusion") == 0) traceMode = TRACE_OCCLUSION;
   }
-
-  if (phys == VK_NULL_HANDLE) {
-    std::cerr << "No RT-capable GPU found\n";
+  if (traceMode == TRACE_OCCLUSION && !batchRays) {
+    std::cerr << "--occlusion needs a ray batch (--rays=N)\n";
     return 1;
   }
 
-  // ---- Queue family (compute is fine) ----
-  // ---- Queue family are just hardware capabilities that already exist on the physical device.
-  uint32_t qfCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, nullptr);
-  std::vector<VkQueueFamilyProperties> qfs(qfCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, qfs.data());
-
-  // Queue families are not created by you. They already exist on the physical device (GPU).
-  // You only query them and choose an index.
-  uint32_t qfam = UINT32_MAX;
-  for (uint32_t i = 0; i < qfCount; i++) {
-    // This line just chooses one queue family that supports compute so the program can request a queue from it when creating the logical device.
-    if (qfs[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-      qfam = i;
-      break;
-    }
-  }
-
-  if (qfam == UINT32_MAX) {
-    std::cerr << "No compute queue found\n";
+  // Shared instance/device/queue
+  VkContext &ctx = getContext();
+  printCaps(ctx.caps);
+  if (!ctx.caps.rayTracingPipeline) {
+    std::cerr << "No RT-capable GPU found\n";
     return 1;
   }
 
-  // ---- Required RT extensions (minimal) ----
-  std::vector<const char *> devExts = {
-    VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
-    VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
-    VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
-    VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
-    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
-    VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
-  };
-
-  // ---- Query and enable features (correct chain root) ----
-  VkPhysicalDeviceBufferDeviceAddressFeatures bda{
-    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES
-  };
-
-  VkPhysicalDeviceAccelerationStructureFeaturesKHR asf{
-    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR
-  };
-
-  VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtf{
-    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR
-  };
-
-  // a linked list of features.
-  VkPhysicalDeviceFeatures2 feats{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
-  feats.pNext = &rtf;
-  rtf.pNext = &asf;
-  asf.pNext = &bda;
-
-  // find all supported features in a physical device and fills in the supported feature booleans
-  vkGetPhysicalDeviceFeatures2(phys, &feats);
-
-  if (!rtf.rayTracingPipeline || !asf.accelerationStructure || !bda.bufferDeviceAddress) {
-    std::cerr << "RT features not fully supported on selected GPU\n";
-    return 1;
-  }
+  VkDevice dev = ctx.dev;
+  VkQueue queue = ctx.queue;
+  uint32_t qfam = ctx.qfam;
 
-  // Enable them
-  // rtf.rayTracingPipeline = VK_TRUE;
-  // asf.accelerationStructure = VK_TRUE;
-  // bda.bufferDeviceAddress = VK_TRUE;
-
-  // ---- Device + queue ----
-  float qprio = 1.0f;
-  VkDeviceQueueCreateInfo qci{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-  qci.queueFamilyIndex = qfam; // init qci with index of the selected queue family
-  qci.queueCount = 1;
-  qci.pQueuePriorities = &qprio;
-
-  VkDeviceCreateInfo dci{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-  dci.queueCreateInfoCount = 1;
-  dci.pQueueCreateInfos = &qci;
-  dci.enabledExtensionCount = (uint32_t) devExts.size();
-  dci.ppEnabledExtensionNames = devExts.data();
-  dci.pNext = &feats; // ✅ correct chain root
-
-  // Create a logical device from this physical device with these extensions enabled
-  VkDevice dev{};
-  VK_CHECK(vkCreateDevice(phys, &dci, nullptr, &dev));
-  volkLoadDevice(dev);
-
-  // Get an arbitrary queue: the first one.
-  VkQueue queue{};
-  vkGetDeviceQueue(dev, qfam, 0, &queue);
-  // This is where Vulkan/driver allocates 1 queue from family qfam for your new VkDevice.
-
-  // ---- Rest of your original code unchanged from here ----
   // Command setup
   VkCommandPool pool = createCmdPool(dev, qfam);
   VkCommandBuffer cmd = createCmdBuffer(dev, pool);
+  GpuProfiler prof;
+  initProfiler(ctx, prof);
 
   // Geometry buffers (3 triangles)
   const float EPSILON = 1e-7f;
@@ -608,23 +279,59 @@ int main() {
   std::vector<uint32_t> indices(vertices.size());
   std::iota(indices.begin(), indices.end(), 0u);
 
-  Buffer vbo = createBuffer(dev, phys, sizeof(Vertex) * vertices.size(),
-                            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                            true);
-  Buffer ibo = createBuffer(dev, phys, sizeof(uint32_t) * indices.size(),
-                            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                            true);
+  // Mesh: parsed now, written into mapped memory once the command buffer records
+  ThreadPool threads;
+  ParsedMesh mesh;
+  MeshLoadStats meshStats{};
+  uint32_t vertexCount = (uint32_t) vertices.size(), indexCount = (uint32_t) indices.size();
+  if (meshFile) {
+    initThreadPool(threads);
+    mesh = parseMesh(meshFile, threads, &meshStats);
+    vertexCount = meshVertexCount(mesh);
+    indexCount = meshIndexCount(mesh);
+  }
 
-  std::memcpy(mapBuffer(dev, vbo), vertices.data(), sizeof(Vertex) * vertices.size());
-  unmapBuffer(dev, vbo);
-  std::memcpy(mapBuffer(dev, ibo), indices.data(), sizeof(uint32_t) * indices.size());
-  unmapBuffer(dev, ibo);
+  Buffer vbo, ibo, meshStaging;
+  if (!meshFile) {
+    vbo = createBuffer(ctx, sizeof(Vertex) * vertices.size(),
+                       VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       true);
+    ibo = createBuffer(ctx, sizeof(uint32_t) * indices.size(),
+                       VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       true);
+
+    std::memcpy(mapBuffer(ctx, vbo), vertices.data(), sizeof(Vertex) * vertices.size());
+    unmapBuffer(ctx, vbo);
+    std::memcpy(mapBuffer(ctx, ibo), indices.data(), sizeof(uint32_t) * indices.size());
+    unmapBuffer(ctx, ibo);
+  }
+
+  // Ray batch: rays in, hit records or occlusion bits out. Always bound (one dummy
+  // element when unused).
+  std::vector<BatchRay> rays;
+  if (batchRays) {
+    const float demoLo[3] = {-1.0f, 0.0f, 0.0f}, demoHi[3] = {1.0f, 0.0f, 4.0f * EPSILON};
+    rays = makeProbeRays(batchRays, meshFile ? mesh.boundsMin : demoLo, meshFile ? mesh.boundsMax : demoHi);
+  } else {
+    rays.resize(1);
+  }
+  Buffer rayBuf = createDeviceLocalBuffer(ctx, rays.data(), sizeof(BatchRay) * rays.size(),
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false);
+  const bool occlusion = traceMode == TRACE_OCCLUSION;
+  Buffer hitBuf = createBuffer(ctx, sizeof(RayHit) * (occlusion ? 1 : rays.size()),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+  const uint32_t maskWords = occlusion ? (batchRays + 31) / 32 : 1;
+  Buffer maskBuf = createBuffer(ctx, sizeof(uint32_t) * maskWords,
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
 
   // Output image
   const uint32_t W = 5, H = 1;
-  Image outIm = createStorageImageRGBA32F(dev, phys, W, H);
+  Image outIm = createStorageImageRGBA32F(ctx, W, H);
   // The current layout is undefined: it has no valid contents and it is not usable by any GPU operation yet
   // So your shader cannot work on this image now.
 
@@ -632,13 +339,29 @@ int main() {
   VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
   VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
 
+  if (meshFile) {
+    uploadMesh(ctx, cmd, mesh, threads, vbo, ibo, meshStaging, meshStats);
+    std::cout << "Mesh " << meshFile << ": " << meshStats.fileBytes / (1024.0 * 1024.0) << " MiB, "
+        << meshStats.triangleCount << " triangles, " << meshStats.vertexCount << " vertices ("
+        << meshStats.inputVertices << " before dedup)\n  parse " << meshStats.parseMs << " ms ("
+        << meshStats.parseMBs() << " MB/s), dedup " << meshStats.dedupMs << " ms, write " << meshStats.writeMs
+        << " ms\n";
+  }
+
   // Build AS
+  uint32_t scope = profilerBegin(prof, cmd, "blas_build");
   Accel blas = createBLAS_Triangles(
-    dev, phys, cmd,
-    vbo, (uint32_t) vertices.size(), sizeof(Vertex),
-    ibo, (uint32_t) indices.size());
-
-  Accel tlas = createTLAS_OneInstance(dev, phys, cmd, blas.addr);
+    ctx, cmd,
+    vbo, vertexCount, sizeof(Vertex),
+    ibo, indexCount,
+    traceMode != TRACE_ALL_HITS ? VK_GEOMETRY_OPAQUE_BIT_KHR : 0); // not opaque: any-hit counts every crossing
+  profilerEnd(prof, cmd, scope);
+
+  scope = profilerBegin(prof, cmd, "tlas_build");
+  AccelInstance inst{};
+  inst.blas = blas.addr;
+  Accel tlas = createTLAS(ctx, cmd, &inst, 1);
+  profilerEnd(prof, cmd, scope);
 
   // Transition output image from UNDEFINED to GENERAL for storage writes
   // After that, the image is ready for operations from shader program.
@@ -663,10 +386,22 @@ int main() {
   b1.descriptorCount = 1;
   b1.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
 
-  VkDescriptorSetLayoutBinding bindings[] = {b0, b1};
+  VkDescriptorSetLayoutBinding b2{};
+  b2.binding = 2;
+  b2.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  b2.descriptorCount = 1;
+  b2.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+  VkDescriptorSetLayoutBinding b3 = b2;
+  b3.binding = 3;
+
+  VkDescriptorSetLayoutBinding b4 = b2;
+  b4.binding = 4;
+
+  VkDescriptorSetLayoutBinding bindings[] = {b0, b1, b2, b3, b4};
 
   VkDescriptorSetLayoutCreateInfo dslci{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-  dslci.bindingCount = 2;
+  dslci.bindingCount = 5;
   dslci.pBindings = bindings;
 
   VkDescriptorSetLayout dsl{};
@@ -680,10 +415,23 @@ int main() {
 
   Push push{};
   push.rayCount = RAY_COUNT;
+  push.traceMode = traceMode;
 
   push.originBase[0] = 0.0f;
   push.originBase[1] = 0.0f;
   push.originBase[2] = 0.0f;
+  push.xMin = -1.0f;
+  push.xMax = 1.0f;
+  push.tMax = 1.0f;
+  if (meshFile) {
+    // Same span as makeProbeRays: the X extent, lo.z - 1e-3 through hi.z + 1e-3
+    push.originBase[0] = 0.0f;
+    push.originBase[1] = 0.5f * (mesh.boundsMin[1] + mesh.boundsMax[1]);
+    push.originBase[2] = mesh.boundsMin[2] - 1e-3f;
+    push.xMin = mesh.boundsMin[0];
+    push.xMax = mesh.boundsMax[0];
+    push.tMax = mesh.boundsMax[2] - mesh.boundsMin[2] + 2e-3f;
+  }
 
   // dir = +z (must be normalized)
   push.dir[0] = 0.0f;
@@ -705,15 +453,17 @@ int main() {
   VkPipelineLayout pipelineLayout{};
   VK_CHECK(vkCreatePipelineLayout(dev, &plci, nullptr, &pipelineLayout));
 
-  VkDescriptorPoolSize ps[2]{};
+  VkDescriptorPoolSize ps[3]{};
   ps[0].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
   ps[0].descriptorCount = 1;
   ps[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
   ps[1].descriptorCount = 1;
+  ps[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  ps[2].descriptorCount = 3;
 
   VkDescriptorPoolCreateInfo dpci{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
   dpci.maxSets = 1;
-  dpci.poolSizeCount = 2;
+  dpci.poolSizeCount = 3;
   dpci.pPoolSizes = ps;
   VkDescriptorPool dpool{};
   VK_CHECK(vkCreateDescriptorPool(dev, &dpci, nullptr, &dpool));
@@ -750,8 +500,27 @@ int main() {
   w1.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
   w1.pImageInfo = &di;
 
-  VkWriteDescriptorSet writes[] = {w0, w1};
-  vkUpdateDescriptorSets(dev, 2, writes, 0, nullptr);
+  VkDescriptorBufferInfo rayInfo{rayBuf.buf, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo hitInfo{hitBuf.buf, 0, VK_WHOLE_SIZE};
+
+  VkWriteDescriptorSet w2{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  w2.dstSet = dset;
+  w2.dstBinding = 2;
+  w2.descriptorCount = 1;
+  w2.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  w2.pBufferInfo = &rayInfo;
+
+  VkWriteDescriptorSet w3 = w2;
+  w3.dstBinding = 3;
+  w3.pBufferInfo = &hitInfo;
+
+  VkDescriptorBufferInfo maskInfo{maskBuf.buf, 0, VK_WHOLE_SIZE};
+  VkWriteDescriptorSet w4 = w2;
+  w4.dstBinding = 4;
+  w4.pBufferInfo = &maskInfo;
+
+  VkWriteDescriptorSet writes[] = {w0, w1, w2, w3, w4};
+  vkUpdateDescriptorSets(dev, 5, writes, 0, nullptr);
 
   // ===============================================================
   // Ray tracing pipeline (raygen + miss + chit)
@@ -764,20 +533,13 @@ int main() {
   auto missSpv = loadSpv((shaderDir + "/" + "miss.spv").c_str());
   auto chitSpv = loadSpv((shaderDir + "/" +"chit.spv").c_str());
   auto ahitSpv = loadSpv((shaderDir + "/"+ "ahit.spv").c_str());
+  auto raygenBatchSpv = loadSpv((shaderDir + "/" + "raygen_batch.spv").c_str());
 
-  auto makeModule = [&](const std::vector<uint32_t> &code) {
-    VkShaderModuleCreateInfo smci{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-    smci.codeSize = code.size() * 4;
-    smci.pCode = code.data();
-    VkShaderModule m{};
-    VK_CHECK(vkCreateShaderModule(dev, &smci, nullptr, &m));
-    return m;
-  };
-
-  VkShaderModule mRaygen = makeModule(raygenSpv);
-  VkShaderModule mMiss = makeModule(missSpv);
-  VkShaderModule mChit = makeModule(chitSpv);
-  VkShaderModule mAhit = makeModule(ahitSpv);
+  VkShaderModule mRaygen = createShaderModule(dev, raygenSpv);
+  VkShaderModule mMiss = createShaderModule(dev, missSpv);
+  VkShaderModule mChit = createShaderModule(dev, chitSpv);
+  VkShaderModule mAhit = createShaderModule(dev, ahitSpv);
+  VkShaderModule mRaygenBatch = createShaderModule(dev, raygenBatchSpv);
 
   std::vector<VkPipelineShaderStageCreateInfo> stages;
   auto addStage = [&](VkShaderModule m, VkShaderStageFlagBits stage, const char *entry) {
@@ -795,8 +557,9 @@ int main() {
   addStage(mMiss, VK_SHADER_STAGE_MISS_BIT_KHR, "main"); // index-1
   addStage(mChit, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main"); // index-2
   addStage(mAhit, VK_SHADER_STAGE_ANY_HIT_BIT_KHR, "main"); // index-3
+  addStage(mRaygenBatch, VK_SHADER_STAGE_RAYGEN_BIT_KHR, "main"); // index-4
 
-  // Shader groups: 0=raygen, 1=miss, 2=hitgroup(chit)
+  // Shader groups: 0=raygen, 1=miss, 2=hitgroup(chit), 3=raygen (batch)
   std::vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
 
   VkRayTracingShaderGroupCreateInfoKHR g0{VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
@@ -824,6 +587,10 @@ int main() {
   g2.intersectionShader = VK_SHADER_UNUSED_KHR;
   groups.push_back(g2);
 
+  VkRayTracingShaderGroupCreateInfoKHR g3 = g0;
+  g3.generalShader = 4;
+  groups.push_back(g3);
+
   VkRayTracingPipelineCreateInfoKHR rpci{VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR};
   rpci.stageCount = (uint32_t) stages.size();
   rpci.pStages = stages.data();
@@ -836,133 +603,210 @@ int main() {
   std::cout << "miss size: " << missSpv.size() << "\n";
   std::cout << "chit size: " << chitSpv.size() << "\n";
 
-  VkPipeline pipeline{};
-  VK_CHECK(vkCreateRayTracingPipelinesKHR(dev, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rpci, nullptr, &pipeline));
+  VkPipeline pipeline = createRayTracingPipeline(ctx, rpci, "rt_triangle");
 
   // SBT
-  VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtp{
-    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR
-  };
-  VkPhysicalDeviceProperties2 p2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
-  p2.pNext = &rtp;
-  vkGetPhysicalDeviceProperties2(phys, &p2);
-
-  const uint32_t handleSize = rtp.shaderGroupHandleSize;
-  const uint32_t handleAlign = rtp.shaderGroupHandleAlignment;
-  auto alignUp = [&](uint32_t v, uint32_t a) { return (v + a - 1) & ~(a - 1); };
-  const uint32_t handleSizeAligned = alignUp(handleSize, handleAlign);
+  const uint32_t handleSize = ctx.caps.shaderGroupHandleSize;
+  const uint32_t handleAlign = ctx.caps.shaderGroupHandleAlignment;
+  const uint32_t handleSizeAligned = (uint32_t) alignUp(handleSize, handleAlign);
+  // Each region (raygen / miss / hit) must start on shaderGroupBaseAlignment
+  const VkDeviceSize regionSize = alignUp(handleSizeAligned, ctx.caps.shaderGroupBaseAlignment);
 
   const uint32_t groupCount = (uint32_t) groups.size();
   std::vector<uint8_t> handles(groupCount * handleSize);
   VK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(dev, pipeline, 0, groupCount, handles.size(), handles.data()));
 
   // One record each
-  Buffer sbt = createBuffer(dev, phys, groupCount * (VkDeviceSize) handleSizeAligned,
+  Buffer sbt = createBuffer(ctx, groupCount * regionSize,
                             VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                            true);
+                            true, ctx.caps.shaderGroupBaseAlignment);
 
   // copy the data on the cpu side but gpu can also access it
-  uint8_t *sbtMap = (uint8_t *) mapBuffer(dev, sbt);
+  uint8_t *sbtMap = (uint8_t *) mapBuffer(ctx, sbt);
   for (uint32_t i = 0; i < groupCount; i++)
-    std::memcpy(sbtMap + i * handleSizeAligned, handles.data() + i * handleSize, handleSize);
-  unmapBuffer(dev, sbt);
+    std::memcpy(sbtMap + i * regionSize, handles.data() + i * handleSize, handleSize);
+  unmapBuffer(ctx, sbt);
 
   VkStridedDeviceAddressRegionKHR rgenRegion{};
   VkStridedDeviceAddressRegionKHR missRegion{};
   VkStridedDeviceAddressRegionKHR hitRegion{};
   VkStridedDeviceAddressRegionKHR callRegion{};
 
-  rgenRegion.deviceAddress = sbt.addr + 0 * handleSizeAligned;
+  rgenRegion.deviceAddress = sbt.addr + (batchRays ? 3 : 0) * regionSize;
   rgenRegion.stride = handleSizeAligned;
   rgenRegion.size = handleSizeAligned;
 
-  missRegion.deviceAddress = sbt.addr + 1 * handleSizeAligned;
+  missRegion.deviceAddress = sbt.addr + 1 * regionSize;
   missRegion.stride = handleSizeAligned;
   missRegion.size = handleSizeAligned;
 
-  hitRegion.deviceAddress = sbt.addr + 2 * handleSizeAligned;
+  hitRegion.deviceAddress = sbt.addr + 2 * regionSize;
   hitRegion.stride = handleSizeAligned;
   hitRegion.size = handleSizeAligned;
 
   // Trace
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
   vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, 1, &dset, 0, nullptr);
-  vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(Push), &push);
 
-  // ray tracing writes into outIm
-  vkCmdTraceRaysKHR(cmd, &rgenRegion, &missRegion, &hitRegion, &callRegion, W, H, 1);
+  if (batchRays) {
+    if (occlusion) {
+      // Rays only ever set bits
+      vkCmdFillBuffer(cmd, maskBuf.buf, 0, VK_WHOLE_SIZE, 0);
+      cmdMemoryBarrier(cmd,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                       VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    // Launches of up to maxRayDispatchInvocationCount rays each, 2D/3D past the width limit
+    scope = profilerBegin(prof, cmd, "trace_batch");
+    uint32_t launches = 0;
+    for (uint64_t offset = 0; offset < batchRays; launches++) {
+      uint64_t covered = 0;
+      const VkExtent3D e = traceRaysExtent(ctx.caps, batchRays - offset, &covered);
+      push.rayOffset = (uint32_t) offset;
+      push.rayCount = (int) (offset + covered);
+      push.launchWidth = e.width;
+      push.launchHeight = e.height;
+      vkCmdPushConstants(cmd, pipelineLayout, pcr.stageFlags, 0, sizeof(Push), &push);
+      vkCmdTraceRaysKHR(cmd, &rgenRegion, &missRegion, &hitRegion, &callRegion, e.width, e.height, e.depth);
+      if (launches == 0)
+        std::cout << "Ray batch: " << batchRays << " rays (" << traceModeName(traceMode) << "), launch " << e.width << "x" << e.height << "x" << e.depth << "\n";
+      offset += covered;
+    }
+    profilerEnd(prof, cmd, scope);
+    if (launches > 1) std::cout << "  split into " << launches << " launches\n";
+  } else {
+    vkCmdPushConstants(cmd, pipelineLayout, pcr.stageFlags, 0, sizeof(Push), &push);
+
+    // ray tracing writes into outIm
+    scope = profilerBegin(prof, cmd, "trace");
+    vkCmdTraceRaysKHR(cmd, &rgenRegion, &missRegion, &hitRegion, &callRegion, W, H, 1);
+    profilerEnd(prof, cmd, scope);
+  }
 
   // Copy image back: outIm -> linear staging buffer via vkCmdCopyImageToBuffer
   // After RT Pipeline Computation
   // Copy into a buffer that cpu can map later (GPU -> GPU)
   VkDeviceSize pixelStride = sizeof(float) * 4;
   VkDeviceSize readbackSize = (VkDeviceSize) W * H * pixelStride;
+  if (batchRays) readbackSize = occlusion ? sizeof(uint32_t) * maskWords : sizeof(RayHit) * (VkDeviceSize) batchRays;
 
-  Buffer readback = createBuffer(dev, phys, readbackSize,
+  Buffer readback = createBuffer(ctx, readbackSize,
                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                  false);
 
-  // Transition for transfer
-  cmdTransitionImage(cmd, outIm.img, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-  VkBufferImageCopy bic{};
-  bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  bic.imageSubresource.layerCount = 1;
-  bic.imageExtent = {W, H, 1};
-
-  vkCmdCopyImageToBuffer(cmd, outIm.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buf, 1, &bic);
+  if (batchRays) {
+    // Hit records or the bitmask: plain buffer copy, no image layouts involved
+    cmdMemoryBarrier(cmd,
+                     VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    VkBufferCopy copy{0, 0, readbackSize};
+    scope = profilerBegin(prof, cmd, "readback_copy");
+    vkCmdCopyBuffer(cmd, occlusion ? maskBuf.buf : hitBuf.buf, readback.buf, 1, &copy);
+    profilerEnd(prof, cmd, scope);
+    cmdMemoryBarrier(cmd,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  } else {
+    // Transition for transfer
+    cmdTransitionImage(cmd, outIm.img, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+    VkBufferImageCopy bic{};
+    bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    bic.imageSubresource.layerCount = 1;
+    bic.imageExtent = {W, H, 1};
+
+    scope = profilerBegin(prof, cmd, "readback_copy");
+    vkCmdCopyImageToBuffer(cmd, outIm.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buf, 1, &bic);
+    profilerEnd(prof, cmd, scope);
+  }
 
   submitAndWait(dev, queue, cmd);
+  const size_t firstRecord = profilerResolve(ctx, prof);
+
+  if (batchRays && occlusion) {
+    const uint32_t *mask = (const uint32_t *) mapBuffer(ctx, readback);
+    uint64_t hitRays = 0;
+    for (uint32_t w = 0; w < maskWords; w++) hitRays += (uint64_t) std::popcount(mask[w]);
+    const double traceMs = profilerSumMs(prof, firstRecord, "trace_batch");
+    std::cout << "  rays with hits=" << hitRays << " of " << batchRays << " (mask " << sizeof(uint32_t) * maskWords
+        << " B)";
+    if (traceMs > 0) std::cout << " trace=" << traceMs << " ms (" << batchRays / (traceMs * 1e3) << " Mrays/s)";
+    std::cout << "\nFirst rays (occluded):\n";
+    for (uint32_t i = 0; i < std::min(batchRays, 5u); i++)
+      std::cout << "Ray " << i << " -> " << ((mask[i >> 5] >> (i & 31)) & 1u) << "\n";
+    unmapBuffer(ctx, readback);
+  } else if (batchRays) {
+    const RayHit *hits = (const RayHit *) mapBuffer(ctx, readback);
+    uint64_t hitRays = 0, crossings = 0;
+    for (uint32_t i = 0; i < batchRays; i++) {
+      hitRays += hits[i].hitCount > 0;
+      crossings += hits[i].hitCount;
+    }
+    const double traceMs = profilerSumMs(prof, firstRecord, "trace_batch");
+    std::cout << "  rays with hits=" << hitRays << " crossings=" << crossings;
+    if (traceMs > 0) std::cout << " trace=" << traceMs << " ms (" << batchRays / (traceMs * 1e3) << " Mrays/s)";
+    std::cout << "\nFirst hit records (t, primitive, hitCount):\n";
+    for (uint32_t i = 0; i < std::min(batchRays, 5u); i++)
+      std::cout << "Ray " << i << " -> t=" << hits[i].t << " prim=" << (int32_t) hits[i].primitive
+          << " hits=" << hits[i].hitCount << "\n";
+    unmapBuffer(ctx, readback);
+  } else {
+    // Inspect some pixels
+    float *data = (float *) mapBuffer(ctx, readback);
+    auto at = [&](uint32_t x, uint32_t y)-> float * {
+      return data + (y * W + x) * 4;
+    };
 
-  // Inspect some pixels
-  float *data = (float *) mapBuffer(dev, readback);
-  auto at = [&](uint32_t x, uint32_t y)-> float * {
-    return data + (y * W + x) * 4;
-  };
+    std::cout << "Ray results (closest.xyz, hitCount):\n";
+    for (uint32_t i = 0; i < RAY_COUNT; i++) {
+      float *p = at(i, 0);
+      std::cout << "Ray " << i
+          << " -> closest=("
+          << p[0] << ", " << p[1] << ", " << p[2]
+          << "), hits=" << p[3] << "\n";
+    }
 
-  // std::cout << "Sample pixels (x,y -> hitPos.xyz,w):\n";
-  // for (auto [x,y]: std::vector<std::pair<uint32_t, uint32_t> >{{128, 128}, {64, 64}, {200, 200}, {10, 10}}) {
-  //   float *p = at(x, y);
-  //   std::cout << "(" << x << "," << y << ") -> "
-  //       << p[0] << ", " << p[1] << ", " << p[2] << ", " << p[3] << "\n";
-  // }
-  //
-  std::cout << "Ray results (closest.xyz, hitCount):\n";
-  for (uint32_t i = 0; i < RAY_COUNT; i++) {
-    float *p = at(i, 0);
-    std::cout << "Ray " << i
-        << " -> closest=("
-        << p[0] << ", " << p[1] << ", " << p[2]
-        << "), hits=" << p[3] << "\n";
+    unmapBuffer(ctx, readback);
   }
 
-  unmapBuffer(dev, readback);
+  printProfile(prof);
+  if (profileFile) writeProfile(profileFile, ctx.caps, prof);
 
   // Cleanup
-  destroyBuffer(dev, readback);
-  destroyBuffer(dev, sbt);
+  destroyBuffer(ctx, readback);
+  destroyBuffer(ctx, sbt);
 
   vkDestroyPipeline(dev, pipeline, nullptr);
   vkDestroyShaderModule(dev, mRaygen, nullptr);
   vkDestroyShaderModule(dev, mMiss, nullptr);
   vkDestroyShaderModule(dev, mChit, nullptr);
+  vkDestroyShaderModule(dev, mAhit, nullptr);
+  vkDestroyShaderModule(dev, mRaygenBatch, nullptr);
 
   vkDestroyDescriptorPool(dev, dpool, nullptr);
   vkDestroyDescriptorSetLayout(dev, dsl, nullptr);
   vkDestroyPipelineLayout(dev, pipelineLayout, nullptr);
 
-  destroyAccel(dev, tlas);
-  destroyAccel(dev, blas);
+  destroyAccel(ctx, tlas);
+  destroyAccel(ctx, blas);
 
-  destroyImage(dev, outIm);
-  destroyBuffer(dev, vbo);
-  destroyBuffer(dev, ibo);
+  destroyImage(ctx, outIm);
+  destroyBuffer(ctx, vbo);
+  destroyBuffer(ctx, ibo);
+  destroyBuffer(ctx, meshStaging);
+  destroyBuffer(ctx, rayBuf);
+  destroyBuffer(ctx, hitBuf);
+  destroyBuffer(ctx, maskBuf);
+  if (meshFile) destroyThreadPool(threads);
 
+  destroyProfiler(ctx, prof);
   vkDestroyCommandPool(dev, pool, nullptr);
-  vkDestroyDevice(dev, nullptr);
-  vkDestroyInstance(instance, nullptr);
+  printAllocatorStats(allocatorStats(ctx.allocator));
+  printPipelineCacheStats(ctx.pipelineCache);
+  releaseContext();
 
   std::cout << "Done.\n";
   return 0;
@@ -0,0 +1,517 @@
+// mesh_io.cpp
+#include "mesh_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t OBJ_CHUNK_BYTES = 4u << 20;
+static constexpr uint64_t PLY_CHUNK_ELEMS = 1u << 16;
+
+static void fail(const char *path, const std::string &what) {
+  std::cerr << path << ": " << what << "\n";
+  std::exit(1);
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// ---- File ----
+struct MappedFile {
+  const char *data{};
+  size_t size{};
+};
+
+static MappedFile mapFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) fail(path, "cannot open");
+  struct stat st{};
+  if (fstat(fd, &st) != 0) fail(path, "cannot stat");
+
+  MappedFile f{};
+  f.size = (size_t) st.st_size;
+  if (f.size) {
+    void *p = mmap(nullptr, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) fail(path, "mmap failed");
+    madvise(p, f.size, MADV_WILLNEED);
+    f.data = (const char *) p;
+  }
+  close(fd);
+  return f;
+}
+
+static void unmapFile(MappedFile &f) {
+  if (f.data) munmap((void *) f.data, f.size);
+  f = {};
+}
+
+// ---- OBJ ----
+// Negative OBJ indices count back from the last vertex read so far, which a chunk only
+// knows relative to its own start: stored as OBJ_LOCAL + local index, resolved once the
+// vertex base of every chunk is known.
+static constexpr int64_t OBJ_LOCAL = -(int64_t(1) << 40);
+
+struct ObjChunk {
+  const char *begin{}, *end{};
+  std::vector<float> positions;
+  std::vector<int64_t> refs; // 3 per triangle: global index, or OBJ_LOCAL + local index
+  const char *error{};
+};
+
+static const char *skipSpace(const char *s, const char *end) {
+  while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+  return s;
+}
+
+static void parseObjChunk(ObjChunk &c) {
+  std::vector<int64_t> poly;
+  for (const char *p = c.begin; p < c.end;) {
+    const char *eol = (const char *) std::memchr(p, '\n', c.end - p);
+    if (!eol) eol = c.end;
+    const char *s = skipSpace(p, eol);
+    p = eol + 1;
+    if (eol - s < 2 || (s[1] != ' ' && s[1] != '\t')) continue; // vn, vt, o, g, usemtl, comments, ...
+
+    if (s[0] == 'v') {
+      s += 2;
+      for (int k = 0; k < 3; k++) {
+        float v;
+        auto r = std::from_chars(skipSpace(s, eol), eol, v);
+        if (r.ec != std::errc()) {
+          c.error = "malformed vertex";
+          return;
+        }
+        c.positions.push_back(v);
+        s = r.ptr;
+      }
+    } else if (s[0] == 'f') {
+      s += 2;
+      poly.clear();
+      const int64_t localCount = (int64_t) (c.positions.size() / 3);
+      for (s = skipSpace(s, eol); s < eol && *s != '#'; s = skipSpace(s, eol)) {
+        int64_t i;
+        auto r = std::from_chars(s, eol, i);
+        if (r.ec != std::errc() || i == 0) {
+          c.error = "malformed face";
+          return;
+        }
+        poly.push_back(i > 0 ? i - 1 : OBJ_LOCAL + localCount + i);
+        s = r.ptr;
+        while (s < eol && *s != ' ' && *s != '\t' && *s != '\r') s++; // /vt/vn
+      }
+      if (poly.size() < 3) {
+        c.error = "face with fewer than 3 vertices";
+        return;
+      }
+      for (size_t k = 1; k + 1 < poly.size(); k++) c.refs.insert(c.refs.end(), {poly[0], poly[k], poly[k + 1]});
+    }
+  }
+}
+
+static void parseObj(const char *path, const MappedFile &f, ThreadPool &pool, ParsedMesh &m) {
+  // Chunks end right after a newline, so no line is split.
+  const size_t chunkCount = std::max<size_t>(1, (f.size + OBJ_CHUNK_BYTES - 1) / OBJ_CHUNK_BYTES);
+  std::vector<ObjChunk> chunks(chunkCount);
+  const char *end = f.data + f.size;
+  const char *p = f.data;
+  for (size_t i = 0; i < chunkCount; i++) {
+    chunks[i].begin = p;
+    const char *cut = std::min(end, f.data + (i + 1) * OBJ_CHUNK_BYTES);
+    if (i + 1 == chunkCount) cut = end;
+    else if (cut < end && cut > p) {
+      const char *nl = (const char *) std::memchr(cut - 1, '\n', end - (cut - 1));
+      cut = nl ? nl + 1 : end;
+    }
+    chunks[i].end = std::max(cut, p);
+    p = chunks[i].end;
+  }
+
+  parallelFor(pool, chunkCount, 1, [&](uint64_t begin, uint64_t last, uint32_t) {
+    for (uint64_t i = begin; i < last; i++) parseObjChunk(chunks[i]);
+  });
+
+  // Vertex / index base of each chunk
+  std::vector<uint64_t> vbase(chunkCount), ibase(chunkCount);
+  uint64_t vertexCount = 0, indexCount = 0;
+  for (size_t i = 0; i < chunkCount; i++) {
+    if (chunks[i].error) fail(path, chunks[i].error);
+    vbase[i] = vertexCount;
+    ibase[i] = indexCount;
+    vertexCount += chunks[i].positions.size() / 3;
+    indexCount += chunks[i].refs.size();
+  }
+  if (vertexCount >= UINT32_MAX || indexCount > UINT32_MAX) fail(path, "too large for 32-bit indices");
+
+  m.positions.resize(vertexCount * 3);
+  m.indices.resize(indexCount);
+  std::atomic<bool> outOfRange{false};
+  parallelFor(pool, chunkCount, 1, [&](uint64_t begin, uint64_t last, uint32_t) {
+    for (uint64_t i = begin; i < last; i++) {
+      const ObjChunk &c = chunks[i];
+      std::copy(c.positions.begin(), c.positions.end(), m.positions.begin() + vbase[i] * 3);
+      for (size_t k = 0; k < c.refs.size(); k++) {
+        const int64_t r = c.refs[k];
+        const int64_t g = r >= 0 ? r : (int64_t) vbase[i] + (r - OBJ_LOCAL);
+        if (g < 0 || g >= (int64_t) vertexCount) outOfRange = true;
+        m.indices[ibase[i] + k] = (uint32_t) g;
+      }
+    }
+  });
+  if (outOfRange) fail(path, "face index out of range");
+}
+
+// ---- PLY ----
+enum class PlyType { Invalid, I8, U8, I16, U16, I32, U32, F32, F64 };
+
+struct PlyProp {
+  std::string name;
+  PlyType type{};
+  bool list{};
+  PlyType countType{}; // list only
+};
+
+struct PlyElem {
+  std::string name;
+  uint64_t count{};
+  std::vector<PlyProp> props;
+};
+
+static PlyType plyType(const std::string &s) {
+  if (s == "char" || s == "int8") return PlyType::I8;
+  if (s == "uchar" || s == "uint8") return PlyType::U8;
+  if (s == "short" || s == "int16") return PlyType::I16;
+  if (s == "ushort" || s == "uint16") return PlyType::U16;
+  if (s == "int" || s == "int32") return PlyType::I32;
+  if (s == "uint" || s == "uint32") return PlyType::U32;
+  if (s == "float" || s == "float32") return PlyType::F32;
+  if (s == "double" || s == "float64") return PlyType::F64;
+  return PlyType::Invalid;
+}
+
+static uint32_t plySize(PlyType t) {
+  switch (t) {
+    case PlyType::I8: case PlyType::U8: return 1;
+    case PlyType::I16: case PlyType::U16: return 2;
+    case PlyType::I32: case PlyType::U32: case PlyType::F32: return 4;
+    case PlyType::F64: return 8;
+    default: return 0;
+  }
+}
+
+template<typename T>
+static T loadAs(const char *p, bool swap) {
+  T v;
+  char b[sizeof(T)];
+  std::memcpy(b, p, sizeof(T));
+  if (swap) std::reverse(b, b + sizeof(T));
+  std::memcpy(&v, b, sizeof(T));
+  return v;
+}
+
+static double plyRead(const char *p, PlyType t, bool swap) {
+  switch (t) {
+    case PlyType::I8: return (int8_t) *p;
+    case PlyType::U8: return (uint8_t) *p;
+    case PlyType::I16: return loadAs<int16_t>(p, swap);
+    case PlyType::U16: return loadAs<uint16_t>(p, swap);
+    case PlyType::I32: return loadAs<int32_t>(p, swap);
+    case PlyType::U32: return loadAs<uint32_t>(p, swap);
+    case PlyType::F32: return loadAs<float>(p, swap);
+    case PlyType::F64: return loadAs<double>(p, swap);
+    default: return 0;
+  }
+}
+
+// Header lines up to end_header; returns the offset of the binary body.
+static size_t parsePlyHeader(const char *path, const MappedFile &f, std::vector<PlyElem> &elems, bool &swap) {
+  const std::string_view text(f.data, f.size);
+  if (text.substr(0, 4) != "ply\n" && text.substr(0, 5) != "ply\r\n") fail(path, "not a PLY file");
+
+  bool haveFormat = false;
+  size_t pos = 0;
+  while (true) {
+    const size_t eol = text.find('\n', pos);
+    if (eol == std::string_view::npos) fail(path, "PLY header without end_header");
+    std::string line(text.substr(pos, eol - pos));
+    pos = eol + 1;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    std::vector<std::string> tok;
+    for (size_t i = 0; i < line.size();) {
+      while (i < line.size() && line[i] == ' ') i++;
+      size_t j = line.find(' ', i);
+      if (j == std::string::npos) j = line.size();
+      if (j > i) tok.push_back(line.substr(i, j - i));
+      i = j;
+    }
+    if (tok.empty() || tok[0] == "comment" || tok[0] == "obj_info" || tok[0] == "ply") continue;
+
+    if (tok[0] == "end_header") break;
+    if (tok[0] == "format" && tok.size() >= 2) {
+      if (tok[1] == "binary_little_endian") swap = false;
+      else if (tok[1] == "binary_big_endian") swap = true;
+      else fail(path, "only binary PLY is supported (format " + tok[1] + ")");
+      haveFormat = true;
+    } else if (tok[0] == "element" && tok.size() == 3) {
+      elems.push_back({tok[1], std::strtoull(tok[2].c_str(), nullptr, 10), {}});
+    } else if (tok[0] == "property" && !elems.empty()) {
+      PlyProp prop;
+      if (tok.size() == 5 && tok[1] == "list") {
+        prop.list = true;
+        prop.countType = plyType(tok[2]);
+        prop.type = plyType(tok[3]);
+        prop.name = tok[4];
+        if (prop.countType == PlyType::Invalid || prop.countType == PlyType::F32 || prop.countType == PlyType::F64)
+          fail(path, "bad PLY list count type");
+      } else if (tok.size() == 3) {
+        prop.type = plyType(tok[1]);
+        prop.name = tok[2];
+      }
+      if (prop.type == PlyType::Invalid) fail(path, "bad PLY property: " + line);
+      elems.back().props.push_back(prop);
+    } else {
+      fail(path, "bad PLY header line: " + line);
+    }
+  }
+  if (!haveFormat) fail(path, "PLY header without format");
+  return pos;
+}
+
+static bool isFaceIndexList(const PlyProp &p) {
+  return p.list && (p.name == "vertex_indices" || p.name == "vertex_index");
+}
+
+static void parsePly(const char *path, const MappedFile &f, ThreadPool &pool, ParsedMesh &m) {
+  std::vector<PlyElem> elems;
+  bool swap = false;
+  const char *p = f.data + parsePlyHeader(path, f, elems, swap);
+  const char *end = f.data + f.size;
+  uint64_t vertexCount = 0;
+  bool haveVertices = false;
+
+  for (const PlyElem &e: elems) {
+    const bool isVertex = e.name == "vertex";
+    const bool isFace = e.name == "face";
+    bool fixed = true;
+    uint32_t stride = 0;
+    for (const PlyProp &prop: e.props) {
+      fixed &= !prop.list;
+      stride += plySize(prop.type);
+    }
+
+    if (isVertex) {
+      if (haveVertices) fail(path, "PLY with more than one vertex element");
+      if (!fixed) fail(path, "PLY vertex element with list properties");
+      int offset[3] = {-1, -1, -1};
+      PlyType type[3]{};
+      uint32_t o = 0;
+      for (const PlyProp &prop: e.props) {
+        const int k = prop.name == "x" ? 0 : prop.name == "y" ? 1 : prop.name == "z" ? 2 : -1;
+        if (k >= 0) {
+          offset[k] = (int) o;
+          type[k] = prop.type;
+        }
+        o += plySize(prop.type);
+      }
+      if (offset[0] < 0 || offset[1] < 0 || offset[2] < 0) fail(path, "PLY vertex element without x/y/z");
+      if (e.count >= UINT32_MAX || (uint64_t) (end - p) / std::max(stride, 1u) < e.count) fail(path, "PLY vertex data truncated");
+
+      vertexCount = e.count;
+      haveVertices = true;
+      m.positions.resize(e.count * 3);
+      const char *base = p;
+      parallelFor(pool, e.count, PLY_CHUNK_ELEMS, [&](uint64_t begin, uint64_t last, uint32_t) {
+        for (uint64_t v = begin; v < last; v++) {
+          const char *rec = base + v * stride;
+          for (int k = 0; k < 3; k++) m.positions[v * 3 + k] = (float) plyRead(rec + offset[k], type[k], swap);
+        }
+      });
+      p += e.count * stride;
+      continue;
+    }
+
+    if (fixed) {
+      // Other fixed-size elements are skipped in one step
+      if ((uint64_t) (end - p) / std::max(stride, 1u) < e.count) fail(path, "PLY element " + e.name + " truncated");
+      p += e.count * stride;
+      continue;
+    }
+
+    // Variable-size records: one sequential pass over the list counts finds the chunk
+    // starts and, for faces, the triangles per chunk.
+    std::vector<const char *> chunkStart;
+    std::vector<uint64_t> chunkTris;
+    uint64_t tris = 0;
+    for (uint64_t i = 0; i < e.count; i++) {
+      if (i % PLY_CHUNK_ELEMS == 0) {
+        chunkStart.push_back(p);
+        chunkTris.push_back(tris);
+      }
+      for (const PlyProp &prop: e.props) {
+        const uint32_t cs = prop.list ? plySize(prop.countType) : 0;
+        if (end - p < (ptrdiff_t) cs) fail(path, "PLY element " + e.name + " truncated");
+        const double count = prop.list ? plyRead(p, prop.countType, swap) : 1;
+        if (count < 0) fail(path, "PLY element " + e.name + " with a negative list count");
+        const uint64_t n = (uint64_t) count;
+        if (isFace && isFaceIndexList(prop)) {
+          if (n < 3) fail(path, "PLY face with fewer than 3 vertices");
+          tris += n - 2;
+        }
+        const uint64_t bytes = cs + n * plySize(prop.type);
+        if ((uint64_t) (end - p) < bytes) fail(path, "PLY element " + e.name + " truncated");
+        p += bytes;
+      }
+    }
+    if (!isFace) continue;
+    // Several face elements are appended in file order
+    const uint64_t firstIndex = m.indices.size();
+    if (firstIndex + tris * 3 > UINT32_MAX) fail(path, "too large for 32-bit indices");
+
+    m.indices.resize(firstIndex + tris * 3);
+    parallelFor(pool, chunkStart.size(), 1, [&](uint64_t begin, uint64_t last, uint32_t) {
+      std::vector<uint32_t> poly;
+      for (uint64_t c = begin; c < last; c++) {
+        const char *q = chunkStart[c];
+        uint32_t *out = m.indices.data() + firstIndex + chunkTris[c] * 3;
+        const uint64_t faceEnd = std::min(e.count, (c + 1) * PLY_CHUNK_ELEMS);
+        for (uint64_t i = c * PLY_CHUNK_ELEMS; i < faceEnd; i++) {
+          for (const PlyProp &prop: e.props) {
+            const uint32_t cs = prop.list ? plySize(prop.countType) : 0;
+            const uint64_t n = prop.list ? (uint64_t) plyRead(q, prop.countType, swap) : 1;
+            q += cs;
+            if (isFaceIndexList(prop)) {
+              poly.resize(n);
+              for (uint64_t k = 0; k < n; k++) {
+                // Negative (signed types) or huge: left to the range check below
+                const double v = plyRead(q + k * plySize(prop.type), prop.type, swap);
+                poly[k] = v >= 0 && v < (double) UINT32_MAX ? (uint32_t) v : UINT32_MAX;
+              }
+              for (uint64_t k = 1; k + 1 < n; k++) {
+                *out++ = poly[0];
+                *out++ = poly[k];
+                *out++ = poly[k + 1];
+              }
+            }
+            q += n * plySize(prop.type);
+          }
+        }
+      }
+    });
+  }
+  if (!haveVertices) fail(path, "PLY without vertex element");
+
+  std::atomic<bool> outOfRange{false};
+  parallelFor(pool, m.indices.size(), 1u << 20, [&](uint64_t begin, uint64_t last, uint32_t) {
+    bool bad = false;
+    for (uint64_t i = begin; i < last; i++) bad |= m.indices[i] >= vertexCount;
+    if (bad) outOfRange = true;
+  });
+  if (outOfRange) fail(path, "face index out of range");
+}
+
+// ---- Dedup ----
+static uint32_t floatKey(float f) {
+  f += 0.0f; // -0 -> +0
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+// Open addressing on the bit patterns of the positions; unique vertices keep the order
+// of their first occurrence (and with it the file's locality).
+static void dedupVertices(ParsedMesh &m) {
+  const uint64_t n = m.positions.size() / 3;
+  uint64_t cap = 16;
+  while (cap < 2 * n) cap <<= 1;
+  std::vector<uint32_t> table(cap, UINT32_MAX);
+
+  m.remap.resize(n);
+  m.firstOf.clear();
+  m.firstOf.reserve(n);
+  for (int k = 0; k < 3; k++) {
+    m.boundsMin[k] = n ? +INFINITY : 0.0f;
+    m.boundsMax[k] = n ? -INFINITY : 0.0f;
+  }
+
+  for (uint64_t v = 0; v < n; v++) {
+    const float *p = &m.positions[v * 3];
+    const uint32_t kx = floatKey(p[0]), ky = floatKey(p[1]), kz = floatKey(p[2]);
+    uint64_t h = (kx * 0x9E3779B1ull) ^ (ky * 0x85EBCA77ull) ^ (kz * 0xC2B2AE3Dull);
+    h ^= h >> 29;
+    for (uint64_t slot = h & (cap - 1);; slot = (slot + 1) & (cap - 1)) {
+      const uint32_t u = table[slot];
+      if (u == UINT32_MAX) {
+        table[slot] = m.remap[v] = (uint32_t) m.firstOf.size();
+        m.firstOf.push_back((uint32_t) v);
+        for (int k = 0; k < 3; k++) {
+          m.boundsMin[k] = std::min(m.boundsMin[k], p[k]);
+          m.boundsMax[k] = std::max(m.boundsMax[k], p[k]);
+        }
+        break;
+      }
+      const float *q = &m.positions[(uint64_t) m.firstOf[u] * 3];
+      if (floatKey(q[0]) == kx && floatKey(q[1]) == ky && floatKey(q[2]) == kz) {
+        m.remap[v] = u;
+        break;
+      }
+    }
+  }
+}
+
+// ---- API ----
+ParsedMesh parseMesh(const char *path, ThreadPool &pool, MeshLoadStats *stats) {
+  MeshLoadStats st{};
+  auto t0 = std::chrono::steady_clock::now();
+
+  const std::string p(path);
+  const std::string ext = p.size() >= 4 ? p.substr(p.size() - 4) : "";
+  const bool ply = ext == ".ply" || ext == ".PLY";
+  if (!ply && ext != ".obj" && ext != ".OBJ") fail(path, "unknown mesh format (expected .obj or .ply)");
+
+  MappedFile f = mapFile(path);
+  ParsedMesh m;
+  if (ply) parsePly(path, f, pool, m);
+  else parseObj(path, f, pool, m);
+  st.fileBytes = f.size;
+  unmapFile(f);
+  st.parseMs = msSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  dedupVertices(m);
+  st.dedupMs = msSince(t0);
+
+  st.inputVertices = m.positions.size() / 3;
+  st.vertexCount = meshVertexCount(m);
+  st.triangleCount = meshIndexCount(m) / 3;
+  if (stats) *stats = st;
+  return m;
+}
+
+void writeMesh(const ParsedMesh &m, ThreadPool &pool, float *positions, uint32_t *indices, MeshLoadStats *stats) {
+  auto t0 = std::chrono::steady_clock::now();
+  if (positions) {
+    parallelFor(pool, m.firstOf.size(), 1u << 16, [&](uint64_t begin, uint64_t end, uint32_t) {
+      for (uint64_t u = begin; u < end; u++)
+        std::memcpy(positions + u * 3, &m.positions[(uint64_t) m.firstOf[u] * 3], sizeof(float) * 3);
+    });
+  }
+  if (indices) {
+    parallelFor(pool, m.indices.size(), 1u << 18, [&](uint64_t begin, uint64_t end, uint32_t) {
+      for (uint64_t i = begin; i < end; i++) indices[i] = m.remap[m.indices[i]];
+    });
+  }
+  if (stats) stats->writeMs = msSince(t0);
+}
@@ -0,0 +1,48 @@
+// mesh_io.h - triangle meshes from Wavefront OBJ and binary PLY.
+//
+// The file is mmap'd and cut into chunks that are parsed on a thread pool: OBJ at line
+// boundaries, PLY at fixed-stride vertex runs and at face offsets found by one pass over
+// the list counts. Only positions are kept; polygons are fan-triangulated. Vertices with
+// identical positions (OBJ/PLY exports duplicate them per normal / UV seam) are merged,
+// so the index buffer really shares vertices.
+//
+// Two steps, so the caller can size its buffers before anything is written:
+//   ParsedMesh m = parseMesh(path, pool, &stats);
+//   writeMesh(m, pool, mappedPositions, mappedIndices, &stats);  // e.g. straight into staging memory
+#pragma once
+
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+struct MeshLoadStats {
+  uint64_t fileBytes{};
+  uint64_t inputVertices{}; // before deduplication
+  uint32_t vertexCount{};
+  uint32_t triangleCount{};
+  double parseMs{}; // mmap + chunked parse
+  double dedupMs{};
+  double writeMs{}; // writeMesh
+  double parseMBs() const { return parseMs > 0 ? fileBytes / (parseMs * 1e3) : 0.0; }
+};
+
+struct ParsedMesh {
+  std::vector<float> positions; // xyz per input vertex
+  std::vector<uint32_t> indices; // 3 per triangle, into positions
+  std::vector<uint32_t> remap; // input vertex -> unique vertex
+  std::vector<uint32_t> firstOf; // unique vertex -> its first input vertex
+  float boundsMin[3]{}, boundsMax[3]{};
+};
+
+// .obj (text) or .ply (binary_little_endian / binary_big_endian), by extension.
+// Exits on unreadable or malformed files and out-of-range indices.
+ParsedMesh parseMesh(const char *path, ThreadPool &pool, MeshLoadStats *stats = nullptr);
+
+inline uint32_t meshVertexCount(const ParsedMesh &m) { return (uint32_t) m.firstOf.size(); }
+inline uint32_t meshIndexCount(const ParsedMesh &m) { return (uint32_t) m.indices.size(); }
+
+// Deduplicated xyz positions (3 * meshVertexCount floats) and remapped indices
+// (meshIndexCount), written in parallel. Either pointer may be null.
+void writeMesh(const ParsedMesh &m, ThreadPool &pool, float *positions, uint32_t *indices,
+               MeshLoadStats *stats = nullptr);
@@ -0,0 +1,81 @@
+// bench_k.cpp - sweeps base edges per AABB primitive (K) for the bucketed LSI BLAS.
+//
+// For every K: BLAS primitive count and size, GPU build time (BLAS + TLAS) and GPU
+// trace time (two-pass: count + scan + write) of the same query batch.
+// Hit counts must not depend on K; a mismatch is reported.
+//
+// Usage: VkPrimeRtLsiBenchK [--cells=N] [--segs=N] [--queries=N] [--qlen=F] [--k=1,2,4,...]
+
+#include "lsi_engine.h"
+#include "lsi_synth.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+  uint32_t cells = 256; // 256x256 street grid
+  uint32_t segs = 8; // edges per street block -> ~1M base edges
+  uint32_t queries = 1u << 18;
+  float qlen = 0.05f;
+  std::vector<uint32_t> ks = {1, 2, 4, 8, 16, 32, 64};
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (std::strncmp(a, "--cells=", 8) == 0) cells = (uint32_t) std::atoi(a + 8);
+    else if (std::strncmp(a, "--segs=", 7) == 0) segs = (uint32_t) std::atoi(a + 7);
+    else if (std::strncmp(a, "--queries=", 10) == 0) queries = (uint32_t) std::atoi(a + 10);
+    else if (std::strncmp(a, "--qlen=", 7) == 0) qlen = (float) std::atof(a + 7);
+    else if (std::strncmp(a, "--k=", 4) == 0) {
+      ks.clear();
+      std::stringstream ss(a + 4);
+      std::string tok;
+      while (std::getline(ss, tok, ',')) ks.push_back((uint32_t) std::atoi(tok.c_str()));
+    }
+  }
+
+  VkContext &ctx = getContext();
+  if (!ctx.caps.rayTracingPipeline) {
+    std::cerr << "No RT-capable GPU found\n";
+    return 1;
+  }
+  printCaps(ctx.caps);
+
+  LineMap base = makeRoadGrid(cells, segs, 0.2f, 1);
+  LineMap query = makeRandomSegments(queries, qlen, 2);
+  std::cout << "base edges=" << base.edges.size() << " query edges=" << query.edges.size() << "\n";
+
+  LsiEngine engine{};
+  initLsiEngine(ctx, engine);
+
+  std::printf("%6s %10s %10s %10s %10s %12s %12s\n",
+              "K", "prims", "BLAS MiB", "build ms", "trace ms", "Mrays/s", "hits");
+  uint64_t refHits = UINT64_MAX;
+  for (uint32_t k: ks) {
+    LsiScene scene = createLsiScene(ctx, engine, base, k);
+
+    // Warm-up, then measured run
+    LsiQueryStats st{};
+    lsiIntersect(ctx, engine, scene, query, {}, &st);
+    lsiIntersect(ctx, engine, scene, query, {}, &st);
+
+    std::printf("%6u %10u %10.2f %10.3f %10.3f %12.1f %12llu\n",
+                k, scene.primCount, lsiSceneBlasBytes(scene) / (1024.0 * 1024.0), scene.buildMs,
+                st.traceMs, st.traceMs > 0 ? query.edges.size() / (st.traceMs * 1e3) : 0.0,
+                (unsigned long long) st.hitCount);
+
+    if (refHits == UINT64_MAX) refHits = st.hitCount;
+    else if (st.hitCount != refHits) std::cout << "  hit count differs from K=" << ks[0] << "!\n";
+
+    destroyLsiScene(ctx, scene);
+  }
+
+  destroyLsiEngine(ctx, engine);
+  releaseContext();
+  return 0;
+}
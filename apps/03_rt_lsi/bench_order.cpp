@@ -0,0 +1,83 @@
+// bench_order.cpp - trace time of input vs Morton vs Hilbert ray launch order.
+//
+// Same base map and query batch for every order; reports GPU trace time (two-pass),
+// host sort time and the delta against input order. Hit counts must match.
+//
+// Usage: VkPrimeRtLsiBenchOrder [--cells=N] [--segs=N] [--queries=N] [--qlen=F] [--k=N] [--runs=N]
+
+#include "lsi_engine.h"
+#include "lsi_synth.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char **argv) {
+  uint32_t cells = 256;
+  uint32_t segs = 8;
+  uint32_t queries = 1u << 20;
+  float qlen = 0.05f;
+  uint32_t k = 4;
+  uint32_t runs = 5;
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (std::strncmp(a, "--cells=", 8) == 0) cells = (uint32_t) std::atoi(a + 8);
+    else if (std::strncmp(a, "--segs=", 7) == 0) segs = (uint32_t) std::atoi(a + 7);
+    else if (std::strncmp(a, "--queries=", 10) == 0) queries = (uint32_t) std::atoi(a + 10);
+    else if (std::strncmp(a, "--qlen=", 7) == 0) qlen = (float) std::atof(a + 7);
+    else if (std::strncmp(a, "--k=", 4) == 0) k = (uint32_t) std::atoi(a + 4);
+    else if (std::strncmp(a, "--runs=", 7) == 0) runs = std::max(1, std::atoi(a + 7));
+  }
+
+  VkContext &ctx = getContext();
+  if (!ctx.caps.rayTracingPipeline) {
+    std::cerr << "No RT-capable GPU found\n";
+    return 1;
+  }
+  printCaps(ctx.caps);
+
+  LineMap base = makeRoadGrid(cells, segs, 0.2f, 1);
+  LineMap query = makeRandomSegments(queries, qlen, 2); // random = worst case input order
+  std::cout << "base edges=" << base.edges.size() << " query edges=" << query.edges.size()
+      << " K=" << k << " runs=" << runs << "\n";
+
+  LsiEngine engine{};
+  initLsiEngine(ctx, engine);
+  LsiScene scene = createLsiScene(ctx, engine, base, k);
+
+  std::printf("%8s %10s %10s %10s %12s\n", "order", "sort ms", "trace ms", "delta", "hits");
+  double inputMs = 0;
+  uint64_t refHits = 0;
+  for (LsiQueryOrder order: {LsiQueryOrder::Input, LsiQueryOrder::Morton, LsiQueryOrder::Hilbert}) {
+    LsiQueryOptions opts{};
+    opts.order = order;
+
+    // Warm-up, then best of runs
+    LsiQueryStats st{};
+    lsiIntersect(ctx, engine, scene, query, opts, &st);
+    double best = 1e30, sortMs = 0;
+    for (uint32_t r = 0; r < runs; r++) {
+      lsiIntersect(ctx, engine, scene, query, opts, &st);
+      best = std::min(best, st.traceMs);
+      sortMs = st.sortMs;
+    }
+
+    if (order == LsiQueryOrder::Input) {
+      inputMs = best;
+      refHits = st.hitCount;
+    }
+    std::printf("%8s %10.3f %10.3f %+9.1f%% %12llu\n", queryOrderName(order), sortMs, best,
+                inputMs > 0 ? (best - inputMs) / inputMs * 100.0 : 0.0, (unsigned long long) st.hitCount);
+    if (st.hitCount != refHits) std::cout << "  hit count differs from input order!\n";
+  }
+
+  destroyLsiScene(ctx, scene);
+  destroyLsiEngine(ctx, engine);
+  releaseContext();
+  return 0;
+}
@@ -0,0 +1,130 @@
+// lsi_bucket.cpp
+#include "lsi_bucket.h"
+#include "lsi_spatial.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+EdgeBuckets bucketEdges(LineMapView map, uint32_t edgesPerBucket) {
+  const uint32_t K = std::max(edgesPerBucket, 1u);
+  const uint32_t edgeCount = (uint32_t) map.edgeCount;
+
+  EdgeBuckets out;
+  out.edgeIds = spaceCurveOrder(edgeCenters(map), SpaceCurve::Morton);
+
+  const uint32_t bucketCount = (edgeCount + K - 1) / K;
+  out.aabbs.resize(bucketCount);
+  out.ranges.resize(bucketCount);
+
+  for (uint32_t b = 0; b < bucketCount; b++) {
+    BucketRange r{b * K, std::min(K, edgeCount - b * K)};
+    out.ranges[b] = r;
+    out.aabbs[b] = bucketAabb(map, out.edgeIds.data(), r);
+  }
+  out.tiles.push_back({0, bucketCount});
+  return out;
+}
+
+// k-d split of ids[0, n) (edge ids) into runs of at most maxEdges, appended to tiles as
+// {offset into the id array, count}.
+static void splitTiles(const std::vector<Point2> &centers, uint32_t *ids, uint32_t offset, uint32_t n,
+                       uint32_t maxEdges, std::vector<BucketRange> &tiles) {
+  if (n <= maxEdges) {
+    if (n) tiles.push_back({offset, n});
+    return;
+  }
+  Bounds2 b{+1e30f, +1e30f, -1e30f, -1e30f};
+  for (uint32_t i = 0; i < n; i++) {
+    const Point2 &c = centers[ids[i]];
+    b.minX = std::min(b.minX, c.x);
+    b.maxX = std::max(b.maxX, c.x);
+    b.minY = std::min(b.minY, c.y);
+    b.maxY = std::max(b.maxY, c.y);
+  }
+  const bool splitX = b.maxX - b.minX >= b.maxY - b.minY;
+  const uint32_t half = n / 2;
+  std::nth_element(ids, ids + half, ids + n, [&](uint32_t a, uint32_t c) {
+    return splitX ? centers[a].x < centers[c].x : centers[a].y < centers[c].y;
+  });
+  splitTiles(centers, ids, offset, half, maxEdges, tiles);
+  splitTiles(centers, ids + half, offset + half, n - half, maxEdges, tiles);
+}
+
+EdgeBuckets bucketEdgesTiled(LineMapView map, uint32_t edgesPerBucket, uint32_t maxTileEdges, ThreadPool *pool) {
+  const uint32_t K = std::max(edgesPerBucket, 1u);
+  const uint32_t edgeCount = (uint32_t) map.edgeCount;
+  if (!maxTileEdges || edgeCount <= maxTileEdges) return bucketEdges(map, K);
+
+  const std::vector<Point2> centers = edgeCenters(map);
+  EdgeBuckets out;
+  out.edgeIds.resize(edgeCount);
+  for (uint32_t i = 0; i < edgeCount; i++) out.edgeIds[i] = i;
+
+  // Buckets never span tiles: the last one of a tile may hold fewer than K edges.
+  std::vector<BucketRange> tileEdges; // into edgeIds
+  splitTiles(centers, out.edgeIds.data(), 0, edgeCount, maxTileEdges, tileEdges);
+
+  const uint32_t tileCount = (uint32_t) tileEdges.size();
+  out.tiles.resize(tileCount);
+  uint32_t primCount = 0;
+  for (uint32_t t = 0; t < tileCount; t++) {
+    const uint32_t n = (tileEdges[t].count + K - 1) / K;
+    out.tiles[t] = {primCount, n};
+    primCount += n;
+  }
+  out.aabbs.resize(primCount);
+  out.ranges.resize(primCount);
+
+  auto bucketTile = [&](uint32_t t) {
+    const BucketRange te = tileEdges[t];
+    uint32_t *ids = out.edgeIds.data() + te.first;
+
+    // Morton order inside the tile
+    std::vector<Point2> c(te.count);
+    for (uint32_t i = 0; i < te.count; i++) c[i] = centers[ids[i]];
+    const std::vector<uint32_t> order = spaceCurveOrder(c, SpaceCurve::Morton);
+    std::vector<uint32_t> sorted(te.count);
+    for (uint32_t i = 0; i < te.count; i++) sorted[i] = ids[order[i]];
+    std::copy(sorted.begin(), sorted.end(), ids);
+
+    for (uint32_t b = 0; b < out.tiles[t].primCount; b++) {
+      BucketRange r{te.first + b * K, std::min(K, te.count - b * K)};
+      out.ranges[out.tiles[t].firstPrim + b] = r;
+      out.aabbs[out.tiles[t].firstPrim + b] = bucketAabb(map, out.edgeIds.data(), r);
+    }
+  };
+  if (pool) {
+    parallelFor(*pool, tileCount, 1, [&](uint64_t begin, uint64_t end, uint32_t) {
+      for (uint64_t t = begin; t < end; t++) bucketTile((uint32_t) t);
+    });
+  } else {
+    for (uint32_t t = 0; t < tileCount; t++) bucketTile(t);
+  }
+  return out;
+}
+
+VkAabbPositionsKHR bucketAabb(LineMapView map, const uint32_t *edgeIds, BucketRange r) {
+  // Slightly inflated so segments lying exactly on an AABB face are not missed.
+  const float eps = 1e-5f;
+  VkAabbPositionsKHR box;
+  box.minX = box.minY = +1e30f;
+  box.maxX = box.maxY = -1e30f;
+  for (uint32_t i = r.first; i < r.first + r.count; i++) {
+    const Edge &e = map.edges[edgeIds[i]];
+    for (uint32_t pi: {e.p1_idx, e.p2_idx}) {
+      const Point2 &p = map.points[pi];
+      box.minX = std::min(box.minX, p.x);
+      box.maxX = std::max(box.maxX, p.x);
+      box.minY = std::min(box.minY, p.y);
+      box.maxY = std::max(box.maxY, p.y);
+    }
+  }
+  box.minX -= eps;
+  box.minY -= eps;
+  box.maxX += eps;
+  box.maxY += eps;
+  box.minZ = -eps;
+  box.maxZ = +eps;
+  return box;
+}
@@ -0,0 +1,67 @@
+// lsi_bucket.h - groups base edges into AABB primitives for the BLAS.
+//
+// Edges are sorted along a Morton curve of their midpoints and cut into runs of
+// K consecutive edges; each run becomes one AABB. The intersection shader looks up
+// the run of its primitive in a range table and tests every edge of it. Larger K
+// means fewer primitives (smaller BLAS, faster build) but more segment tests per
+// candidate; K = 1 is the original one-AABB-per-edge layout.
+//
+// Tiling: bucketEdgesTiled first cuts the map into tiles with a k-d tree over the edge
+// midpoints (median split along the longer side until a tile has at most maxTileEdges
+// edges), then buckets every tile on its own. Each tile's buckets are a contiguous run
+// of primitives and become one BLAS, so an edit only rebuilds the tiles it touches.
+#pragma once
+
+#include "lsi_types.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <vector>
+
+// Must match BucketRange in rt_lsi.slang
+struct BucketRange {
+  uint32_t first; // into EdgeBuckets::edgeIds
+  uint32_t count;
+};
+
+// Primitives [firstPrim, firstPrim + primCount) of one tile
+struct TileRange {
+  uint32_t firstPrim;
+  uint32_t primCount;
+};
+
+struct EdgeBuckets {
+  std::vector<VkAabbPositionsKHR> aabbs; // one per bucket (= BLAS primitive)
+  std::vector<BucketRange> ranges; // one per bucket
+  std::vector<uint32_t> edgeIds; // base edge ids, Morton order (within each tile)
+  std::vector<TileRange> tiles; // one entry when untiled
+};
+
+// Precomputed buckets, e.g. straight out of a memory-mapped .lsimap file.
+struct EdgeBucketsView {
+  const VkAabbPositionsKHR *aabbs{};
+  const BucketRange *ranges{};
+  const uint32_t *edgeIds{}; // edgeCount entries
+  uint64_t primCount{};
+  uint32_t edgesPerPrim{};
+  const TileRange *tiles{}; // tileCount entries; 0 = one tile over all primitives
+  uint32_t tileCount{};
+
+  EdgeBucketsView() = default;
+  EdgeBucketsView(const EdgeBuckets &b, uint32_t K)
+    : aabbs(b.aabbs.data()), ranges(b.ranges.data()), edgeIds(b.edgeIds.data()),
+      primCount(b.aabbs.size()), edgesPerPrim(K), tiles(b.tiles.data()), tileCount((uint32_t) b.tiles.size()) {}
+};
+
+EdgeBuckets bucketEdges(LineMapView map, uint32_t edgesPerBucket);
+
+struct ThreadPool;
+
+// Tiles of at most maxTileEdges edges (0 = one tile, same as bucketEdges). Tiles are
+// bucketed in parallel on pool when given.
+EdgeBuckets bucketEdgesTiled(LineMapView map, uint32_t edgesPerBucket, uint32_t maxTileEdges,
+                             ThreadPool *pool = nullptr);
+
+// Box of the edges edgeIds[r.first, r.first + r.count), as bucketEdges makes it.
+VkAabbPositionsKHR bucketAabb(LineMapView map, const uint32_t *edgeIds, BucketRange r);
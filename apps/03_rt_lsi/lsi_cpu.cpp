@@ -0,0 +1,365 @@
+// lsi_cpu.cpp
+//
+// Built with -ffp-contract=off (see CMakeLists.txt): the SIMD kernels and the scalar test
+// must round identically, so no multiply-add may be fused behind our back.
+#include "lsi_cpu.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LSI_CPU_X86 1
+#include <immintrin.h>
+#else
+#define LSI_CPU_X86 0
+#endif
+
+static constexpr uint32_t SIMD_PAD = 16; // candidate arrays are padded to the widest kernel
+static constexpr uint64_t QUERY_GRAIN = 512; // query edges per parallelFor chunk
+
+// ---- Narrow phase ----
+// segSegIntersect2D of rt_lsi.slang, operation for operation.
+static inline bool segSegIntersect2D(float ox, float oy, float dx, float dy,
+                                     float ax, float ay, float ex, float ey,
+                                     float &px, float &py) {
+  float det = dx * (-ey) - dy * (-ex);
+  if (std::fabs(det) < 1e-12f) return false;
+
+  float rx = ax - ox, ry = ay - oy;
+  float t = (rx * (-ey) - ry * (-ex)) / det;
+  float u = (dx * ry - dy * rx) / det;
+  if (t < 0.0f || t > 1.0f || u < 0.0f || u > 1.0f) return false;
+
+  px = ox + t * dx;
+  py = oy + t * dy;
+  return true;
+}
+
+// Candidates of one query edge, gathered from the scene's SoA arrays.
+struct Candidates {
+  std::vector<uint32_t> ids;
+  std::vector<float> ax, ay, ex, ey; // padded with zero-length edges (det = 0, never hit)
+  uint32_t count{};
+};
+
+// Appends the hits of query edge q among c.
+using NarrowKernel = void (*)(const Candidates &c, uint32_t q, float ox, float oy, float dx, float dy,
+                              std::vector<HitRecord> &out);
+
+static void emitHit(const Candidates &c, uint32_t i, uint32_t q, float ox, float oy, float dx, float dy,
+                    std::vector<HitRecord> &out) {
+  float px, py;
+  if (segSegIntersect2D(ox, oy, dx, dy, c.ax[i], c.ay[i], c.ex[i], c.ey[i], px, py))
+    out.push_back({q, c.ids[i], px, py});
+}
+
+static void narrowScalar(const Candidates &c, uint32_t q, float ox, float oy, float dx, float dy,
+                         std::vector<HitRecord> &out) {
+  for (uint32_t i = 0; i < c.count; i++) emitHit(c, i, q, ox, oy, dx, dy, out);
+}
+
+#if LSI_CPU_X86
+// The SIMD kernels only find the lanes that hit; the hit point is then taken from the
+// scalar test on that lane, which gives the same bits.
+__attribute__((target("avx2")))
+static void narrowAvx2(const Candidates &c, uint32_t q, float ox, float oy, float dx, float dy,
+                       std::vector<HitRecord> &out) {
+  const __m256 vox = _mm256_set1_ps(ox), voy = _mm256_set1_ps(oy);
+  const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+  const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  const __m256 eps = _mm256_set1_ps(1e-12f), signBit = _mm256_set1_ps(-0.0f);
+
+  for (uint32_t i = 0; i < c.count; i += 8) {
+    __m256 nex = _mm256_xor_ps(_mm256_loadu_ps(&c.ex[i]), signBit);
+    __m256 ney = _mm256_xor_ps(_mm256_loadu_ps(&c.ey[i]), signBit);
+    __m256 det = _mm256_sub_ps(_mm256_mul_ps(vdx, ney), _mm256_mul_ps(vdy, nex));
+    __m256 rx = _mm256_sub_ps(_mm256_loadu_ps(&c.ax[i]), vox);
+    __m256 ry = _mm256_sub_ps(_mm256_loadu_ps(&c.ay[i]), voy);
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(rx, ney), _mm256_mul_ps(ry, nex)), det);
+    __m256 u = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(vdx, ry), _mm256_mul_ps(vdy, rx)), det);
+
+    __m256 reject = _mm256_cmp_ps(_mm256_andnot_ps(signBit, det), eps, _CMP_LT_OQ);
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(t, zero, _CMP_LT_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(t, one, _CMP_GT_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(u, zero, _CMP_LT_OQ));
+    reject = _mm256_or_ps(reject, _mm256_cmp_ps(u, one, _CMP_GT_OQ));
+    uint32_t hits = ~(uint32_t) _mm256_movemask_ps(reject) & 0xFFu;
+    for (; hits; hits &= hits - 1) {
+      uint32_t lane = i + (uint32_t) __builtin_ctz(hits);
+      if (lane < c.count) emitHit(c, lane, q, ox, oy, dx, dy, out);
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static void narrowAvx512(const Candidates &c, uint32_t q, float ox, float oy, float dx, float dy,
+                         std::vector<HitRecord> &out) {
+  const __m512 vox = _mm512_set1_ps(ox), voy = _mm512_set1_ps(oy);
+  const __m512 vdx = _mm512_set1_ps(dx), vdy = _mm512_set1_ps(dy);
+  const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+  const __m512 eps = _mm512_set1_ps(1e-12f);
+  const __m512i signBit = _mm512_set1_epi32((int) 0x80000000u);
+
+  for (uint32_t i = 0; i < c.count; i += 16) {
+    // xor of the sign bit, like the scalar unary minus (0 - x would turn -0 into +0)
+    __m512 nex = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_loadu_ps(&c.ex[i])), signBit));
+    __m512 ney = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_loadu_ps(&c.ey[i])), signBit));
+    __m512 det = _mm512_sub_ps(_mm512_mul_ps(vdx, ney), _mm512_mul_ps(vdy, nex));
+    __m512 rx = _mm512_sub_ps(_mm512_loadu_ps(&c.ax[i]), vox);
+    __m512 ry = _mm512_sub_ps(_mm512_loadu_ps(&c.ay[i]), voy);
+    __m512 t = _mm512_div_ps(_mm512_sub_ps(_mm512_mul_ps(rx, ney), _mm512_mul_ps(ry, nex)), det);
+    __m512 u = _mm512_div_ps(_mm512_sub_ps(_mm512_mul_ps(vdx, ry), _mm512_mul_ps(vdy, rx)), det);
+
+    __mmask16 reject = _mm512_cmp_ps_mask(_mm512_abs_ps(det), eps, _CMP_LT_OQ);
+    reject |= _mm512_cmp_ps_mask(t, zero, _CMP_LT_OQ);
+    reject |= _mm512_cmp_ps_mask(t, one, _CMP_GT_OQ);
+    reject |= _mm512_cmp_ps_mask(u, zero, _CMP_LT_OQ);
+    reject |= _mm512_cmp_ps_mask(u, one, _CMP_GT_OQ);
+    uint32_t hits = ~(uint32_t) reject & 0xFFFFu;
+    for (; hits; hits &= hits - 1) {
+      uint32_t lane = i + (uint32_t) __builtin_ctz(hits);
+      if (lane < c.count) emitHit(c, lane, q, ox, oy, dx, dy, out);
+    }
+  }
+}
+#endif
+
+static NarrowKernel narrowKernel(LsiCpuKernel k) {
+#if LSI_CPU_X86
+  if (k == LsiCpuKernel::Avx512) return narrowAvx512;
+  if (k == LsiCpuKernel::Avx2) return narrowAvx2;
+#endif
+  return narrowScalar;
+}
+
+const char *cpuKernelName(LsiCpuKernel kernel) {
+  switch (kernel) {
+    case LsiCpuKernel::Auto: return "auto";
+    case LsiCpuKernel::Scalar: return "scalar";
+    case LsiCpuKernel::Avx2: return "avx2";
+    case LsiCpuKernel::Avx512: return "avx512";
+  }
+  return "?";
+}
+
+// ---- Engine ----
+static bool cpuSupports(LsiCpuKernel k) {
+#if LSI_CPU_X86
+  if (k == LsiCpuKernel::Avx512) return __builtin_cpu_supports("avx512f");
+  if (k == LsiCpuKernel::Avx2) return __builtin_cpu_supports("avx2");
+#endif
+  return k == LsiCpuKernel::Scalar;
+}
+
+void initLsiCpuEngine(LsiCpuEngine &e, uint32_t threads, LsiCpuKernel kernel) {
+  initThreadPool(e.pool, threads);
+  if (kernel == LsiCpuKernel::Auto) {
+    kernel = cpuSupports(LsiCpuKernel::Avx512) ? LsiCpuKernel::Avx512
+             : cpuSupports(LsiCpuKernel::Avx2) ? LsiCpuKernel::Avx2
+             : LsiCpuKernel::Scalar;
+  } else if (!cpuSupports(kernel)) {
+    std::cerr << "CPU has no " << cpuKernelName(kernel) << ", using the scalar LSI kernel\n";
+    kernel = LsiCpuKernel::Scalar;
+  }
+  e.kernel = kernel;
+}
+
+void destroyLsiCpuEngine(LsiCpuEngine &e) {
+  destroyThreadPool(e.pool);
+}
+
+// ---- Scene ----
+static inline uint32_t cellCoord(float v, float origin, float cellsPerUnit, uint32_t n) {
+  float c = (v - origin) * cellsPerUnit;
+  if (!(c > 0.0f)) return 0; // also NaN
+  return (uint32_t) std::min(c, (float) (n - 1));
+}
+
+LsiCpuScene createLsiCpuScene(LsiCpuEngine &e, LineMapView base, float cellsPerEdge) {
+  auto t0 = std::chrono::steady_clock::now();
+  LsiCpuScene s{};
+  const uint32_t E = (uint32_t) base.edgeCount;
+  s.baseEdgeCount = E;
+  s.ax.resize(E);
+  s.ay.resize(E);
+  s.ex.resize(E);
+  s.ey.resize(E);
+
+  // SoA copy + bounds, one partial bounds per worker
+  std::vector<Bounds2> partial(threadCount(e.pool), Bounds2{INFINITY, INFINITY, -INFINITY, -INFINITY});
+  parallelFor(e.pool, E, 1u << 16, [&](uint64_t begin, uint64_t end, uint32_t worker) {
+    Bounds2 &pb = partial[worker];
+    for (uint64_t i = begin; i < end; i++) {
+      Point2 A = base.points[base.edges[i].p1_idx];
+      Point2 B = base.points[base.edges[i].p2_idx];
+      s.ax[i] = A.x;
+      s.ay[i] = A.y;
+      s.ex[i] = B.x - A.x;
+      s.ey[i] = B.y - A.y;
+      pb.minX = std::min({pb.minX, A.x, B.x});
+      pb.minY = std::min({pb.minY, A.y, B.y});
+      pb.maxX = std::max({pb.maxX, A.x, B.x});
+      pb.maxY = std::max({pb.maxY, A.y, B.y});
+    }
+  });
+  Bounds2 b = partial[0];
+  for (const Bounds2 &pb: partial) {
+    b.minX = std::min(b.minX, pb.minX);
+    b.minY = std::min(b.minY, pb.minY);
+    b.maxX = std::max(b.maxX, pb.maxX);
+    b.maxY = std::max(b.maxY, pb.maxY);
+  }
+  if (E == 0) b = {0, 0, 0, 0};
+  s.bounds = b;
+
+  // ~cellsPerEdge * E square-ish cells
+  const float w = std::max(b.maxX - b.minX, 1e-6f), h = std::max(b.maxY - b.minY, 1e-6f);
+  const double cells = std::max(1.0, (double) E * cellsPerEdge);
+  s.gridW = (uint32_t) std::clamp(std::ceil(std::sqrt(cells * w / h)), 1.0, 8192.0);
+  s.gridH = (uint32_t) std::clamp(std::ceil(cells / s.gridW), 1.0, 8192.0);
+  s.cellsPerUnitX = s.gridW / w;
+  s.cellsPerUnitY = s.gridH / h;
+
+  auto cellRange = [&](uint32_t i, uint32_t &x0, uint32_t &y0, uint32_t &x1, uint32_t &y1) {
+    float bx = s.ax[i] + s.ex[i], by = s.ay[i] + s.ey[i];
+    x0 = cellCoord(std::min(s.ax[i], bx), b.minX, s.cellsPerUnitX, s.gridW);
+    x1 = cellCoord(std::max(s.ax[i], bx), b.minX, s.cellsPerUnitX, s.gridW);
+    y0 = cellCoord(std::min(s.ay[i], by), b.minY, s.cellsPerUnitY, s.gridH);
+    y1 = cellCoord(std::max(s.ay[i], by), b.minY, s.cellsPerUnitY, s.gridH);
+  };
+
+  // Counting sort of (cell, edge) pairs; edges go in ascending id order per cell.
+  s.cellStart.assign((size_t) s.gridW * s.gridH + 1, 0);
+  for (uint32_t i = 0; i < E; i++) {
+    uint32_t x0, y0, x1, y1;
+    cellRange(i, x0, y0, x1, y1);
+    for (uint32_t y = y0; y <= y1; y++)
+      for (uint32_t x = x0; x <= x1; x++) s.cellStart[(size_t) y * s.gridW + x + 1]++;
+  }
+  for (size_t c = 1; c < s.cellStart.size(); c++) s.cellStart[c] += s.cellStart[c - 1];
+  s.cellEdges.resize(s.cellStart.back());
+  std::vector<uint32_t> fill(s.cellStart.begin(), s.cellStart.end() - 1);
+  for (uint32_t i = 0; i < E; i++) {
+    uint32_t x0, y0, x1, y1;
+    cellRange(i, x0, y0, x1, y1);
+    for (uint32_t y = y0; y <= y1; y++)
+      for (uint32_t x = x0; x <= x1; x++) s.cellEdges[fill[(size_t) y * s.gridW + x]++] = i;
+  }
+
+  s.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  return s;
+}
+
+// ---- Query ----
+// Base edges whose cells the query edge's bounding box touches, each once, ascending.
+static void gatherCandidates(const LsiCpuScene &s, float x0, float y0, float x1, float y1, Candidates &c) {
+  c.ids.clear();
+  const Bounds2 &b = s.bounds;
+  if (x1 < b.minX || x0 > b.maxX || y1 < b.minY || y0 > b.maxY) {
+    c.count = 0;
+    return;
+  }
+  uint32_t cx0 = cellCoord(x0, b.minX, s.cellsPerUnitX, s.gridW);
+  uint32_t cx1 = cellCoord(x1, b.minX, s.cellsPerUnitX, s.gridW);
+  uint32_t cy0 = cellCoord(y0, b.minY, s.cellsPerUnitY, s.gridH);
+  uint32_t cy1 = cellCoord(y1, b.minY, s.cellsPerUnitY, s.gridH);
+  for (uint32_t y = cy0; y <= cy1; y++) {
+    for (uint32_t x = cx0; x <= cx1; x++) {
+      size_t cell = (size_t) y * s.gridW + x;
+      c.ids.insert(c.ids.end(), s.cellEdges.begin() + s.cellStart[cell], s.cellEdges.begin() + s.cellStart[cell + 1]);
+    }
+  }
+  // An edge spanning several cells is listed in each of them.
+  if (cx0 != cx1 || cy0 != cy1) {
+    std::sort(c.ids.begin(), c.ids.end());
+    c.ids.erase(std::unique(c.ids.begin(), c.ids.end()), c.ids.end());
+  }
+
+  c.count = (uint32_t) c.ids.size();
+  const size_t padded = (c.count + SIMD_PAD - 1) / SIMD_PAD * SIMD_PAD;
+  c.ax.assign(padded, 0.0f);
+  c.ay.assign(padded, 0.0f);
+  c.ex.assign(padded, 0.0f);
+  c.ey.assign(padded, 0.0f);
+  for (uint32_t i = 0; i < c.count; i++) {
+    uint32_t id = c.ids[i];
+    c.ax[i] = s.ax[id];
+    c.ay[i] = s.ay[id];
+    c.ex[i] = s.ex[id];
+    c.ey[i] = s.ey[id];
+  }
+}
+
+std::vector<HitRecord> lsiIntersectCpu(LsiCpuEngine &e, const LsiCpuScene &scene, LineMapView query,
+                                       LsiCpuStats *stats) {
+  auto t0 = std::chrono::steady_clock::now();
+  const uint64_t Q = query.edgeCount;
+  const NarrowKernel narrow = narrowKernel(e.kernel);
+
+  // One output vector per chunk, concatenated in chunk order: deterministic and lock-free.
+  std::vector<std::vector<HitRecord>> chunkHits((Q + QUERY_GRAIN - 1) / QUERY_GRAIN);
+  std::vector<Candidates> scratch(threadCount(e.pool));
+  std::atomic<uint64_t> candidates{0};
+
+  parallelFor(e.pool, Q, QUERY_GRAIN, [&](uint64_t begin, uint64_t end, uint32_t worker) {
+    Candidates &c = scratch[worker];
+    std::vector<HitRecord> &out = chunkHits[begin / QUERY_GRAIN];
+    uint64_t tested = 0;
+    for (uint64_t q = begin; q < end; q++) {
+      Point2 p1 = query.points[query.edges[q].p1_idx];
+      Point2 p2 = query.points[query.edges[q].p2_idx];
+      gatherCandidates(scene, std::min(p1.x, p2.x), std::min(p1.y, p2.y),
+                       std::max(p1.x, p2.x), std::max(p1.y, p2.y), c);
+      tested += c.count;
+      narrow(c, (uint32_t) q, p1.x, p1.y, p2.x - p1.x, p2.y - p1.y, out);
+    }
+    candidates.fetch_add(tested, std::memory_order_relaxed);
+  });
+
+  size_t total = 0;
+  for (auto &h: chunkHits) total += h.size();
+  std::vector<HitRecord> hits;
+  hits.reserve(total);
+  for (auto &h: chunkHits) hits.insert(hits.end(), h.begin(), h.end());
+
+  if (stats) {
+    stats->candidates = candidates.load();
+    stats->hitCount = hits.size();
+    stats->traceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  }
+  return hits;
+}
+
+// ---- Oracle ----
+static inline bool pairLess(const HitRecord &a, const HitRecord &b) {
+  return a.queryEid != b.queryEid ? a.queryEid < b.queryEid : a.baseEid < b.baseEid;
+}
+
+void sortHits(std::vector<HitRecord> &hits) {
+  std::sort(hits.begin(), hits.end(), pairLess);
+}
+
+HitDiff compareHits(const std::vector<HitRecord> &expected, const std::vector<HitRecord> &actual, float eps) {
+  HitDiff d{};
+  size_t i = 0, j = 0;
+  while (i < expected.size() && j < actual.size()) {
+    if (pairLess(expected[i], actual[j])) {
+      d.missing++;
+      i++;
+    } else if (pairLess(actual[j], expected[i])) {
+      d.extra++;
+      j++;
+    } else {
+      if (std::fabs(expected[i].hitx - actual[j].hitx) > eps || std::fabs(expected[i].hity - actual[j].hity) > eps)
+        d.moved++;
+      i++;
+      j++;
+    }
+  }
+  d.missing += expected.size() - i;
+  d.extra += actual.size() - j;
+  return d;
+}
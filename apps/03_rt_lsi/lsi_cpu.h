@@ -0,0 +1,81 @@
+// lsi_cpu.h - line-segment intersection on the CPU.
+//
+// Reference for the GPU engine (same HitRecords, same float arithmetic as
+// segSegIntersect2D in rt_lsi.slang) and the fallback on machines without ray tracing.
+//
+// Broad phase: uniform grid over the base map; every base edge is listed in each cell
+// its bounding box touches. Narrow phase: the candidate edges of a query edge are tested
+// 16 / 8 at a time with AVX-512 / AVX2 (picked at runtime, scalar otherwise). Query edges
+// are split across a thread pool.
+//
+//   LsiCpuEngine e;  initLsiCpuEngine(e);
+//   LsiCpuScene s = createLsiCpuScene(e, baseMap);
+//   auto hits = lsiIntersectCpu(e, s, queryMap);
+//
+// Output is grouped by query edge like the GPU two-pass output, and sorted by base edge
+// inside a group (the GPU keeps traversal order there; sortHits makes both comparable).
+#pragma once
+
+#include "lsi_spatial.h"
+#include "lsi_types.h"
+
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class LsiCpuKernel { Auto, Scalar, Avx2, Avx512 };
+
+struct LsiCpuEngine {
+  ThreadPool pool;
+  LsiCpuKernel kernel = LsiCpuKernel::Scalar; // resolved by initLsiCpuEngine
+};
+
+// kernel = Auto: the widest one this CPU supports.
+void initLsiCpuEngine(LsiCpuEngine &e, uint32_t threads = 0, LsiCpuKernel kernel = LsiCpuKernel::Auto);
+void destroyLsiCpuEngine(LsiCpuEngine &e);
+
+// ---- Scene ----
+struct LsiCpuScene {
+  // Base edge i as A + u (B - A), structure of arrays
+  std::vector<float> ax, ay, ex, ey;
+
+  Bounds2 bounds{};
+  uint32_t gridW{}, gridH{};
+  float cellsPerUnitX{}, cellsPerUnitY{};
+  std::vector<uint32_t> cellStart; // gridW * gridH + 1, into cellEdges
+  std::vector<uint32_t> cellEdges; // base edge ids per cell, ascending
+
+  uint32_t baseEdgeCount{};
+  double buildMs{};
+};
+
+// cellsPerEdge: grid cells per base edge (resolution of the broad phase).
+LsiCpuScene createLsiCpuScene(LsiCpuEngine &e, LineMapView base, float cellsPerEdge = 1.0f);
+
+// ---- Query ----
+struct LsiCpuStats {
+  uint64_t candidates{}; // narrow-phase segment tests
+  uint64_t hitCount{};
+  double traceMs{};
+};
+
+std::vector<HitRecord> lsiIntersectCpu(LsiCpuEngine &e, const LsiCpuScene &scene, LineMapView query,
+                                       LsiCpuStats *stats = nullptr);
+
+const char *cpuKernelName(LsiCpuKernel kernel);
+
+// ---- Oracle ----
+// (queryEid, baseEid) order.
+void sortHits(std::vector<HitRecord> &hits);
+
+struct HitDiff {
+  uint64_t missing{}; // in expected only
+  uint64_t extra{}; // in actual only
+  uint64_t moved{}; // same pair, hit point further than eps apart
+  bool equal() const { return missing == 0 && extra == 0 && moved == 0; }
+};
+
+// Both sorted with sortHits. Hits that graze an endpoint can legitimately differ in
+// ulps between devices (FMA contraction, division precision), so eps is absolute.
+HitDiff compareHits(const std::vector<HitRecord> &expected, const std::vector<HitRecord> &actual, float eps = 1e-5f);
@@ -0,0 +1,1313 @@
+// lsi_engine.cpp
+#include "lsi_engine.h"
+#include "lsi_bucket.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Must match MODE_* in rt_lsi.slang
+enum class OutputMode : uint32_t { Append = 0, Count = 1, Write = 2, AppendRay = 3, AppendSubgroup = 4, Any = 5, Pip = 6 };
+
+struct Push {
+  uint32_t queryEdgeCount; // ray count
+  uint32_t maxOutHits;
+  OutputMode mode;
+  uint32_t useQueryList;
+  uint32_t queryEidBase;
+  uint32_t dispatchWidth;
+  float rayEndX; // OutputMode::Pip
+  uint32_t rayOffset; // RT pipeline: first ray of this launch
+  uint32_t launchHeight; // RT pipeline: rows per slice of this launch
+};
+
+// APPEND_COUNTER_LIMIT in rt_lsi.slang: append capacity limit, the device counter saturates near it
+static constexpr uint32_t MAX_APPEND_HITS = 1u << 31;
+
+// PIP_RESULT_UNSURE in rt_lsi.slang: some edge was too close to call in float
+static constexpr uint32_t PIP_UNSURE = 0xFFFFFFFDu;
+
+// Must match RQ_GROUP_SIZE in rt_lsi.slang
+static constexpr uint32_t RQ_GROUP_SIZE = 64;
+
+
+// set 0 bindings, see rt_lsi.slang
+enum : uint32_t {
+  B_TLAS = 0,
+  B_QUERY_PTS = 1,
+  B_QUERY_EDGES = 2,
+  B_BASE_PTS = 3,
+  B_BASE_EDGES = 4,
+  B_OUT_HITS = 5,
+  B_OUT_COUNTER = 6,
+  B_QUERY_OFFSETS = 7,
+  B_QUERY_LIST = 8,
+  B_OVERFLOW = 9,
+  B_BUCKET_RANGES = 10,
+  B_BUCKET_EDGES = 11,
+  B_HIT_MASK = 12,
+  B_TILE_FIRST_PRIM = 13,
+  BINDING_COUNT
+};
+
+// ---- Commands ----
+static void beginCmd(VkCommandBuffer cmd) {
+  VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+}
+
+// Stages that read the bindings and push constants
+static VkShaderStageFlags shaderStages(const LsiEngine &e) {
+  if (e.backend == LsiBackend::RayQuery) return VK_SHADER_STAGE_COMPUTE_BIT;
+  return VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+}
+
+// Pipeline stage that writes the trace outputs (for barriers)
+static VkPipelineStageFlags traceStage(const LsiEngine &e) {
+  return e.backend == LsiBackend::RayQuery
+           ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+           : VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+}
+
+// ---- Scene ----
+static Buffer makeDeviceSSBO(VkContext &ctx, const LsiEngine &e, const void *data, VkDeviceSize sz) {
+  // Inputs live in DEVICE_LOCAL memory: the intersection shader fetches base points/edges
+  // for every candidate, which must not cross PCIe. Uploaded through ctx.staging
+  // (or written in place on UMA/ReBAR).
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                             VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+  if (!sz) return createBuffer(ctx, 4, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true); // keeps descriptors valid
+  if (e.hostInputs) {
+    // Baseline for LsiEngine::hostInputs; TRANSFER_DST for updateLsiScene's staged writes
+    Buffer b = createBuffer(ctx, sz, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+    std::memcpy(mapBuffer(ctx, b), data, sz);
+    return b;
+  }
+  return createDeviceLocalBuffer(ctx, data, sz, usage, true);
+}
+
+// BLASes of the given tiles in one batched build; the returned scratch arena must live
+// until the submission finished.
+static Buffer buildTileBlases(VkContext &ctx, LsiEngine &e, LsiScene &s, const std::vector<uint32_t> &tiles) {
+  VkBuildAccelerationStructureFlagsKHR flags = ACCEL_BUILD_DEFAULT;
+  if (e.compactBlas) flags |= ACCEL_BUILD_COMPACTABLE;
+  if (e.updatableBlas) flags |= ACCEL_BUILD_UPDATABLE;
+
+  std::vector<BlasBuild> builds(tiles.size());
+  for (size_t i = 0; i < tiles.size(); i++) {
+    const TileRange &t = s.tiles[tiles[i]];
+    // any-hit must run exactly once per hit: the two-pass output relies on identical counts
+    builds[i] = blasAABBs(s.aabbs.addr + sizeof(VkAabbPositionsKHR) * t.firstPrim, t.primCount,
+                          VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR, flags);
+  }
+  std::vector<Accel> built(tiles.size());
+  Buffer scratch;
+  createBLASBatch(ctx, e.cmd, builds.data(), (uint32_t) builds.size(), built.data(), scratch);
+  for (size_t i = 0; i < tiles.size(); i++) s.blases[tiles[i]] = built[i];
+  return scratch;
+}
+
+// Instance t = tile t; the shaders look up its first primitive in tileFirstPrim.
+static std::vector<AccelInstance> tileInstances(const LsiScene &s) {
+  std::vector<AccelInstance> insts(s.tiles.size());
+  for (size_t t = 0; t < s.tiles.size(); t++) insts[t].blas = s.blases[t].addr;
+  return insts;
+}
+
+// Compacts blases[tiles[i]] and records the stats in s.compaction.
+static void compactTiles(VkContext &ctx, LsiEngine &e, LsiScene &s, const std::vector<uint32_t> &tiles) {
+  std::vector<Accel> accels(tiles.size());
+  for (size_t i = 0; i < tiles.size(); i++) accels[i] = s.blases[tiles[i]];
+  compactAccels(ctx, e.cmd, accels.data(), (uint32_t) accels.size(), &s.compaction);
+  for (size_t i = 0; i < tiles.size(); i++) s.blases[tiles[i]] = accels[i];
+}
+
+LsiScene createLsiScene(VkContext &ctx, LsiEngine &e, LineMapView base, uint32_t edgesPerPrim) {
+  const uint32_t K = std::max(edgesPerPrim, 1u);
+  EdgeBuckets buckets;
+  if (e.maxTileEdges && base.edgeCount > e.maxTileEdges) {
+    ThreadPool pool;
+    initThreadPool(pool);
+    buckets = bucketEdgesTiled(base, K, e.maxTileEdges, &pool);
+    destroyThreadPool(pool);
+  } else {
+    buckets = bucketEdges(base, K);
+  }
+  return createLsiScene(ctx, e, base, EdgeBucketsView(buckets, K));
+}
+
+LsiScene createLsiScene(VkContext &ctx, LsiEngine &e, LineMapView base, const EdgeBucketsView &buckets) {
+  LsiScene s{};
+  s.baseEdgeCount = (uint32_t) base.edgeCount;
+  s.primCount = (uint32_t) buckets.primCount;
+  s.edgesPerPrim = buckets.edgesPerPrim;
+  if (buckets.tileCount) s.tiles.assign(buckets.tiles, buckets.tiles + buckets.tileCount);
+  else s.tiles.push_back({0, s.primCount});
+  const uint32_t tileCount = (uint32_t) s.tiles.size();
+
+  s.basePts = makeDeviceSSBO(ctx, e, base.points, sizeof(Point2) * base.pointCount);
+  s.baseEdges = makeDeviceSSBO(ctx, e, base.edges, sizeof(Edge) * base.edgeCount);
+  s.aabbs = makeDeviceSSBO(ctx, e, buckets.aabbs, sizeof(VkAabbPositionsKHR) * buckets.primCount);
+  s.bucketRanges = makeDeviceSSBO(ctx, e, buckets.ranges, sizeof(BucketRange) * buckets.primCount);
+  s.bucketEdgeIds = makeDeviceSSBO(ctx, e, buckets.edgeIds, sizeof(uint32_t) * base.edgeCount);
+  std::vector<uint32_t> firstPrims(tileCount);
+  for (uint32_t t = 0; t < tileCount; t++) firstPrims[t] = s.tiles[t].firstPrim;
+  s.tileFirstPrim = makeDeviceSSBO(ctx, e, firstPrims.data(), sizeof(uint32_t) * tileCount);
+
+  if (e.updatableBlas) {
+    s.hostAabbs.assign(buckets.aabbs, buckets.aabbs + buckets.primCount);
+    s.hostRanges.assign(buckets.ranges, buckets.ranges + buckets.primCount);
+    s.hostEdgeIds.assign(buckets.edgeIds, buckets.edgeIds + base.edgeCount);
+    s.edgeBucket.resize(base.edgeCount);
+    for (uint32_t b = 0; b < s.primCount; b++)
+      for (uint32_t i = 0; i < s.hostRanges[b].count; i++) s.edgeBucket[s.hostEdgeIds[s.hostRanges[b].first + i]] = b;
+    s.refit.resize(tileCount);
+    for (uint32_t t = 0; t < tileCount; t++)
+      resetRefitTracker(s.refit[t], s.hostAabbs.data() + s.tiles[t].firstPrim, s.tiles[t].primCount);
+  }
+
+  std::vector<uint32_t> all(tileCount);
+  for (uint32_t t = 0; t < tileCount; t++) all[t] = t;
+  s.blases.resize(tileCount);
+
+  beginCmd(e.cmd);
+  uint32_t scope = profilerBegin(e.prof, e.cmd, "blas_build");
+  Buffer scratch = buildTileBlases(ctx, e, s, all);
+  profilerEnd(e.prof, e.cmd, scope);
+  if (e.compactBlas) {
+    // The TLAS must reference the compacted BLASes: build it in a second submission.
+    submitAndWait(ctx.dev, ctx.queue, e.cmd);
+    compactTiles(ctx, e, s, all);
+    beginCmd(e.cmd);
+  }
+  scope = profilerBegin(e.prof, e.cmd, "tlas_build");
+  const std::vector<AccelInstance> insts = tileInstances(s);
+  s.tlas = createTLAS(ctx, e.cmd, insts.data(), tileCount);
+  profilerEnd(e.prof, e.cmd, scope);
+  submitAndWait(ctx.dev, ctx.queue, e.cmd);
+  destroyBuffer(ctx, scratch);
+  s.buildMs = profilerSumMs(e.prof, profilerResolve(ctx, e.prof));
+  return s;
+}
+
+void destroyLsiScene(VkContext &ctx, LsiScene &s) {
+  destroyAccel(ctx, s.tlas);
+  for (Accel &b: s.blases) destroyAccel(ctx, b);
+  destroyBuffer(ctx, s.basePts);
+  destroyBuffer(ctx, s.baseEdges);
+  destroyBuffer(ctx, s.aabbs);
+  destroyBuffer(ctx, s.bucketRanges);
+  destroyBuffer(ctx, s.bucketEdgeIds);
+  destroyBuffer(ctx, s.tileFirstPrim);
+  s = {};
+  // A scene's BLASes and inputs are the largest allocations around; hand the blocks
+  // they leave empty back to the driver instead of keeping them for the next scene.
+  trimAllocator(ctx.allocator);
+}
+
+VkDeviceSize lsiSceneBlasBytes(const LsiScene &s) {
+  VkDeviceSize bytes = 0;
+  for (const Accel &b: s.blases) bytes += b.backing.size;
+  return bytes;
+}
+
+// Elements sortedIds of src into the same slots of dst: one upload per run, short gaps
+// merged (a few unchanged elements cost less than another staging submission). Scene
+// inputs are read by BLAS builds and traces.
+static void uploadElements(VkContext &ctx, const LsiEngine &e, const Buffer &dst, const void *src, size_t elemSize,
+                           const std::vector<uint32_t> &sortedIds) {
+  const uint32_t MAX_GAP = 64;
+  const uint8_t *bytes = (const uint8_t *) src;
+  for (size_t i = 0; i < sortedIds.size();) {
+    const uint32_t first = sortedIds[i];
+    uint32_t last = first;
+    for (i++; i < sortedIds.size() && sortedIds[i] - last <= MAX_GAP; i++) last = sortedIds[i];
+    updateDeviceLocalBuffer(ctx, dst, (VkDeviceSize) first * elemSize, bytes + (size_t) first * elemSize,
+                            (VkDeviceSize) (last - first + 1) * elemSize,
+                            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | traceStage(e), 0);
+  }
+}
+
+void updateLsiScene(VkContext &ctx, LsiEngine &e, LsiScene &s, LineMapView base,
+                    const uint32_t *moved, size_t movedCount, LsiUpdateStats *stats) {
+  if (!e.updatableBlas || s.hostAabbs.size() != s.primCount) {
+    std::cerr << "updateLsiScene: scene was not created with LsiEngine::updatableBlas\n";
+    std::exit(1);
+  }
+  LsiUpdateStats st{};
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Moved points -> buckets with an edge ending there
+  std::vector<uint32_t> points(moved, moved + movedCount);
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  std::vector<uint8_t> isMoved(base.pointCount, 0);
+  for (uint32_t p: points) isMoved[p] = 1;
+
+  std::vector<uint32_t> prims;
+  for (uint64_t i = 0; i < base.edgeCount; i++)
+    if (isMoved[base.edges[i].p1_idx] || isMoved[base.edges[i].p2_idx]) prims.push_back(s.edgeBucket[i]);
+  std::sort(prims.begin(), prims.end());
+  prims.erase(std::unique(prims.begin(), prims.end()), prims.end());
+
+  std::vector<VkAabbPositionsKHR> oldBoxes(prims.size()), newBoxes(prims.size());
+  for (size_t i = 0; i < prims.size(); i++) {
+    oldBoxes[i] = s.hostAabbs[prims[i]];
+    newBoxes[i] = bucketAabb(base, s.hostEdgeIds.data(), s.hostRanges[prims[i]]);
+    s.hostAabbs[prims[i]] = newBoxes[i];
+  }
+
+  uploadElements(ctx, e, s.basePts, base.points, sizeof(Point2), points);
+  uploadElements(ctx, e, s.aabbs, s.hostAabbs.data(), sizeof(VkAabbPositionsKHR), prims);
+  st.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  st.changedPrims = (uint32_t) prims.size();
+
+  // Sorted prims -> runs per tile (tiles are in primitive order); refit or rebuild each
+  std::vector<uint32_t> rebuildTiles, refitTiles;
+  for (size_t i = 0, t = 0; i < prims.size();) {
+    while (prims[i] >= s.tiles[t].firstPrim + s.tiles[t].primCount) t++;
+    size_t j = i;
+    while (j < prims.size() && prims[j] < s.tiles[t].firstPrim + s.tiles[t].primCount) j++;
+    if (shouldRebuild(e.refitPolicy, s.refit[t], oldBoxes.data() + i, newBoxes.data() + i, (uint32_t) (j - i),
+                      s.tiles[t].primCount))
+      rebuildTiles.push_back((uint32_t) t);
+    else refitTiles.push_back((uint32_t) t);
+    i = j;
+  }
+  st.changedTiles = (uint32_t) (rebuildTiles.size() + refitTiles.size());
+  st.rebuiltTiles = (uint32_t) rebuildTiles.size();
+  st.rebuilt = !rebuildTiles.empty();
+
+  // Engine calls are synchronous: nothing still reads the old structures.
+  for (uint32_t t: rebuildTiles) destroyAccel(ctx, s.blases[t]);
+
+  beginCmd(e.cmd);
+  uint32_t scope = profilerBegin(e.prof, e.cmd, "blas_rebuild");
+  Buffer scratch = buildTileBlases(ctx, e, s, rebuildTiles);
+  profilerEnd(e.prof, e.cmd, scope);
+  scope = profilerBegin(e.prof, e.cmd, "blas_refit");
+  for (uint32_t t: refitTiles) refitAccel(ctx, e.cmd, s.blases[t]);
+  profilerEnd(e.prof, e.cmd, scope);
+  if (st.rebuilt && e.compactBlas) {
+    submitAndWait(ctx.dev, ctx.queue, e.cmd);
+    compactTiles(ctx, e, s, rebuildTiles);
+    beginCmd(e.cmd);
+  }
+  scope = profilerBegin(e.prof, e.cmd, "tlas_build");
+  const std::vector<AccelInstance> insts = tileInstances(s);
+  rebuildTLAS(ctx, e.cmd, s.tlas, insts.data(), (uint32_t) insts.size());
+  profilerEnd(e.prof, e.cmd, scope);
+  submitAndWait(ctx.dev, ctx.queue, e.cmd);
+  destroyBuffer(ctx, scratch);
+  const size_t first = profilerResolve(ctx, e.prof);
+  st.blasMs = profilerSumMs(e.prof, first, "blas_");
+  st.tlasMs = profilerSumMs(e.prof, first, "tlas_");
+
+  for (uint32_t t: rebuildTiles)
+    resetRefitTracker(s.refit[t], s.hostAabbs.data() + s.tiles[t].firstPrim, s.tiles[t].primCount);
+  for (const RefitTracker &r: s.refit) st.qualityLoss = std::max(st.qualityLoss, r.qualityLoss);
+  if (stats) *stats = st;
+}
+
+// ---- Engine ----
+bool lsiBackendSupported(const VkCaps &caps, LsiBackend backend) {
+  return backend == LsiBackend::RayQuery ? caps.rayQuery : caps.rayTracingPipeline;
+}
+
+bool lsiSubgroupAppendSupported(const VkCaps &caps, LsiBackend backend) {
+  const VkSubgroupFeatureFlags ops = VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+  const VkShaderStageFlags stage = backend == LsiBackend::RayQuery
+                                     ? VK_SHADER_STAGE_COMPUTE_BIT
+                                     : VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+  return (caps.subgroupOps & ops) == ops && (caps.subgroupStages & stage);
+}
+
+// Shader mode of an append output
+static OutputMode appendMode(const VkCaps &caps, const LsiEngine &e, LsiOutput output) {
+  switch (output) {
+    case LsiOutput::AppendPerRay: return OutputMode::AppendRay;
+    case LsiOutput::AppendSubgroup:
+      return lsiSubgroupAppendSupported(caps, e.backend) ? OutputMode::AppendSubgroup : OutputMode::AppendRay;
+    default: return OutputMode::Append;
+  }
+}
+
+static void createRtPipeline(VkContext &ctx, LsiEngine &e);
+static void createRayQueryPipeline(VkContext &ctx, LsiEngine &e);
+
+void initLsiEngine(VkContext &ctx, LsiEngine &e, LsiBackend backend) {
+  if (!lsiBackendSupported(ctx.caps, backend)) {
+    std::cerr << "Device has no support for the " << backendName(backend) << " LSI backend\n";
+    std::exit(1);
+  }
+  VkDevice dev = ctx.dev;
+  e.backend = backend;
+
+  e.cmdPool = createCmdPool(dev, ctx.qfam);
+  e.cmd = createCmdBuffer(dev, e.cmdPool);
+
+  initProfiler(ctx, e.prof);
+
+  // -------------------------
+  // Descriptors (set 0, see B_* above)
+  // -------------------------
+  VkDescriptorSetLayoutBinding bindings[BINDING_COUNT]{};
+  for (uint32_t b = 0; b < BINDING_COUNT; b++) {
+    bindings[b].binding = b;
+    bindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[b].descriptorCount = 1;
+    bindings[b].stageFlags = shaderStages(e);
+  }
+  bindings[B_TLAS].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+  VkDescriptorSetLayoutCreateInfo dslci{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  dslci.bindingCount = BINDING_COUNT;
+  dslci.pBindings = bindings;
+  VK_CHECK(vkCreateDescriptorSetLayout(dev, &dslci, nullptr, &e.dsl));
+
+  // Push constants
+  VkPushConstantRange pcr{};
+  pcr.offset = 0;
+  pcr.size = sizeof(Push);
+  pcr.stageFlags = shaderStages(e);
+
+  VkPipelineLayoutCreateInfo plci{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  plci.setLayoutCount = 1;
+  plci.pSetLayouts = &e.dsl;
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
+  VK_CHECK(vkCreatePipelineLayout(dev, &plci, nullptr, &e.layout));
+
+  // Pool + set
+  VkDescriptorPoolSize ps[2]{};
+  ps[0].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+  ps[0].descriptorCount = 1;
+  ps[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  ps[1].descriptorCount = BINDING_COUNT - 1;
+
+  VkDescriptorPoolCreateInfo dpci{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  dpci.maxSets = 1;
+  dpci.poolSizeCount = 2;
+  dpci.pPoolSizes = ps;
+  VK_CHECK(vkCreateDescriptorPool(dev, &dpci, nullptr, &e.dpool));
+
+  VkDescriptorSetAllocateInfo dsai{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  dsai.descriptorPool = e.dpool;
+  dsai.descriptorSetCount = 1;
+  dsai.pSetLayouts = &e.dsl;
+  VK_CHECK(vkAllocateDescriptorSets(dev, &dsai, &e.dset));
+
+  if (backend == LsiBackend::RayQuery) createRayQueryPipeline(ctx, e);
+  else createRtPipeline(ctx, e);
+
+  initExclusiveScan(ctx, e.scan);
+}
+
+// Same bindings and push constants as the RT pipeline, one compute stage.
+static void createRayQueryPipeline(VkContext &ctx, LsiEngine &e) {
+  e.modules[0] = createShaderModule(ctx.dev, loadSpv((std::string(SHADER_DIR) + "/rq.spv").c_str()));
+
+  VkComputePipelineCreateInfo cpci{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  cpci.stage.module = e.modules[0];
+  cpci.stage.pName = "rqMain";
+  cpci.layout = e.layout;
+  e.pipeline = createComputePipeline(ctx, cpci, "lsi_rayquery");
+}
+
+static void createRtPipeline(VkContext &ctx, LsiEngine &e) {
+  VkDevice dev = ctx.dev;
+
+  // -------------------------
+  // RT pipeline (raygen+miss+isect+anyhit+chit)
+  // -------------------------
+  std::string shaderDir = SHADER_DIR;
+  const char *files[5] = {"raygen.spv", "miss.spv", "isect.spv", "ahit.spv", "chit.spv"};
+  for (int i = 0; i < 5; i++)
+    e.modules[i] = createShaderModule(dev, loadSpv((shaderDir + "/" + files[i]).c_str()));
+
+  std::vector<VkPipelineShaderStageCreateInfo> stages;
+  auto addStage = [&](VkShaderModule m, VkShaderStageFlagBits stage, const char *entry) {
+    VkPipelineShaderStageCreateInfo s{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+    s.stage = stage;
+    s.module = m;
+    s.pName = entry;
+    stages.push_back(s);
+  };
+
+  // Entry names must match what you compiled from Slang
+  addStage(e.modules[0], VK_SHADER_STAGE_RAYGEN_BIT_KHR, "raygenMain"); // stage 0
+  addStage(e.modules[1], VK_SHADER_STAGE_MISS_BIT_KHR, "missMain"); // stage 1
+  addStage(e.modules[2], VK_SHADER_STAGE_INTERSECTION_BIT_KHR, "isectMain"); // stage 2
+  addStage(e.modules[3], VK_SHADER_STAGE_ANY_HIT_BIT_KHR, "anyhitMain"); // stage 3
+  addStage(e.modules[4], VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "closesthitMain"); // stage 4
+
+  // Shader groups:
+  // 0: raygen general
+  // 1: miss general
+  // 2: procedural hitgroup (intersection + anyhit + closesthit optional)
+  std::vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
+
+  VkRayTracingShaderGroupCreateInfoKHR g0{VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
+  g0.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+  g0.generalShader = 0;
+  g0.closestHitShader = VK_SHADER_UNUSED_KHR;
+  g0.anyHitShader = VK_SHADER_UNUSED_KHR;
+  g0.intersectionShader = VK_SHADER_UNUSED_KHR;
+  groups.push_back(g0);
+
+  VkRayTracingShaderGroupCreateInfoKHR g1 = g0;
+  g1.generalShader = 1;
+  groups.push_back(g1);
+
+  VkRayTracingShaderGroupCreateInfoKHR g2{VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
+  g2.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
+  g2.generalShader = VK_SHADER_UNUSED_KHR;
+  g2.intersectionShader = 2;
+  g2.anyHitShader = 3;
+  g2.closestHitShader = 4; // can be unused, but fine
+  groups.push_back(g2);
+
+  VkRayTracingPipelineCreateInfoKHR rpci{VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR};
+  rpci.stageCount = (uint32_t) stages.size();
+  rpci.pStages = stages.data();
+  rpci.groupCount = (uint32_t) groups.size();
+  rpci.pGroups = groups.data();
+  rpci.maxPipelineRayRecursionDepth = 1;
+  rpci.layout = e.layout;
+  e.pipeline = createRayTracingPipeline(ctx, rpci, "lsi_pipeline");
+
+  // -------------------------
+  // SBT
+  // -------------------------
+  const uint32_t handleSize = ctx.caps.shaderGroupHandleSize;
+  const uint32_t handleAlign = ctx.caps.shaderGroupHandleAlignment;
+  const uint32_t handleSizeAligned = (uint32_t) alignUp(handleSize, handleAlign);
+
+  const uint32_t groupCount = (uint32_t) groups.size();
+  std::vector<uint8_t> handles(groupCount * handleSize);
+  VK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(dev, e.pipeline, 0, groupCount, handles.size(), handles.data()));
+
+  e.sbt = createBuffer(ctx, groupCount * (VkDeviceSize) handleSizeAligned,
+                       VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       true);
+
+  uint8_t *sbtMap = (uint8_t *) mapBuffer(ctx, e.sbt);
+  for (uint32_t i = 0; i < groupCount; i++)
+    std::memcpy(sbtMap + i * handleSizeAligned, handles.data() + i * handleSize, handleSize);
+  unmapBuffer(ctx, e.sbt);
+
+  e.rgenRegion.deviceAddress = e.sbt.addr + 0 * handleSizeAligned;
+  e.rgenRegion.stride = handleSizeAligned;
+  e.rgenRegion.size = handleSizeAligned;
+
+  e.missRegion.deviceAddress = e.sbt.addr + 1 * handleSizeAligned;
+  e.missRegion.stride = handleSizeAligned;
+  e.missRegion.size = handleSizeAligned;
+
+  e.hitRegion.deviceAddress = e.sbt.addr + 2 * handleSizeAligned;
+  e.hitRegion.stride = handleSizeAligned;
+  e.hitRegion.size = handleSizeAligned;
+}
+
+void destroyLsiEngine(VkContext &ctx, LsiEngine &e) {
+  VkDevice dev = ctx.dev;
+  destroyExclusiveScan(ctx, e.scan);
+  destroyBuffer(ctx, e.sbt);
+  vkDestroyPipeline(dev, e.pipeline, nullptr);
+  for (VkShaderModule m: e.modules) vkDestroyShaderModule(dev, m, nullptr);
+  vkDestroyDescriptorPool(dev, e.dpool, nullptr);
+  vkDestroyDescriptorSetLayout(dev, e.dsl, nullptr);
+  vkDestroyPipelineLayout(dev, e.layout, nullptr);
+  destroyProfiler(ctx, e.prof);
+  vkDestroyCommandPool(dev, e.cmdPool, nullptr);
+  e = {};
+}
+
+// ---- Query ----
+static void writeSSBO(VkDescriptorSet set, VkDevice dev, uint32_t binding, const Buffer &b) {
+  VkDescriptorBufferInfo info{};
+  info.buffer = b.buf;
+  info.offset = 0;
+  info.range = b.size;
+
+  VkWriteDescriptorSet w{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  w.dstSet = set;
+  w.dstBinding = binding;
+  w.descriptorCount = 1;
+  w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  w.pBufferInfo = &info;
+  vkUpdateDescriptorSets(dev, 1, &w, 0, nullptr);
+}
+
+static void writeTLAS(VkDescriptorSet set, VkDevice dev, const Accel &tlas) {
+  VkWriteDescriptorSetAccelerationStructureKHR asWrite{
+    VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR
+  };
+  asWrite.accelerationStructureCount = 1;
+  asWrite.pAccelerationStructures = &tlas.as;
+
+  VkWriteDescriptorSet w{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  w.dstSet = set;
+  w.dstBinding = B_TLAS;
+  w.descriptorCount = 1;
+  w.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+  w.pNext = &asWrite;
+  vkUpdateDescriptorSets(dev, 1, &w, 0, nullptr);
+}
+
+static Buffer makeHostBuffer(VkContext &ctx, VkDeviceSize sz, VkBufferUsageFlags usage) {
+  return createBuffer(ctx, std::max<VkDeviceSize>(sz, 4), usage,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      false);
+}
+
+// One ray per query edge (or point), on either backend.
+static void cmdTraceRays(VkContext &ctx, LsiEngine &e, VkCommandBuffer cmd, VkDescriptorSet set, OutputMode mode,
+                         uint32_t rayCount, uint32_t maxOutHits, bool useQueryList, uint32_t queryEidBase = 0,
+                         float rayEndX = 0.f) {
+  const bool rayQuery = e.backend == LsiBackend::RayQuery;
+  const VkPipelineBindPoint bindPoint = rayQuery ? VK_PIPELINE_BIND_POINT_COMPUTE
+                                                 : VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+  vkCmdBindPipeline(cmd, bindPoint, e.pipeline);
+  vkCmdBindDescriptorSets(cmd, bindPoint, e.layout, 0, 1, &set, 0, nullptr);
+
+  // Ray query: rows of up to 65535 workgroups
+  const uint32_t groups = (rayCount + RQ_GROUP_SIZE - 1) / RQ_GROUP_SIZE;
+  const uint32_t groupsX = std::clamp(groups, 1u, 65535u);
+  const uint32_t groupsY = (groups + groupsX - 1) / groupsX;
+
+  Push push{};
+  push.queryEdgeCount = rayCount;
+  push.maxOutHits = maxOutHits;
+  push.mode = mode;
+  push.useQueryList = useQueryList;
+  push.queryEidBase = queryEidBase;
+  push.dispatchWidth = groupsX * RQ_GROUP_SIZE;
+  push.rayEndX = rayEndX;
+
+  if (rayQuery) {
+    vkCmdPushConstants(cmd, e.layout, shaderStages(e), 0, sizeof(Push), &push);
+    vkCmdDispatch(cmd, groupsX, groupsY, 1);
+    return;
+  }
+
+  // RT pipeline: launches of up to maxRayDispatchInvocationCount rays, 2D/3D past the width limit
+  uint64_t offset = 0;
+  do {
+    uint64_t covered = 0;
+    const VkExtent3D ext = traceRaysExtent(ctx.caps, rayCount - offset, &covered);
+    push.rayOffset = (uint32_t) offset;
+    push.dispatchWidth = ext.width;
+    push.launchHeight = ext.height;
+    vkCmdPushConstants(cmd, e.layout, shaderStages(e), 0, sizeof(Push), &push);
+    vkCmdTraceRaysKHR(cmd, &e.rgenRegion, &e.missRegion, &e.hitRegion, &e.callRegion, ext.width, ext.height,
+                      ext.depth);
+    offset += covered;
+  } while (offset < rayCount);
+}
+
+// Append capacity after a round that truncated some queries. Everything they produced is
+// attempted - kept, so the re-trace fits, unless that passes MAX_APPEND_HITS: then the
+// capacity is clamped to it, and a round that still overflows there is fatal.
+static uint32_t grownAppendCapacity(const char *fn, uint32_t capacity, uint32_t attempted, uint64_t kept) {
+  if (capacity >= MAX_APPEND_HITS) {
+    std::cerr << fn << ": append output needs more than " << MAX_APPEND_HITS
+        << " hits in one round, use the two-pass output or smaller batches\n";
+    std::exit(1);
+  }
+  const uint64_t need = (uint64_t) attempted - std::min<uint64_t>(kept, attempted);
+  return (uint32_t) std::min<uint64_t>(std::max<uint64_t>(2ull * capacity, need), MAX_APPEND_HITS);
+}
+
+LsiQueryOrder parseQueryOrder(const char *name) {
+  if (std::strcmp(name, "morton") == 0) return LsiQueryOrder::Morton;
+  if (std::strcmp(name, "hilbert") == 0) return LsiQueryOrder::Hilbert;
+  if (std::strcmp(name, "input") != 0) std::cerr << "Unknown query order '" << name << "', using input\n";
+  return LsiQueryOrder::Input;
+}
+
+const char *queryOrderName(LsiQueryOrder order) {
+  switch (order) {
+    case LsiQueryOrder::Morton: return "morton";
+    case LsiQueryOrder::Hilbert: return "hilbert";
+    default: return "input";
+  }
+}
+
+LsiBackend parseBackend(const char *name) {
+  if (std::strcmp(name, "rayquery") == 0) return LsiBackend::RayQuery;
+  if (std::strcmp(name, "pipeline") != 0) std::cerr << "Unknown LSI backend '" << name << "', using pipeline\n";
+  return LsiBackend::RtPipeline;
+}
+
+const char *backendName(LsiBackend backend) {
+  return backend == LsiBackend::RayQuery ? "rayquery" : "pipeline";
+}
+
+LsiOutput parseOutput(const char *name) {
+  if (std::strcmp(name, "append") == 0) return LsiOutput::Append;
+  if (std::strcmp(name, "append-ray") == 0) return LsiOutput::AppendPerRay;
+  if (std::strcmp(name, "append-subgroup") == 0) return LsiOutput::AppendSubgroup;
+  if (std::strcmp(name, "two-pass") != 0) std::cerr << "Unknown LSI output '" << name << "', using two-pass\n";
+  return LsiOutput::TwoPass;
+}
+
+const char *outputName(LsiOutput output) {
+  switch (output) {
+    case LsiOutput::Append: return "append";
+    case LsiOutput::AppendPerRay: return "append-ray";
+    case LsiOutput::AppendSubgroup: return "append-subgroup";
+    default: return "two-pass";
+  }
+}
+
+std::vector<HitRecord> lsiIntersect(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                                    LineMapView query, const LsiQueryOptions &opts, LsiQueryStats *stats) {
+  VkDevice dev = ctx.dev;
+  if (query.edgeCount >= UINT32_MAX) {
+    std::cerr << "lsiIntersect: " << query.edgeCount << " query edges, at most 2^32 - 2 are supported\n";
+    std::exit(1);
+  }
+  const uint32_t QUERY_COUNT = (uint32_t) query.edgeCount;
+  const LsiOutput output = opts.output;
+  LsiQueryStats st{};
+  std::vector<HitRecord> hits;
+
+  // Launch order: ray i traces query edge order[i]
+  const bool reorder = opts.order != LsiQueryOrder::Input;
+  Buffer bOrder{};
+  if (reorder) {
+    auto t0 = std::chrono::steady_clock::now();
+    SpaceCurve curve = opts.order == LsiQueryOrder::Hilbert ? SpaceCurve::Hilbert : SpaceCurve::Morton;
+    std::vector<uint32_t> order = spaceCurveOrder(edgeCenters(query), curve);
+    st.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    bOrder = makeDeviceSSBO(ctx, e, order.data(), sizeof(uint32_t) * order.size());
+  }
+
+  Buffer bQueryPts = makeDeviceSSBO(ctx, e, query.points, sizeof(Point2) * query.pointCount);
+  Buffer bQueryEdge = makeDeviceSSBO(ctx, e, query.edges, sizeof(Edge) * query.edgeCount);
+
+  // Output buffers
+  // Append: initial capacity, grown on overflow. Two-pass: placeholder until the count
+  // pass gives the exact size.
+  auto makeOutHits = [&](uint32_t records)-> Buffer {
+    return makeHostBuffer(ctx, sizeof(HitRecord) * std::max(records, 1u), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  };
+  Buffer bOutHits = makeOutHits(output != LsiOutput::TwoPass ? std::clamp(e.initialOutHits, 1u, MAX_APPEND_HITS) : 1);
+  Buffer bOutCounter = makeHostBuffer(ctx, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  // Two-pass: per-ray counts, scanned in place into offsets. Entry QUERY_COUNT stays 0
+  // through the count pass and becomes the total after the scan. Indexed by ray, so with
+  // reordering the output is grouped by query edge in launch order.
+  Buffer bQueryOffsets = createBuffer(ctx, sizeof(uint32_t) * (QUERY_COUNT + 1),
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+  Buffer bScanScratch = createBuffer(ctx, exclusiveScanScratchSize(QUERY_COUNT + 1),
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+  Buffer bTotal = makeHostBuffer(ctx, 2 * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT); // total, scan carry
+
+  // Append overflow handling: truncated query edges of one round, and the subset the
+  // next round traces. Host-visible: the host filters partial results and builds the list.
+  Buffer bOverflow = makeHostBuffer(ctx, sizeof(uint32_t) * (QUERY_COUNT + 1), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  Buffer bQueryList = makeHostBuffer(ctx, sizeof(uint32_t) * QUERY_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  writeTLAS(e.dset, dev, scene.tlas);
+  writeSSBO(e.dset, dev, B_QUERY_PTS, bQueryPts);
+  writeSSBO(e.dset, dev, B_QUERY_EDGES, bQueryEdge);
+  writeSSBO(e.dset, dev, B_BASE_PTS, scene.basePts);
+  writeSSBO(e.dset, dev, B_BASE_EDGES, scene.baseEdges);
+  writeSSBO(e.dset, dev, B_OUT_HITS, bOutHits);
+  writeSSBO(e.dset, dev, B_OUT_COUNTER, bOutCounter);
+  writeSSBO(e.dset, dev, B_QUERY_OFFSETS, bQueryOffsets);
+  writeSSBO(e.dset, dev, B_QUERY_LIST, reorder ? bOrder : bQueryList);
+  writeSSBO(e.dset, dev, B_OVERFLOW, bOverflow);
+  writeSSBO(e.dset, dev, B_BUCKET_RANGES, scene.bucketRanges);
+  writeSSBO(e.dset, dev, B_TILE_FIRST_PRIM, scene.tileFirstPrim);
+  writeSSBO(e.dset, dev, B_BUCKET_EDGES, scene.bucketEdgeIds);
+  writeSSBO(e.dset, dev, B_HIT_MASK, bQueryOffsets); // only written by lsiOcclusion
+
+  auto resizeOutHits = [&](uint32_t records) {
+    destroyBuffer(ctx, bOutHits);
+    bOutHits = makeOutHits(records);
+    writeSSBO(e.dset, dev, B_OUT_HITS, bOutHits);
+  };
+
+  if (output != LsiOutput::TwoPass) {
+    // Each round appends into outHits; complete query edges are spilled to the host.
+    // Query edges that overflowed are dropped from this round and re-traced alone once
+    // outHits grew to hold (at least) every hit they produced.
+    uint32_t *counter = (uint32_t *) mapBuffer(ctx, bOutCounter);
+    uint32_t *overflow = (uint32_t *) mapBuffer(ctx, bOverflow);
+    uint32_t *queryList = (uint32_t *) mapBuffer(ctx, bQueryList);
+    std::vector<uint8_t> truncated(QUERY_COUNT, 0);
+
+    const OutputMode mode = appendMode(ctx.caps, e, output);
+    uint32_t capacity = std::clamp(e.initialOutHits, 1u, MAX_APPEND_HITS);
+    uint32_t rayCount = QUERY_COUNT;
+    for (uint32_t round = 0; rayCount; round++) {
+      counter[0] = 0;
+      overflow[0] = 0;
+
+      beginCmd(e.cmd);
+      uint32_t scope = profilerBegin(e.prof, e.cmd, round ? "trace_retrace" : "trace_append");
+      cmdTraceRays(ctx, e, e.cmd, e.dset, mode, rayCount, capacity, reorder || round > 0);
+      profilerEnd(e.prof, e.cmd, scope);
+      cmdMemoryBarrier(e.cmd,
+                       traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+      submitAndWait(dev, ctx.queue, e.cmd);
+      st.traceMs += profilerSumMs(e.prof, profilerResolve(ctx, e.prof));
+      st.rounds++;
+
+      const uint32_t attempted = counter[0];
+      const uint32_t truncCount = overflow[0];
+      for (uint32_t i = 0; i < truncCount; i++) truncated[overflow[1 + i]] = 1;
+
+      const HitRecord *out = (const HitRecord *) mapBuffer(ctx, bOutHits);
+      const size_t before = hits.size();
+      for (uint32_t i = 0, n = std::min(attempted, capacity); i < n; i++)
+        if (!truncated[out[i].queryEid]) hits.push_back(out[i]);
+      unmapBuffer(ctx, bOutHits);
+      const uint32_t kept = (uint32_t) (hits.size() - before);
+
+      if (!truncCount) break;
+
+      capacity = grownAppendCapacity("lsiIntersect", capacity, attempted, kept);
+      resizeOutHits(capacity);
+
+      for (uint32_t i = 0; i < truncCount; i++) {
+        queryList[i] = overflow[1 + i];
+        truncated[queryList[i]] = 0;
+      }
+      rayCount = truncCount;
+      if (round == 0 && reorder) writeSSBO(e.dset, dev, B_QUERY_LIST, bQueryList);
+    }
+
+    unmapBuffer(ctx, bQueryList);
+    unmapBuffer(ctx, bOverflow);
+    unmapBuffer(ctx, bOutCounter);
+  } else {
+    // Pass 1: count hits per query edge, then scan counts into offsets on the device.
+    beginCmd(e.cmd);
+    vkCmdFillBuffer(e.cmd, bQueryOffsets.buf, 0, VK_WHOLE_SIZE, 0);
+    cmdMemoryBarrier(e.cmd,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     traceStage(e), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    uint32_t scope = profilerBegin(e.prof, e.cmd, "trace_count");
+    cmdTraceRays(ctx, e, e.cmd, e.dset, OutputMode::Count, QUERY_COUNT, 0, reorder);
+    profilerEnd(e.prof, e.cmd, scope);
+    cmdMemoryBarrier(e.cmd,
+                     traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    scope = profilerBegin(e.prof, e.cmd, "scan", true);
+    cmdExclusiveScan(e.scan, e.cmd, bQueryOffsets, QUERY_COUNT + 1, bScanScratch);
+    profilerEnd(e.prof, e.cmd, scope);
+    // Offsets are read by the total's copy here and by pass 2 in the next submission;
+    // the host wait in between makes nothing visible to the device.
+    cmdMemoryBarrier(e.cmd,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT | traceStage(e),
+                     VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    // Only the total (and whether it wrapped) comes back to the host, to size the output.
+    scope = profilerBegin(e.prof, e.cmd, "readback_total");
+    VkBufferCopy totalCopy{};
+    totalCopy.srcOffset = sizeof(uint32_t) * QUERY_COUNT;
+    totalCopy.size = sizeof(uint32_t);
+    vkCmdCopyBuffer(e.cmd, bQueryOffsets.buf, bTotal.buf, 1, &totalCopy);
+    VkBufferCopy carryCopy{};
+    carryCopy.dstOffset = sizeof(uint32_t);
+    carryCopy.size = sizeof(uint32_t);
+    vkCmdCopyBuffer(e.cmd, bScanScratch.buf, bTotal.buf, 1, &carryCopy);
+    profilerEnd(e.prof, e.cmd, scope);
+    cmdMemoryBarrier(e.cmd,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    submitAndWait(dev, ctx.queue, e.cmd);
+    size_t first = profilerResolve(ctx, e.prof);
+    st.traceMs += profilerSumMs(e.prof, first, "trace") + profilerSumMs(e.prof, first, "scan");
+
+    const uint32_t *totalMapped = (const uint32_t *) mapBuffer(ctx, bTotal);
+    const uint32_t total = totalMapped[0];
+    const bool wrapped = totalMapped[1] != 0;
+    unmapBuffer(ctx, bTotal);
+    if (wrapped) {
+      std::cerr << "lsiIntersect: two-pass output exceeds 2^32 hits, offsets would wrap\n";
+      std::exit(1);
+    }
+
+    // Exact-sized output
+    resizeOutHits(total);
+
+    // Pass 2: same traversal, each query writes into its own range.
+    beginCmd(e.cmd);
+    scope = profilerBegin(e.prof, e.cmd, "trace_write");
+    cmdTraceRays(ctx, e, e.cmd, e.dset, OutputMode::Write, QUERY_COUNT, total, reorder);
+    profilerEnd(e.prof, e.cmd, scope);
+    cmdMemoryBarrier(e.cmd,
+                     traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    submitAndWait(dev, ctx.queue, e.cmd);
+    st.traceMs += profilerSumMs(e.prof, profilerResolve(ctx, e.prof));
+    st.rounds = 2;
+
+    const HitRecord *out = (const HitRecord *) mapBuffer(ctx, bOutHits);
+    hits.assign(out, out + total);
+    unmapBuffer(ctx, bOutHits);
+  }
+
+  destroyBuffer(ctx, bQueryPts);
+  destroyBuffer(ctx, bQueryEdge);
+  destroyBuffer(ctx, bOutHits);
+  destroyBuffer(ctx, bOutCounter);
+  destroyBuffer(ctx, bQueryOffsets);
+  destroyBuffer(ctx, bScanScratch);
+  destroyBuffer(ctx, bTotal);
+  destroyBuffer(ctx, bOverflow);
+  destroyBuffer(ctx, bQueryList);
+  destroyBuffer(ctx, bOrder);
+
+  st.hitCount = hits.size();
+  if (stats) *stats = st;
+  return hits;
+}
+
+// ---- Occlusion ----
+std::vector<uint32_t> lsiOcclusion(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                                   LineMapView query, LsiQueryOrder order, LsiQueryStats *stats) {
+  VkDevice dev = ctx.dev;
+  if (query.edgeCount >= UINT32_MAX) {
+    std::cerr << "lsiOcclusion: " << query.edgeCount << " query edges, at most 2^32 - 2 are supported\n";
+    std::exit(1);
+  }
+  const uint32_t QUERY_COUNT = (uint32_t) query.edgeCount;
+  const uint32_t WORDS = std::max((uint32_t) (((uint64_t) QUERY_COUNT + 31) / 32), 1u);
+  LsiQueryStats st{};
+
+  const bool reorder = order != LsiQueryOrder::Input;
+  Buffer bOrder{};
+  if (reorder) {
+    auto t0 = std::chrono::steady_clock::now();
+    SpaceCurve curve = order == LsiQueryOrder::Hilbert ? SpaceCurve::Hilbert : SpaceCurve::Morton;
+    std::vector<uint32_t> perm = spaceCurveOrder(edgeCenters(query), curve);
+    st.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    bOrder = makeDeviceSSBO(ctx, e, perm.data(), sizeof(uint32_t) * perm.size());
+  }
+
+  Buffer bQueryPts = makeDeviceSSBO(ctx, e, query.points, sizeof(Point2) * query.pointCount);
+  Buffer bQueryEdge = makeDeviceSSBO(ctx, e, query.edges, sizeof(Edge) * query.edgeCount);
+  Buffer bMask = createBuffer(ctx, sizeof(uint32_t) * WORDS,
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+  Buffer bReadback = makeHostBuffer(ctx, sizeof(uint32_t) * WORDS, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  // Hit records, counters and offsets are not touched in this mode
+  Buffer bUnused = createBuffer(ctx, 4, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+  writeTLAS(e.dset, dev, scene.tlas);
+  writeSSBO(e.dset, dev, B_QUERY_PTS, bQueryPts);
+  writeSSBO(e.dset, dev, B_QUERY_EDGES, bQueryEdge);
+  writeSSBO(e.dset, dev, B_BASE_PTS, scene.basePts);
+  writeSSBO(e.dset, dev, B_BASE_EDGES, scene.baseEdges);
+  writeSSBO(e.dset, dev, B_OUT_HITS, bUnused);
+  writeSSBO(e.dset, dev, B_OUT_COUNTER, bUnused);
+  writeSSBO(e.dset, dev, B_QUERY_OFFSETS, bUnused);
+  writeSSBO(e.dset, dev, B_QUERY_LIST, reorder ? bOrder : bUnused);
+  writeSSBO(e.dset, dev, B_OVERFLOW, bUnused);
+  writeSSBO(e.dset, dev, B_BUCKET_RANGES, scene.bucketRanges);
+  writeSSBO(e.dset, dev, B_TILE_FIRST_PRIM, scene.tileFirstPrim);
+  writeSSBO(e.dset, dev, B_BUCKET_EDGES, scene.bucketEdgeIds);
+  writeSSBO(e.dset, dev, B_HIT_MASK, bMask);
+
+  beginCmd(e.cmd);
+  vkCmdFillBuffer(e.cmd, bMask.buf, 0, VK_WHOLE_SIZE, 0);
+  cmdMemoryBarrier(e.cmd,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   traceStage(e), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  uint32_t scope = profilerBegin(e.prof, e.cmd, "trace_any");
+  cmdTraceRays(ctx, e, e.cmd, e.dset, OutputMode::Any, QUERY_COUNT, 0, reorder);
+  profilerEnd(e.prof, e.cmd, scope);
+  cmdMemoryBarrier(e.cmd,
+                   traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+  scope = profilerBegin(e.prof, e.cmd, "readback_mask");
+  VkBufferCopy copy{0, 0, sizeof(uint32_t) * WORDS};
+  vkCmdCopyBuffer(e.cmd, bMask.buf, bReadback.buf, 1, &copy);
+  profilerEnd(e.prof, e.cmd, scope);
+  cmdMemoryBarrier(e.cmd,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  submitAndWait(dev, ctx.queue, e.cmd);
+  st.traceMs = profilerSumMs(e.prof, profilerResolve(ctx, e.prof), "trace");
+  st.rounds = 1;
+
+  const uint32_t *words = (const uint32_t *) mapBuffer(ctx, bReadback);
+  std::vector<uint32_t> mask(words, words + ((uint64_t) QUERY_COUNT + 31) / 32);
+  unmapBuffer(ctx, bReadback);
+  for (uint32_t w: mask) st.hitCount += (uint32_t) std::popcount(w);
+
+  destroyBuffer(ctx, bQueryPts);
+  destroyBuffer(ctx, bQueryEdge);
+  destroyBuffer(ctx, bMask);
+  destroyBuffer(ctx, bReadback);
+  destroyBuffer(ctx, bUnused);
+  destroyBuffer(ctx, bOrder);
+
+  if (stats) *stats = st;
+  return mask;
+}
+
+// ---- Point in polygon ----
+PipScene createPipScene(VkContext &ctx, LsiEngine &e, const PolygonSet &zones, uint32_t edgesPerPrim) {
+  const LineMap edges = pipEdges(zones);
+  PipScene s{};
+  s.lsi = createLsiScene(ctx, e, edges, edgesPerPrim);
+  s.exact = createPipCpuIndex(edges);
+  // Past every edge (and its padded box), so each ray ends in empty space
+  const Bounds2 &b = s.exact.bounds;
+  s.rayEndX = b.maxX + 0.01f * (b.maxX - b.minX) + 1e-3f;
+  return s;
+}
+
+void destroyPipScene(VkContext &ctx, PipScene &s) {
+  destroyLsiScene(ctx, s.lsi);
+  s = {};
+}
+
+std::vector<uint32_t> lsiPointInPolygon(VkContext &ctx, LsiEngine &e, const PipScene &scene,
+                                        const Point2 *points, uint64_t count, LsiQueryOrder order,
+                                        PipQueryStats *stats) {
+  VkDevice dev = ctx.dev;
+  if (count >= UINT32_MAX) {
+    std::cerr << "lsiPointInPolygon: " << count << " points, at most 2^32 - 2 are supported\n";
+    std::exit(1);
+  }
+  const uint32_t QUERY_COUNT = (uint32_t) count;
+  PipQueryStats st{};
+
+  const bool reorder = order != LsiQueryOrder::Input;
+  Buffer bOrder{};
+  if (reorder) {
+    auto t0 = std::chrono::steady_clock::now();
+    SpaceCurve curve = order == LsiQueryOrder::Hilbert ? SpaceCurve::Hilbert : SpaceCurve::Morton;
+    std::vector<uint32_t> perm = spaceCurveOrder(std::vector<Point2>(points, points + count), curve);
+    st.sortMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    bOrder = makeDeviceSSBO(ctx, e, perm.data(), sizeof(uint32_t) * perm.size());
+  }
+
+  Buffer bQueryPts = makeDeviceSSBO(ctx, e, points, sizeof(Point2) * count);
+  Buffer bZones = createBuffer(ctx, sizeof(uint32_t) * std::max(QUERY_COUNT, 1u),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+  Buffer bReadback = makeHostBuffer(ctx, sizeof(uint32_t) * std::max(QUERY_COUNT, 1u),
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  // Query edges, hit records, counters and the mask are not touched in this mode
+  Buffer bUnused = createBuffer(ctx, 4, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+  writeTLAS(e.dset, dev, scene.lsi.tlas);
+  writeSSBO(e.dset, dev, B_QUERY_PTS, bQueryPts);
+  writeSSBO(e.dset, dev, B_QUERY_EDGES, bUnused);
+  writeSSBO(e.dset, dev, B_BASE_PTS, scene.lsi.basePts);
+  writeSSBO(e.dset, dev, B_BASE_EDGES, scene.lsi.baseEdges);
+  writeSSBO(e.dset, dev, B_OUT_HITS, bUnused);
+  writeSSBO(e.dset, dev, B_OUT_COUNTER, bUnused);
+  writeSSBO(e.dset, dev, B_QUERY_OFFSETS, bZones);
+  writeSSBO(e.dset, dev, B_QUERY_LIST, reorder ? bOrder : bUnused);
+  writeSSBO(e.dset, dev, B_OVERFLOW, bUnused);
+  writeSSBO(e.dset, dev, B_BUCKET_RANGES, scene.lsi.bucketRanges);
+  writeSSBO(e.dset, dev, B_TILE_FIRST_PRIM, scene.lsi.tileFirstPrim);
+  writeSSBO(e.dset, dev, B_BUCKET_EDGES, scene.lsi.bucketEdgeIds);
+  writeSSBO(e.dset, dev, B_HIT_MASK, bUnused);
+
+  // Every ray writes its point's entry, no clear needed
+  beginCmd(e.cmd);
+  uint32_t scope = profilerBegin(e.prof, e.cmd, "trace_pip");
+  cmdTraceRays(ctx, e, e.cmd, e.dset, OutputMode::Pip, QUERY_COUNT, 0, reorder, 0, scene.rayEndX);
+  profilerEnd(e.prof, e.cmd, scope);
+  cmdMemoryBarrier(e.cmd,
+                   traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+  scope = profilerBegin(e.prof, e.cmd, "readback_zones");
+  VkBufferCopy copy{0, 0, sizeof(uint32_t) * std::max(QUERY_COUNT, 1u)};
+  vkCmdCopyBuffer(e.cmd, bZones.buf, bReadback.buf, 1, &copy);
+  profilerEnd(e.prof, e.cmd, scope);
+  cmdMemoryBarrier(e.cmd,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  submitAndWait(dev, ctx.queue, e.cmd);
+  st.traceMs = profilerSumMs(e.prof, profilerResolve(ctx, e.prof), "trace");
+
+  const uint32_t *out = (const uint32_t *) mapBuffer(ctx, bReadback);
+  std::vector<uint32_t> zones(out, out + QUERY_COUNT);
+  unmapBuffer(ctx, bReadback);
+
+  // Points with an edge within float error of them: exact test over their row
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < QUERY_COUNT; i++) {
+    if (zones[i] == PIP_UNSURE) {
+      zones[i] = pipClassifyPoint(scene.exact, points[i]);
+      st.resolved++;
+    }
+    if (zones[i] == PIP_BOUNDARY) st.boundary++;
+    else if (zones[i] != PIP_OUTSIDE) st.inside++;
+  }
+  st.resolveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+  destroyBuffer(ctx, bQueryPts);
+  destroyBuffer(ctx, bZones);
+  destroyBuffer(ctx, bReadback);
+  destroyBuffer(ctx, bUnused);
+  destroyBuffer(ctx, bOrder);
+
+  if (stats) *stats = st;
+  return zones;
+}
+
+// ---- Streaming ----
+struct StreamSlot {
+  VkCommandBuffer cmd{};
+  VkFence fence{};
+  VkDescriptorSet set{};
+
+  Buffer pts; // batch-local: query edge i spans points 2i, 2i+1
+  Buffer edges;
+  Buffer outHits;
+  Buffer counter;
+  Buffer overflow;
+  Buffer list;
+  uint32_t capacity{};
+
+  uint32_t first{}; // global id of the batch's first query edge
+  uint32_t count{}; // query edges in flight, 0 = idle
+
+  // Scopes of the submission in flight, resolved when it is harvested: the engine's
+  // profiler would only be resolvable once every batch is done, and long streams would
+  // run it out of scope slots long before that.
+  GpuProfiler prof;
+};
+
+// Batch inputs are written once by the host and read once per ray: host-visible, and
+// device-local as well when the CPU can write that directly (UMA/ReBAR).
+static Buffer makeStreamBuffer(VkContext &ctx, VkDeviceSize sz) {
+  VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  if (ctx.caps.deviceLocalHostVisible) props |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  return createBuffer(ctx, std::max<VkDeviceSize>(sz, 4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, props, false);
+}
+
+// Host writes made before vkQueueSubmit (inputs, counter reset) are visible to the trace.
+static void submitSlot(VkContext &ctx, LsiEngine &e, StreamSlot &s, uint32_t rayCount, bool useQueryList) {
+  uint32_t *counter = (uint32_t *) mapBuffer(ctx, s.counter);
+  uint32_t *overflow = (uint32_t *) mapBuffer(ctx, s.overflow);
+  counter[0] = 0;
+  overflow[0] = 0;
+
+  beginCmd(s.cmd);
+  uint32_t scope = profilerBegin(s.prof, s.cmd, useQueryList ? "stream_retrace" : "stream_trace");
+  cmdTraceRays(ctx, e, s.cmd, s.set, OutputMode::Append, rayCount, s.capacity, useQueryList, s.first);
+  profilerEnd(s.prof, s.cmd, scope);
+  cmdMemoryBarrier(s.cmd,
+                   traceStage(e), VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  VK_CHECK(vkEndCommandBuffer(s.cmd));
+
+  VK_CHECK(vkResetFences(ctx.dev, 1, &s.fence));
+  VkSubmitInfo si{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  si.commandBufferCount = 1;
+  si.pCommandBuffers = &s.cmd;
+  VK_CHECK(vkQueueSubmit(ctx.queue, 1, &si, s.fence));
+}
+
+// Waits for the slot's batch, hands its hits to the sink and re-traces query edges that
+// overflowed until none are left. Leaves the slot idle.
+static void harvestSlot(VkContext &ctx, LsiEngine &e, StreamSlot &s, const LsiHitSink &sink,
+                        std::vector<uint8_t> &truncated, std::vector<HitRecord> &kept, LsiStreamStats &st) {
+  const uint32_t *counter = (const uint32_t *) mapBuffer(ctx, s.counter);
+  const uint32_t *overflow = (const uint32_t *) mapBuffer(ctx, s.overflow);
+  uint32_t *list = (uint32_t *) mapBuffer(ctx, s.list);
+
+  for (;;) {
+    auto t0 = std::chrono::steady_clock::now();
+    VK_CHECK(vkWaitForFences(ctx.dev, 1, &s.fence, VK_TRUE, UINT64_MAX));
+    st.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    // Records go on to the engine's profiler like those of the other calls
+    st.traceMs += profilerSumMs(s.prof, profilerResolve(ctx, s.prof));
+    profilerMoveRecords(e.prof, s.prof);
+
+    const uint32_t attempted = counter[0];
+    const uint32_t truncCount = overflow[0];
+    const HitRecord *out = (const HitRecord *) mapBuffer(ctx, s.outHits);
+    const uint32_t n = std::min(attempted, s.capacity);
+
+    if (!truncCount) {
+      // Common case: straight from mapped memory, no copy.
+      if (n) sink(out, n);
+      st.hitCount += n;
+      break;
+    }
+
+    truncated.assign(s.count, 0);
+    for (uint32_t i = 0; i < truncCount; i++) truncated[overflow[1 + i]] = 1;
+    kept.clear();
+    for (uint32_t i = 0; i < n; i++)
+      if (!truncated[out[i].queryEid - s.first]) kept.push_back(out[i]);
+    if (!kept.empty()) sink(kept.data(), kept.size());
+    st.hitCount += kept.size();
+
+    // Same growth rule as lsiIntersect; the slot keeps the size.
+    s.capacity = grownAppendCapacity("lsiIntersectStreamed", s.capacity, attempted, kept.size());
+    destroyBuffer(ctx, s.outHits);
+    s.outHits = makeHostBuffer(ctx, sizeof(HitRecord) * s.capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    writeSSBO(s.set, ctx.dev, B_OUT_HITS, s.outHits);
+
+    std::memcpy(list, overflow + 1, sizeof(uint32_t) * truncCount);
+    submitSlot(ctx, e, s, truncCount, true);
+    st.rounds++;
+  }
+  s.count = 0;
+}
+
+void lsiIntersectStreamed(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                          LineMapView query, const LsiStreamOptions &opts, const LsiHitSink &sink,
+                          LsiStreamStats *stats) {
+  VkDevice dev = ctx.dev;
+  auto tStart = std::chrono::steady_clock::now();
+  if (query.edgeCount > UINT32_MAX) {
+    std::cerr << "lsiIntersectStreamed: " << query.edgeCount << " query edges, ids must fit in 32 bits\n";
+    std::exit(1);
+  }
+  const uint32_t QUERY_COUNT = (uint32_t) query.edgeCount;
+  const uint32_t BATCH = std::clamp(opts.batchSize, 1u, std::max(QUERY_COUNT, 1u));
+  const uint32_t SLOTS = LSI_STREAM_SLOTS;
+  LsiStreamStats st{};
+
+  // Own descriptor pool: e.dset stays with lsiIntersect.
+  VkDescriptorPoolSize ps[2]{};
+  ps[0].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+  ps[0].descriptorCount = SLOTS;
+  ps[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  ps[1].descriptorCount = (BINDING_COUNT - 1) * SLOTS;
+
+  VkDescriptorPoolCreateInfo dpci{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  dpci.maxSets = SLOTS;
+  dpci.poolSizeCount = 2;
+  dpci.pPoolSizes = ps;
+  VkDescriptorPool dpool{};
+  VK_CHECK(vkCreateDescriptorPool(dev, &dpci, nullptr, &dpool));
+
+  VkDescriptorSetLayout layouts[LSI_STREAM_SLOTS];
+  std::fill(layouts, layouts + SLOTS, e.dsl);
+  VkDescriptorSet sets[LSI_STREAM_SLOTS]{};
+  VkDescriptorSetAllocateInfo dsai{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  dsai.descriptorPool = dpool;
+  dsai.descriptorSetCount = SLOTS;
+  dsai.pSetLayouts = layouts;
+  VK_CHECK(vkAllocateDescriptorSets(dev, &dsai, sets));
+
+  VkCommandBuffer cmds[LSI_STREAM_SLOTS]{};
+  VkCommandBufferAllocateInfo cbai{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  cbai.commandPool = e.cmdPool;
+  cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cbai.commandBufferCount = SLOTS;
+  VK_CHECK(vkAllocateCommandBuffers(dev, &cbai, cmds));
+
+  // Only used by the two-pass and occlusion modes; bound to keep the sets complete.
+  Buffer unusedOffsets = createBuffer(ctx, 4, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+  StreamSlot slots[LSI_STREAM_SLOTS]{};
+  for (uint32_t i = 0; i < SLOTS; i++) {
+    StreamSlot &s = slots[i];
+    s.cmd = cmds[i];
+    s.set = sets[i];
+    VkFenceCreateInfo fci{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VK_CHECK(vkCreateFence(dev, &fci, nullptr, &s.fence));
+    initProfiler(ctx, s.prof, 4); // one scope per submission
+
+    s.pts = makeStreamBuffer(ctx, sizeof(Point2) * 2 * (VkDeviceSize) BATCH);
+    s.edges = makeStreamBuffer(ctx, sizeof(Edge) * (VkDeviceSize) BATCH);
+    s.capacity = std::clamp(opts.initialOutHits, 1u, MAX_APPEND_HITS);
+    s.outHits = makeHostBuffer(ctx, sizeof(HitRecord) * s.capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    s.counter = makeHostBuffer(ctx, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    s.overflow = makeHostBuffer(ctx, sizeof(uint32_t) * (BATCH + 1), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    s.list = makeHostBuffer(ctx, sizeof(uint32_t) * BATCH, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    writeTLAS(s.set, dev, scene.tlas);
+    writeSSBO(s.set, dev, B_QUERY_PTS, s.pts);
+    writeSSBO(s.set, dev, B_QUERY_EDGES, s.edges);
+    writeSSBO(s.set, dev, B_BASE_PTS, scene.basePts);
+    writeSSBO(s.set, dev, B_BASE_EDGES, scene.baseEdges);
+    writeSSBO(s.set, dev, B_OUT_HITS, s.outHits);
+    writeSSBO(s.set, dev, B_OUT_COUNTER, s.counter);
+    writeSSBO(s.set, dev, B_QUERY_OFFSETS, unusedOffsets);
+    writeSSBO(s.set, dev, B_HIT_MASK, unusedOffsets);
+    writeSSBO(s.set, dev, B_QUERY_LIST, s.list);
+    writeSSBO(s.set, dev, B_OVERFLOW, s.overflow);
+    writeSSBO(s.set, dev, B_BUCKET_RANGES, scene.bucketRanges);
+    writeSSBO(s.set, dev, B_TILE_FIRST_PRIM, scene.tileFirstPrim);
+    writeSSBO(s.set, dev, B_BUCKET_EDGES, scene.bucketEdgeIds);
+  }
+
+  std::vector<uint8_t> truncated;
+  std::vector<HitRecord> kept;
+  const uint32_t batches = (uint32_t) (((uint64_t) QUERY_COUNT + BATCH - 1) / BATCH);
+  for (uint32_t b = 0; b < batches; b++) {
+    // Slot reuse: batch b - SLOTS must be done (and read back) before its buffers are refilled.
+    StreamSlot &s = slots[b % SLOTS];
+    if (s.count) harvestSlot(ctx, e, s, sink, truncated, kept, st);
+
+    // Gather the batch with its own copy of the endpoints (two per edge), so the device
+    // never needs the global point array.
+    auto t0 = std::chrono::steady_clock::now();
+    s.first = b * BATCH;
+    s.count = std::min(BATCH, QUERY_COUNT - s.first);
+    Point2 *pts = (Point2 *) mapBuffer(ctx, s.pts);
+    Edge *edges = (Edge *) mapBuffer(ctx, s.edges);
+    for (uint32_t i = 0; i < s.count; i++) {
+      const Edge &qe = query.edges[s.first + i];
+      pts[2 * i] = query.points[qe.p1_idx];
+      pts[2 * i + 1] = query.points[qe.p2_idx];
+      edges[i] = {2 * i, 2 * i + 1, 0, 0};
+    }
+    st.fillMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    submitSlot(ctx, e, s, s.count, false);
+    st.rounds++;
+  }
+
+  // Drain the last batches, oldest first.
+  for (uint32_t b = batches > SLOTS ? batches - SLOTS : 0; b < batches; b++)
+    harvestSlot(ctx, e, slots[b % SLOTS], sink, truncated, kept, st);
+
+  for (StreamSlot &s: slots) {
+    vkDestroyFence(dev, s.fence, nullptr);
+    destroyProfiler(ctx, s.prof);
+    destroyBuffer(ctx, s.pts);
+    destroyBuffer(ctx, s.edges);
+    destroyBuffer(ctx, s.outHits);
+    destroyBuffer(ctx, s.counter);
+    destroyBuffer(ctx, s.overflow);
+    destroyBuffer(ctx, s.list);
+  }
+  destroyBuffer(ctx, unusedOffsets);
+  vkFreeCommandBuffers(dev, e.cmdPool, SLOTS, cmds);
+  vkDestroyDescriptorPool(dev, dpool, nullptr);
+
+  st.batches = batches;
+  st.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+  if (stats) *stats = st;
+}
@@ -0,0 +1,249 @@
+// lsi_engine.h - GPU line-segment intersection (LSI) on the KHR ray tracing pipeline.
+//
+// A scene holds one base map as procedural AABB geometry (see lsi_bucket.h), in one
+// BLAS or, with LsiEngine::maxTileEdges, one BLAS per spatial tile under the TLAS; every
+// query edge becomes one ray with t in [0,1], the intersection shader runs the
+// segment-segment test and the any-hit shader records every hit.
+// The ray query backend runs the same traversal from a compute shader (RayQuery with
+// the segment test in the candidate loop): no SBT, no shader-stage switches per hit.
+// Scenes do not depend on the backend.
+//
+//   LsiEngine e;  initLsiEngine(ctx, e);
+//   LsiScene s = createLsiScene(ctx, e, baseMap, K);
+//   auto hits = lsiIntersect(ctx, e, s, queryMap, {});
+//
+// The engine owns one command buffer and descriptor set; calls are synchronous and
+// must not overlap. lsiIntersectStreamed pipelines batches internally but also returns
+// only once every batch is done.
+#pragma once
+
+#include "lsi_bucket.h"
+#include "lsi_pip.h"
+#include "lsi_spatial.h"
+#include "lsi_types.h"
+
+#include "vk_accel.h"
+#include "vk_context.h"
+#include "vk_profiler.h"
+#include "vk_scan.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct LsiEngine;
+
+// ---- Scene ----
+struct LsiScene {
+  Buffer basePts;
+  Buffer baseEdges;
+  Buffer aabbs;
+  Buffer bucketRanges; // BucketRange per primitive
+  Buffer bucketEdgeIds; // base edge ids, Morton order
+  Buffer tileFirstPrim; // uint32 per tile, indexed by instance
+  std::vector<TileRange> tiles; // one when untiled
+  std::vector<Accel> blases; // one per tile
+  Accel tlas; // instance t = blases[t]
+
+  uint32_t baseEdgeCount{};
+  uint32_t primCount{};
+  uint32_t edgesPerPrim{};
+  double buildMs{}; // GPU time of the BLAS + TLAS build
+  AccelCompactStats compaction; // BLAS bytes before/after of the last compaction, only with LsiEngine::compactBlas
+
+  // Host copies for updateLsiScene, only with LsiEngine::updatableBlas
+  std::vector<VkAabbPositionsKHR> hostAabbs;
+  std::vector<BucketRange> hostRanges;
+  std::vector<uint32_t> hostEdgeIds;
+  std::vector<uint32_t> edgeBucket; // base edge -> primitive
+  std::vector<RefitTracker> refit; // per tile
+};
+
+// edgesPerPrim: base edges per AABB primitive (K). 1 = one AABB per edge.
+LsiScene createLsiScene(VkContext &ctx, LsiEngine &e, LineMapView base, uint32_t edgesPerPrim = 1);
+
+// Same with buckets computed ahead of time (no host work besides the uploads). The
+// buckets' tiles are used as they are, whatever e.maxTileEdges says.
+LsiScene createLsiScene(VkContext &ctx, LsiEngine &e, LineMapView base, const EdgeBucketsView &buckets);
+void destroyLsiScene(VkContext &ctx, LsiScene &s);
+
+// BLAS bytes over all tiles
+VkDeviceSize lsiSceneBlasBytes(const LsiScene &s);
+
+// Base map edit between queries: the points listed in moved have new coordinates in base
+// (same points, edges and connectivity as at creation otherwise). Uploads them and the
+// boxes of the buckets they touch, then refits or rebuilds the BLAS of every touched
+// tile as e.refitPolicy decides (each tile has its own tracker; untouched tiles are left
+// alone). The TLAS is rebuilt in place. Buckets keep their edges and tiles, so the Morton
+// grouping also ages until the scene is recreated. Finding the touched buckets scans all
+// edges once. Needs LsiEngine::updatableBlas when the scene was created.
+struct LsiUpdateStats {
+  uint32_t changedPrims{};
+  uint32_t changedTiles{};
+  uint32_t rebuiltTiles{};
+  bool rebuilt{}; // any tile
+  double qualityLoss{}; // largest over the tiles' refit trackers after this update (0 after a rebuild)
+  double uploadMs{}; // host time of the point / AABB uploads
+  double blasMs{}; // GPU time of the refit or the rebuild
+  double tlasMs{};
+};
+
+void updateLsiScene(VkContext &ctx, LsiEngine &e, LsiScene &s, LineMapView base,
+                    const uint32_t *moved, size_t movedCount, LsiUpdateStats *stats = nullptr);
+
+// ---- Engine ----
+enum class LsiBackend {
+  RtPipeline, // vkCmdTraceRaysKHR: raygen + intersection + any-hit
+  RayQuery, // vkCmdDispatch of rqMain (VK_KHR_ray_query)
+};
+
+// The append modes share the overflow handling and only differ in how often the
+// any-hit shader hits the global counter: once per hit, once per batch of up to
+// HIT_BATCH hits of a ray, or per batch with the last partial batches of a subgroup
+// merged into one atomic. Hit order in the output differs between them.
+enum class LsiOutput {
+  TwoPass, // count -> device prefix sum -> write: exact size, grouped by query edge
+  Append, // global atomic append, overflowed query edges re-traced into a grown buffer
+  AppendPerRay, // Append, hits staged per ray in the payload
+  AppendSubgroup, // AppendPerRay, leftovers flushed per subgroup (AppendPerRay if unsupported)
+};
+
+// Ray launch order. Input order sends neighbouring invocations into unrelated parts of
+// the BVH; sorting query edges by a space-filling curve of their midpoints keeps a warp's
+// rays spatially close (coherent traversal, better cache hit rate). The permutation is
+// applied through the query-id list, so HitRecord::queryEid stays the input id.
+enum class LsiQueryOrder { Input, Morton, Hilbert };
+
+struct LsiQueryOptions {
+  LsiOutput output = LsiOutput::TwoPass;
+  LsiQueryOrder order = LsiQueryOrder::Input;
+};
+
+struct LsiQueryStats {
+  uint32_t rounds{}; // trace submissions (append: 1 + re-trace rounds, two-pass: 2)
+  double sortMs{}; // host time of the query reordering
+  double traceMs{}; // GPU time of all traces (+ scan for two-pass)
+  uint64_t hitCount{};
+};
+
+struct LsiEngine {
+  LsiBackend backend{};
+  VkCommandPool cmdPool{};
+  VkCommandBuffer cmd{};
+
+  VkDescriptorSetLayout dsl{};
+  VkPipelineLayout layout{};
+  VkDescriptorPool dpool{};
+  VkDescriptorSet dset{};
+
+  VkShaderModule modules[5]{}; // RT pipeline stages, or rqMain alone in [0]
+  VkPipeline pipeline{}; // of the backend
+
+  Buffer sbt; // RT pipeline only
+  VkStridedDeviceAddressRegionKHR rgenRegion{}, missRegion{}, hitRegion{}, callRegion{};
+
+  ExclusiveScan scan;
+  GpuProfiler prof; // every build / trace / readback scope of the engine's calls
+
+  uint32_t initialOutHits = 1024; // append mode start capacity
+  bool compactBlas = false; // scenes compact their BLAS before the TLAS build (see compactAccels)
+  bool updatableBlas = false; // scenes can be edited with updateLsiScene (ALLOW_UPDATE BLAS)
+  RefitPolicy refitPolicy; // per tile
+  uint32_t maxTileEdges = 0; // > 0: base maps are tiled, one BLAS per tile (see bucketEdgesTiled)
+  bool hostInputs = false; // points, edges, AABBs and query lists in HOST_VISIBLE memory instead of
+                           // DEVICE_LOCAL (the layout before the staging ring), to measure the difference
+};
+
+bool lsiBackendSupported(const VkCaps &caps, LsiBackend backend);
+
+// Subgroup arithmetic + ballot in the stage that ends the ray (raygen, or compute).
+bool lsiSubgroupAppendSupported(const VkCaps &caps, LsiBackend backend);
+
+// Exits if the device does not support the backend.
+void initLsiEngine(VkContext &ctx, LsiEngine &e, LsiBackend backend = LsiBackend::RtPipeline);
+void destroyLsiEngine(VkContext &ctx, LsiEngine &e);
+
+std::vector<HitRecord> lsiIntersect(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                                    LineMapView query, const LsiQueryOptions &opts,
+                                    LsiQueryStats *stats = nullptr);
+
+// ---- Occlusion ----
+// Does query edge q cross any base edge: bit (q & 31) of word q / 32 of the returned
+// mask. Each ray stops at its first hit (RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, or an
+// aborted ray query) and the device writes one bit per query edge instead of hit
+// records. stats->hitCount is the number of set bits.
+std::vector<uint32_t> lsiOcclusion(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                                   LineMapView query, LsiQueryOrder order = LsiQueryOrder::Input,
+                                   LsiQueryStats *stats = nullptr);
+
+// ---- Point in polygon ----
+// Zones (see lsi_pip.h) as an LSI scene of their ring edges, plus the exact CPU index
+// for the points the GPU cannot decide.
+struct PipScene {
+  LsiScene lsi;
+  PipCpuIndex exact;
+  float rayEndX{}; // right of every edge
+};
+
+PipScene createPipScene(VkContext &ctx, LsiEngine &e, const PolygonSet &zones, uint32_t edgesPerPrim = 1);
+void destroyPipScene(VkContext &ctx, PipScene &s);
+
+struct PipQueryStats {
+  double sortMs{}; // host time of the query reordering
+  double traceMs{}; // GPU time of the trace
+  double resolveMs{}; // host time of the exact re-classification
+  uint64_t resolved{}; // points re-classified on the host
+  uint64_t inside{}; // points in some zone
+  uint64_t boundary{};
+};
+
+// Zone of every point (or PIP_OUTSIDE / PIP_BOUNDARY), by the parity of the crossings
+// of one ray per point along +x. The intersection shader applies the rules of lsi_pip.h
+// with a filtered float orientation; a point with an edge inside the filter's error
+// bound comes back unsure and is classified exactly on the host (pipClassifyPoint), so
+// the result equals pipClassifyCpu for every point.
+std::vector<uint32_t> lsiPointInPolygon(VkContext &ctx, LsiEngine &e, const PipScene &scene,
+                                        const Point2 *points, uint64_t count,
+                                        LsiQueryOrder order = LsiQueryOrder::Input,
+                                        PipQueryStats *stats = nullptr);
+
+// ---- Streaming ----
+// Out-of-core queries: the query map is cut into batches of batchSize edges and only
+// LSI_STREAM_SLOTS batches live on the device at a time. While the GPU traces batch i,
+// the host fills batch i+1 and hands the hits of batch i-1 to the sink, so uploads,
+// traces and readbacks overlap. Each slot has its own buffers, descriptor set, command
+// buffer and fence. Output is append per batch; query edges that overflow a slot's
+// buffer are re-traced once it grew (the grown size is kept for later batches).
+constexpr uint32_t LSI_STREAM_SLOTS = 3;
+
+struct LsiStreamOptions {
+  uint32_t batchSize = 1u << 20; // query edges per batch
+  uint32_t initialOutHits = 1u << 20; // per-slot output capacity before growing
+};
+
+struct LsiStreamStats {
+  uint32_t batches{};
+  uint32_t rounds{}; // trace submissions (batches + overflow re-traces)
+  double fillMs{}; // host time gathering batch inputs
+  double waitMs{}; // host time blocked on slot fences
+  double traceMs{}; // GPU time of all traces (0 without timestamps)
+  double totalMs{}; // wall time of the whole stream
+  uint64_t hitCount{};
+};
+
+// Called once or more per batch, in batch order. HitRecord::queryEid is the global query
+// edge id. The pointer is only valid during the call (it may point into mapped memory).
+using LsiHitSink = std::function<void(const HitRecord *hits, size_t count)>;
+
+void lsiIntersectStreamed(VkContext &ctx, LsiEngine &e, const LsiScene &scene,
+                          LineMapView query, const LsiStreamOptions &opts, const LsiHitSink &sink,
+                          LsiStreamStats *stats = nullptr);
+
+LsiQueryOrder parseQueryOrder(const char *name); // "input" | "morton" | "hilbert"
+const char *queryOrderName(LsiQueryOrder order);
+
+LsiBackend parseBackend(const char *name); // "pipeline" | "rayquery"
+const char *backendName(LsiBackend backend);
+
+LsiOutput parseOutput(const char *name); // "two-pass" | "append" | "append-ray" | "append-subgroup"
+const char *outputName(LsiOutput output);
@@ -0,0 +1,181 @@
+// lsi_mapfile.cpp
+#include "lsi_mapfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t alignOffset(uint64_t v) { return (v + LSIMAP_ALIGN - 1) & ~(LSIMAP_ALIGN - 1); }
+
+static void fail(const char *path, const char *what) {
+  std::cerr << path << ": " << what << "\n";
+  std::exit(1);
+}
+
+// ---- Binary ----
+MappedLineMap openLineMap(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) fail(path, "cannot open");
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0) fail(path, "cannot stat");
+  if ((size_t) st.st_size < sizeof(LsiMapHeader)) fail(path, "too small for an .lsimap header");
+
+  MappedLineMap m{};
+  m.size = (size_t) st.st_size;
+  m.base = mmap(nullptr, m.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m.base == MAP_FAILED) fail(path, "mmap failed");
+
+  // Read once front to back while uploading. Advice values are not flags, one call each;
+  // they are only hints, so a failure is reported but not fatal.
+  if (madvise(m.base, m.size, MADV_SEQUENTIAL) != 0) std::cerr << path << ": madvise(MADV_SEQUENTIAL) failed\n";
+  if (madvise(m.base, m.size, MADV_WILLNEED) != 0) std::cerr << path << ": madvise(MADV_WILLNEED) failed\n";
+
+  const uint8_t *bytes = (const uint8_t *) m.base;
+  const LsiMapHeader *h = (const LsiMapHeader *) bytes;
+  m.header = h;
+  if (std::memcmp(h->magic, LSIMAP_MAGIC, sizeof(LSIMAP_MAGIC)) != 0) fail(path, "not an .lsimap file");
+  if (h->version != LSIMAP_VERSION) fail(path, "unsupported .lsimap version");
+  if (h->fileSize != m.size) fail(path, "truncated (size does not match header)");
+
+  auto section = [&](uint64_t offset, uint64_t count, uint64_t elemSize) -> const void * {
+    if (offset % LSIMAP_ALIGN || count > m.size / std::max<uint64_t>(elemSize, 1) || offset > m.size - count * elemSize)
+      fail(path, "section out of bounds");
+    return bytes + offset;
+  };
+
+  m.map.points = (const Point2 *) section(h->pointsOffset, h->pointCount, sizeof(Point2));
+  m.map.pointCount = h->pointCount;
+  m.map.edges = (const Edge *) section(h->edgesOffset, h->edgeCount, sizeof(Edge));
+  m.map.edgeCount = h->edgeCount;
+
+  if (h->flags & LSIMAP_HAS_BUCKETS) {
+    m.buckets.aabbs = (const VkAabbPositionsKHR *) section(h->aabbsOffset, h->primCount, sizeof(VkAabbPositionsKHR));
+    m.buckets.ranges = (const BucketRange *) section(h->rangesOffset, h->primCount, sizeof(BucketRange));
+    m.buckets.edgeIds = (const uint32_t *) section(h->edgeIdsOffset, h->edgeCount, sizeof(uint32_t));
+    m.buckets.primCount = h->primCount;
+    m.buckets.edgesPerPrim = h->edgesPerPrim;
+  }
+
+  // Every index the shaders follow must stay inside its array
+  for (uint64_t i = 0; i < m.map.edgeCount; i++)
+    if (m.map.edges[i].p1_idx >= m.map.pointCount || m.map.edges[i].p2_idx >= m.map.pointCount)
+      fail(path, "edge references a missing point");
+  for (uint64_t i = 0; i < m.buckets.primCount; i++)
+    if ((uint64_t) m.buckets.ranges[i].first + m.buckets.ranges[i].count > m.map.edgeCount)
+      fail(path, "bucket range out of bounds");
+  if (m.buckets.edgeIds)
+    for (uint64_t i = 0; i < m.map.edgeCount; i++)
+      if (m.buckets.edgeIds[i] >= m.map.edgeCount) fail(path, "bucket edge id out of range");
+  return m;
+}
+
+void closeLineMap(MappedLineMap &m) {
+  if (m.base) munmap(m.base, m.size);
+  m = {};
+}
+
+void writeLineMap(const char *path, LineMapView map, const EdgeBucketsView *buckets) {
+  LsiMapHeader h{};
+  std::memcpy(h.magic, LSIMAP_MAGIC, sizeof(LSIMAP_MAGIC));
+  h.version = LSIMAP_VERSION;
+  h.pointCount = map.pointCount;
+  h.edgeCount = map.edgeCount;
+
+  uint64_t off = alignOffset(sizeof(LsiMapHeader));
+  h.pointsOffset = off;
+  off = alignOffset(off + sizeof(Point2) * map.pointCount);
+  h.edgesOffset = off;
+  off = alignOffset(off + sizeof(Edge) * map.edgeCount);
+  if (buckets) {
+    h.flags |= LSIMAP_HAS_BUCKETS;
+    h.primCount = buckets->primCount;
+    h.edgesPerPrim = buckets->edgesPerPrim;
+    h.aabbsOffset = off;
+    off = alignOffset(off + sizeof(VkAabbPositionsKHR) * buckets->primCount);
+    h.rangesOffset = off;
+    off = alignOffset(off + sizeof(BucketRange) * buckets->primCount);
+    h.edgeIdsOffset = off;
+    off = alignOffset(off + sizeof(uint32_t) * map.edgeCount);
+  }
+  h.fileSize = off;
+
+  FILE *f = std::fopen(path, "wb");
+  if (!f) fail(path, "cannot create");
+
+  auto put = [&](uint64_t offset, const void *data, uint64_t size) {
+    if (std::fseek(f, (long) offset, SEEK_SET) != 0 || (size && std::fwrite(data, 1, size, f) != size))
+      fail(path, "write failed");
+  };
+  put(0, &h, sizeof(h));
+  put(h.pointsOffset, map.points, sizeof(Point2) * map.pointCount);
+  put(h.edgesOffset, map.edges, sizeof(Edge) * map.edgeCount);
+  if (buckets) {
+    put(h.aabbsOffset, buckets->aabbs, sizeof(VkAabbPositionsKHR) * buckets->primCount);
+    put(h.rangesOffset, buckets->ranges, sizeof(BucketRange) * buckets->primCount);
+    put(h.edgeIdsOffset, buckets->edgeIds, sizeof(uint32_t) * map.edgeCount);
+  }
+  // Pad the last section so fileSize holds
+  if (std::fseek(f, (long) h.fileSize - 1, SEEK_SET) != 0 || std::fputc(0, f) == EOF) fail(path, "write failed");
+  if (std::fclose(f) != 0) fail(path, "write failed");
+}
+
+// ---- Text ----
+LineMap readLineMapText(const char *path) {
+  FILE *f = std::fopen(path, "r");
+  if (!f) fail(path, "cannot open");
+
+  LineMap m;
+  char line[256];
+  uint64_t lineNo = 0;
+  while (std::fgets(line, sizeof(line), f)) {
+    lineNo++;
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) continue;
+
+    char *end = nullptr;
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      Point2 pt{};
+      pt.x = std::strtof(p + 1, &end);
+      const char *q = end;
+      pt.y = std::strtof(q, &end);
+      if (end == q) {
+        std::cerr << path << ":" << lineNo << ": expected 'v <x> <y>'\n";
+        std::exit(1);
+      }
+      m.points.push_back(pt);
+    } else if (p[0] == 'e' && (p[1] == ' ' || p[1] == '\t')) {
+      Edge e{};
+      e.p1_idx = (uint32_t) std::strtoul(p + 1, &end, 10);
+      const char *q = end;
+      e.p2_idx = (uint32_t) std::strtoul(q, &end, 10);
+      if (end == q) {
+        std::cerr << path << ":" << lineNo << ": expected 'e <p1> <p2>'\n";
+        std::exit(1);
+      }
+      m.edges.push_back(e);
+    } else {
+      std::cerr << path << ":" << lineNo << ": unknown record\n";
+      std::exit(1);
+    }
+  }
+  std::fclose(f);
+
+  for (size_t i = 0; i < m.edges.size(); i++) {
+    if (m.edges[i].p1_idx >= m.points.size() || m.edges[i].p2_idx >= m.points.size()) {
+      std::cerr << path << ": edge " << i << " references a missing point\n";
+      std::exit(1);
+    }
+  }
+  return m;
+}
@@ -0,0 +1,70 @@
+// lsi_mapfile.h - versioned binary container for large line maps (.lsimap).
+//
+// Layout (little-endian, every section 4 KiB aligned):
+//   LsiMapHeader                    128 bytes
+//   Point2[pointCount]
+//   Edge[edgeCount]
+//   optional, LSIMAP_HAS_BUCKETS (precomputed BLAS input for edgesPerPrim = K):
+//     VkAabbPositionsKHR[primCount]
+//     BucketRange[primCount]
+//     uint32_t edgeIds[edgeCount]
+//
+// Arrays are stored exactly as the GPU consumes them, so a loaded map is a set of
+// pointers into the mmap'd file that go straight into staging memory: load time is
+// disk read time, not parse time. Indices are checked on open (edge points, bucket
+// ranges and edge ids against their counts), since the GPU reads through them unchecked.
+#pragma once
+
+#include "lsi_bucket.h"
+#include "lsi_types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+static constexpr char LSIMAP_MAGIC[8] = {'L', 'S', 'I', 'M', 'A', 'P', 0, 0};
+static constexpr uint32_t LSIMAP_VERSION = 1;
+static constexpr uint64_t LSIMAP_ALIGN = 4096;
+
+enum : uint32_t {
+  LSIMAP_HAS_BUCKETS = 1u << 0,
+};
+
+struct LsiMapHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags; // LSIMAP_*
+  uint64_t pointCount;
+  uint64_t edgeCount;
+  uint64_t primCount; // 0 without LSIMAP_HAS_BUCKETS
+  uint32_t edgesPerPrim;
+  uint32_t reserved0;
+  uint64_t pointsOffset; // byte offsets from the start of the file
+  uint64_t edgesOffset;
+  uint64_t aabbsOffset;
+  uint64_t rangesOffset;
+  uint64_t edgeIdsOffset;
+  uint64_t fileSize;
+  uint8_t reserved[32];
+};
+static_assert(sizeof(LsiMapHeader) == 128, "LsiMapHeader is part of the file format");
+
+struct MappedLineMap {
+  void *base{};
+  size_t size{};
+  const LsiMapHeader *header{};
+  LineMapView map;
+  EdgeBucketsView buckets; // primCount == 0 when the file has none
+};
+
+// mmap's path read-only and checks header, section bounds and every index. Exits on error.
+MappedLineMap openLineMap(const char *path);
+void closeLineMap(MappedLineMap &m);
+
+// Writes map (and, when buckets != nullptr, its precomputed buckets). Exits on error.
+void writeLineMap(const char *path, LineMapView map, const EdgeBucketsView *buckets);
+
+// Text format, one record per line ('#' starts a comment):
+//   v <x> <y>        point, ids are assigned in order starting at 0
+//   e <p1> <p2>      edge between two point ids
+// Exits on malformed input or out-of-range point ids.
+LineMap readLineMapText(const char *path);
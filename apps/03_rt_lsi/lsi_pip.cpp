@@ -0,0 +1,140 @@
+// lsi_pip.cpp
+#include "lsi_pip.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+LineMap pipEdges(const PolygonSet &polys) {
+  LineMap m;
+  m.points = polys.points;
+  m.edges.reserve(polys.points.size());
+  for (uint32_t r = 0; r < ringCount(polys); r++) {
+    const uint32_t first = polys.ringStart[r], end = polys.ringStart[r + 1];
+    for (uint32_t i = first; i < end; i++)
+      m.edges.push_back({i, i + 1 < end ? i + 1 : first, polys.ringZone[r], 0});
+  }
+  return m;
+}
+
+// ---- Exact edge test ----
+// Sign of x[0] + ... + x[n-1]: grows a nonoverlapping expansion term by term (two-sum,
+// zero components dropped), whose largest component is the last one.
+static int expansionSign(const double *x, int n) {
+  double h[8];
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    double q = x[i];
+    int k = 0;
+    for (int j = 0; j < m; j++) {
+      const double s = q + h[j];
+      const double bv = s - q;
+      const double err = (q - (s - bv)) + (h[j] - bv);
+      q = s;
+      if (err != 0.0) h[k++] = err;
+    }
+    if (q != 0.0) h[k++] = q;
+    m = k;
+  }
+  return m == 0 ? 0 : h[m - 1] > 0.0 ? 1 : -1;
+}
+
+// Sign of cross(b - a, c - a) as ax*by - ay*bx + bx*cy - by*cx + cx*ay - cy*ax
+static int orientExact(Point2 a, Point2 b, Point2 c) {
+  const double t[6] = {
+    (double) a.x * b.y, -((double) a.y * b.x),
+    (double) b.x * c.y, -((double) b.y * c.x),
+    (double) c.x * a.y, -((double) c.y * a.x),
+  };
+  return expansionSign(t, 6);
+}
+
+PipEdge pipEdgeExact(Point2 p, Point2 a, Point2 b) {
+  const Point2 lo = a.y <= b.y ? a : b;
+  const Point2 hi = a.y <= b.y ? b : a;
+  if (p.y < lo.y || p.y > hi.y) return PipEdge::None;
+  if (lo.y == hi.y)
+    return p.x >= std::min(lo.x, hi.x) && p.x <= std::max(lo.x, hi.x) ? PipEdge::Boundary : PipEdge::None;
+
+  // > 0: p left of the upward edge, which then lies to the right of p
+  const int s = orientExact(lo, hi, p);
+  if (s == 0) return PipEdge::Boundary;
+  if (p.y == hi.y || s < 0) return PipEdge::None;
+  return PipEdge::Cross;
+}
+
+// ---- CPU classifier ----
+static uint32_t rowOf(const PipCpuIndex &ix, float y) {
+  return std::min((uint32_t) ((y - ix.bounds.minY) * ix.rowsPerUnit), ix.rows - 1);
+}
+
+PipCpuIndex createPipCpuIndex(LineMapView edges, uint32_t rows) {
+  auto t0 = std::chrono::steady_clock::now();
+  PipCpuIndex ix{};
+  const uint64_t E = edges.edgeCount;
+  ix.a.resize(E);
+  ix.b.resize(E);
+  ix.zone.resize(E);
+  for (uint64_t i = 0; i < E; i++) {
+    ix.a[i] = edges.points[edges.edges[i].p1_idx];
+    ix.b[i] = edges.points[edges.edges[i].p2_idx];
+    ix.zone[i] = edges.edges[i].pad0;
+  }
+
+  ix.bounds = {0, 0, 0, 0};
+  if (E) ix.bounds = {ix.a[0].x, ix.a[0].y, ix.a[0].x, ix.a[0].y};
+  for (uint64_t i = 0; i < E; i++)
+    for (Point2 p: {ix.a[i], ix.b[i]}) {
+      ix.bounds.minX = std::min(ix.bounds.minX, p.x);
+      ix.bounds.minY = std::min(ix.bounds.minY, p.y);
+      ix.bounds.maxX = std::max(ix.bounds.maxX, p.x);
+      ix.bounds.maxY = std::max(ix.bounds.maxY, p.y);
+    }
+
+  ix.rows = rows ? rows : std::max((uint32_t) std::sqrt((double) E), 1u);
+  const float extent = ix.bounds.maxY - ix.bounds.minY;
+  ix.rowsPerUnit = extent > 0.f ? (float) ix.rows / extent : 0.f;
+
+  // Counting sort of (row, edge) pairs. rowOf is monotonic in y, so an edge whose y range
+  // holds p.y is listed in p's row.
+  ix.rowStart.assign(ix.rows + 1, 0);
+  for (uint64_t i = 0; i < E; i++) {
+    const uint32_t r0 = rowOf(ix, std::min(ix.a[i].y, ix.b[i].y));
+    const uint32_t r1 = rowOf(ix, std::max(ix.a[i].y, ix.b[i].y));
+    for (uint32_t r = r0; r <= r1; r++) ix.rowStart[r + 1]++;
+  }
+  for (uint32_t r = 0; r < ix.rows; r++) ix.rowStart[r + 1] += ix.rowStart[r];
+  ix.rowEdges.resize(ix.rowStart[ix.rows]);
+  std::vector<uint32_t> cursor(ix.rowStart.begin(), ix.rowStart.end() - 1);
+  for (uint64_t i = 0; i < E; i++) {
+    const uint32_t r0 = rowOf(ix, std::min(ix.a[i].y, ix.b[i].y));
+    const uint32_t r1 = rowOf(ix, std::max(ix.a[i].y, ix.b[i].y));
+    for (uint32_t r = r0; r <= r1; r++) ix.rowEdges[cursor[r]++] = (uint32_t) i;
+  }
+
+  ix.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  return ix;
+}
+
+uint32_t pipClassifyPoint(const PipCpuIndex &ix, Point2 p) {
+  if (ix.a.empty() || !(p.y >= ix.bounds.minY && p.y <= ix.bounds.maxY) || !(p.x <= ix.bounds.maxX))
+    return PIP_OUTSIDE;
+
+  const uint32_t r = rowOf(ix, p.y);
+  uint32_t acc = 0;
+  for (uint32_t i = ix.rowStart[r]; i < ix.rowStart[r + 1]; i++) {
+    const uint32_t e = ix.rowEdges[i];
+    const PipEdge k = pipEdgeExact(p, ix.a[e], ix.b[e]);
+    if (k == PipEdge::Boundary) return PIP_BOUNDARY;
+    if (k == PipEdge::Cross) acc ^= ix.zone[e] + 1;
+  }
+  return acc ? acc - 1 : PIP_OUTSIDE;
+}
+
+void pipClassifyCpu(const PipCpuIndex &ix, const Point2 *points, uint64_t count, uint32_t *out, ThreadPool *pool) {
+  auto body = [&](uint64_t begin, uint64_t end, uint32_t) {
+    for (uint64_t i = begin; i < end; i++) out[i] = pipClassifyPoint(ix, points[i]);
+  };
+  if (pool) parallelFor(*pool, count, 4096, body);
+  else body(0, count, 0);
+}
@@ -0,0 +1,71 @@
+// lsi_pip.h - point in polygon by crossing parity: zones, exact edge test, CPU classifier.
+//
+// A zone is a polygon given as rings; holes are more rings of the same zone. A point is
+// inside a zone when the ray from it along +x crosses that zone's rings an odd number of
+// times. Rings become LSI base edges (pipEdges) carrying their zone in Edge::pad0, so the
+// GPU path (lsiPointInPolygon in lsi_engine.h) runs on an ordinary LsiScene.
+//
+// Degenerate cases, same rules on the GPU and here:
+//   - An edge counts when lo.y <= p.y < hi.y (half-open in y), so a ring passing through
+//     the ray at a vertex is counted once and a ring only touching it 0 or 2 times.
+//   - Horizontal edges never count.
+//   - Endpoints are put in lower-first order before any arithmetic, so the two copies of
+//     an edge shared by adjacent zones give bit-identical answers.
+//   - Points on an edge or a vertex are PIP_BOUNDARY, whatever zones the edge separates.
+// Zones must not overlap: the result is the xor of (zone + 1) over the crossed edges,
+// which is the single zone with odd parity, or 0 outside every zone.
+#pragma once
+
+#include "lsi_spatial.h"
+#include "lsi_types.h"
+
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+// Results besides a zone id (zone ids must stay below PIP_BOUNDARY - 1)
+constexpr uint32_t PIP_OUTSIDE = 0xFFFFFFFFu;
+constexpr uint32_t PIP_BOUNDARY = 0xFFFFFFFEu;
+
+struct PolygonSet {
+  std::vector<Point2> points; // rings back to back, each closed implicitly (last -> first)
+  std::vector<uint32_t> ringStart; // ring r is points[ringStart[r], ringStart[r + 1]); rings + 1 entries
+  std::vector<uint32_t> ringZone; // per ring
+};
+
+inline uint32_t ringCount(const PolygonSet &s) { return s.ringStart.empty() ? 0 : (uint32_t) s.ringStart.size() - 1; }
+
+// One edge per ring side, indexing the set's points; Edge::pad0 = zone of the ring.
+LineMap pipEdges(const PolygonSet &polys);
+
+// ---- Exact edge test ----
+enum class PipEdge { None, Cross, Boundary };
+
+// How the +x ray from p meets edge ab. Exact for all float inputs: the orientation is
+// the sign of six float products (exact in double) summed as a floating-point expansion.
+PipEdge pipEdgeExact(Point2 p, Point2 a, Point2 b);
+
+// ---- CPU classifier ----
+// Edges binned into horizontal rows; a point tests every edge of its row. The reference
+// for the GPU path, and where it resolves the points its float test cannot decide.
+struct PipCpuIndex {
+  Bounds2 bounds{};
+  uint32_t rows{};
+  float rowsPerUnit{};
+  std::vector<uint32_t> rowStart; // rows + 1, into rowEdges
+  std::vector<uint32_t> rowEdges; // edges whose y range touches the row
+  std::vector<Point2> a, b; // edge endpoints
+  std::vector<uint32_t> zone; // per edge
+  double buildMs{};
+};
+
+// rows = 0: about sqrt(edge count).
+PipCpuIndex createPipCpuIndex(LineMapView edges, uint32_t rows = 0);
+
+// Zone id, PIP_OUTSIDE or PIP_BOUNDARY.
+uint32_t pipClassifyPoint(const PipCpuIndex &ix, Point2 p);
+
+// out[i] for points[i], split across the pool when given.
+void pipClassifyCpu(const PipCpuIndex &ix, const Point2 *points, uint64_t count, uint32_t *out,
+                    ThreadPool *pool = nullptr);
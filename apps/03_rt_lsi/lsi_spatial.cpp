@@ -0,0 +1,81 @@
+// lsi_spatial.cpp
+#include "lsi_spatial.h"
+
+#include <algorithm>
+#include <numeric>
+
+Bounds2 boundsOf(const std::vector<Point2> &pts) {
+  Bounds2 b{0, 0, 0, 0};
+  if (pts.empty()) return b;
+  b = {pts[0].x, pts[0].y, pts[0].x, pts[0].y};
+  for (const Point2 &p: pts) {
+    b.minX = std::min(b.minX, p.x);
+    b.minY = std::min(b.minY, p.y);
+    b.maxX = std::max(b.maxX, p.x);
+    b.maxY = std::max(b.maxY, p.y);
+  }
+  return b;
+}
+
+// Spreads the low 16 bits of v to the even bits.
+static uint32_t spreadBits(uint32_t v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+static uint32_t quantize(float v, float lo, float hi) {
+  float extent = hi - lo;
+  if (extent <= 0.f) return 0;
+  float t = (v - lo) / extent;
+  return (uint32_t) std::clamp(t * 65535.f, 0.f, 65535.f);
+}
+
+uint32_t morton2D(Point2 p, const Bounds2 &b) {
+  return spreadBits(quantize(p.x, b.minX, b.maxX)) | (spreadBits(quantize(p.y, b.minY, b.maxY)) << 1);
+}
+
+uint32_t hilbert2D(Point2 p, const Bounds2 &b) {
+  uint32_t x = quantize(p.x, b.minX, b.maxX);
+  uint32_t y = quantize(p.y, b.minY, b.maxY);
+  uint32_t d = 0;
+  for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant so the sub-curve starts/ends at the right corners
+    if (ry == 0) {
+      if (rx == 1) {
+        x = 0xFFFF - x;
+        y = 0xFFFF - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+std::vector<uint32_t> spaceCurveOrder(const std::vector<Point2> &centers, SpaceCurve curve) {
+  Bounds2 b = boundsOf(centers);
+  std::vector<uint32_t> codes(centers.size());
+  for (size_t i = 0; i < centers.size(); i++)
+    codes[i] = curve == SpaceCurve::Hilbert ? hilbert2D(centers[i], b) : morton2D(centers[i], b);
+
+  std::vector<uint32_t> order(centers.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t c) { return codes[a] < codes[c]; });
+  return order;
+}
+
+std::vector<Point2> edgeCenters(LineMapView map) {
+  std::vector<Point2> c(map.edgeCount);
+  for (size_t i = 0; i < map.edgeCount; i++) {
+    const Point2 &a = map.points[map.edges[i].p1_idx];
+    const Point2 &b = map.points[map.edges[i].p2_idx];
+    c[i] = {0.5f * (a.x + b.x), 0.5f * (a.y + b.y)};
+  }
+  return c;
+}
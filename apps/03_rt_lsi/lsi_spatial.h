@@ -0,0 +1,28 @@
+// lsi_spatial.h - space-filling-curve ordering of 2D items.
+#pragma once
+
+#include "lsi_types.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Bounds2 {
+  float minX, minY, maxX, maxY;
+};
+
+Bounds2 boundsOf(const std::vector<Point2> &pts);
+
+// 32-bit Morton code (16 bits per axis) of p quantized inside b.
+uint32_t morton2D(Point2 p, const Bounds2 &b);
+
+// 32-bit Hilbert index (16 bits per axis) of p quantized inside b. Unlike Morton,
+// consecutive indices are always neighbouring cells (no long jumps).
+uint32_t hilbert2D(Point2 p, const Bounds2 &b);
+
+enum class SpaceCurve { Morton, Hilbert };
+
+// Permutation that visits centers along the curve (stable for equal codes).
+std::vector<uint32_t> spaceCurveOrder(const std::vector<Point2> &centers, SpaceCurve curve);
+
+// Midpoint of every edge.
+std::vector<Point2> edgeCenters(LineMapView map);
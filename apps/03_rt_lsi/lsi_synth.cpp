@@ -0,0 +1,131 @@
+// lsi_synth.cpp
+#include "lsi_synth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+LineMap makeRoadGrid(uint32_t cells, uint32_t segmentsPerBlock, float jitter, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> noise(-jitter, jitter);
+
+  const uint32_t n = cells + 1; // intersections per axis
+  const float step = 2.f / (float) cells;
+  const uint32_t S = std::max(segmentsPerBlock, 1u);
+
+  LineMap m;
+  m.points.reserve((size_t) n * n * (1 + 2 * (S - 1)));
+  m.edges.reserve((size_t) 2 * cells * n * S);
+
+  // Jittered intersections
+  for (uint32_t y = 0; y < n; y++)
+    for (uint32_t x = 0; x < n; x++)
+      m.points.push_back({-1.f + x * step + noise(rng) * step, -1.f + y * step + noise(rng) * step});
+
+  // Street from intersection a to b as S edges with slightly wiggling interior vertices
+  auto street = [&](uint32_t a, uint32_t b) {
+    uint32_t prev = a;
+    for (uint32_t s = 1; s < S; s++) {
+      float t = (float) s / (float) S;
+      Point2 pa = m.points[a], pb = m.points[b];
+      m.points.push_back({
+        pa.x + t * (pb.x - pa.x) + 0.1f * noise(rng) * step,
+        pa.y + t * (pb.y - pa.y) + 0.1f * noise(rng) * step
+      });
+      uint32_t cur = (uint32_t) m.points.size() - 1;
+      m.edges.push_back({prev, cur, 0, 0});
+      prev = cur;
+    }
+    m.edges.push_back({prev, b, 0, 0});
+  };
+
+  for (uint32_t y = 0; y < n; y++)
+    for (uint32_t x = 0; x < n; x++) {
+      uint32_t i = y * n + x;
+      if (x + 1 < n) street(i, i + 1);
+      if (y + 1 < n) street(i, i + n);
+    }
+  return m;
+}
+
+LineMap makeRandomSegments(uint32_t count, float maxLen, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> pos(-1.f, 1.f);
+  std::uniform_real_distribution<float> len(0.f, maxLen);
+  std::uniform_real_distribution<float> ang(0.f, 6.2831853f);
+
+  LineMap m;
+  m.points.reserve((size_t) count * 2);
+  m.edges.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    Point2 a{pos(rng), pos(rng)};
+    float l = len(rng), phi = ang(rng);
+    Point2 b{a.x + l * std::cos(phi), a.y + l * std::sin(phi)};
+    m.points.push_back(a);
+    m.points.push_back(b);
+    m.edges.push_back({2 * i, 2 * i + 1, 0, 0});
+  }
+  return m;
+}
+
+PolygonSet makeZoneGrid(uint32_t cells, float jitter, uint32_t holeEvery, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> noise(-jitter, jitter);
+
+  const uint32_t n = cells + 1;
+  const float step = 2.f / (float) cells;
+  std::vector<Point2> grid;
+  grid.reserve((size_t) n * n);
+  for (uint32_t y = 0; y < n; y++)
+    for (uint32_t x = 0; x < n; x++) {
+      // The outline stays a square
+      const float jx = x == 0 || x == cells ? 0.f : noise(rng) * step;
+      const float jy = y == 0 || y == cells ? 0.f : noise(rng) * step;
+      grid.push_back({-1.f + x * step + jx, -1.f + y * step + jy});
+    }
+
+  PolygonSet s;
+  auto ring = [&](std::initializer_list<Point2> pts, uint32_t zone) {
+    s.ringStart.push_back((uint32_t) s.points.size());
+    s.ringZone.push_back(zone);
+    s.points.insert(s.points.end(), pts);
+  };
+  for (uint32_t y = 0; y < cells; y++)
+    for (uint32_t x = 0; x < cells; x++) {
+      const uint32_t zone = y * cells + x;
+      const Point2 p00 = grid[y * n + x], p10 = grid[y * n + x + 1];
+      const Point2 p11 = grid[(y + 1) * n + x + 1], p01 = grid[(y + 1) * n + x];
+      ring({p00, p10, p11, p01}, zone);
+      if (holeEvery && zone % holeEvery == 0) {
+        // Square around the quad's center, well inside it for jitter < 0.25
+        const float cx = 0.25f * (p00.x + p10.x + p11.x + p01.x);
+        const float cy = 0.25f * (p00.y + p10.y + p11.y + p01.y);
+        const float h = 0.15f * step;
+        ring({{cx - h, cy - h}, {cx - h, cy + h}, {cx + h, cy + h}, {cx + h, cy - h}}, zone);
+      }
+    }
+  s.ringStart.push_back((uint32_t) s.points.size());
+  return s;
+}
+
+std::vector<Point2> makePipQueries(const PolygonSet &zones, uint32_t count, float degenerate, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> pos(-1.1f, 1.1f);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  std::uniform_int_distribution<uint32_t> vertex(0, zones.points.empty() ? 0 : (uint32_t) zones.points.size() - 1);
+
+  std::vector<Point2> q(count);
+  for (Point2 &p: q) {
+    p = {pos(rng), pos(rng)};
+    if (zones.points.empty() || unit(rng) >= degenerate) continue;
+    const uint32_t v = vertex(rng);
+    const Point2 a = zones.points[v];
+    const Point2 b = zones.points[v + 1 < zones.points.size() ? v + 1 : v]; // ring neighbour, mostly
+    switch (rng() % 3) {
+      case 0: p = a; break;
+      case 1: p = {0.5f * (a.x + b.x), 0.5f * (a.y + b.y)}; break;
+      default: p.y = a.y; break;
+    }
+  }
+  return q;
+}
@@ -0,0 +1,25 @@
+// lsi_synth.h - synthetic inputs for LSI benchmarks.
+#pragma once
+
+#include "lsi_pip.h"
+#include "lsi_types.h"
+
+#include <cstdint>
+#include <vector>
+
+// Road-network-like base map in [-1,1]^2: a cells x cells grid of jittered streets,
+// every street block split into segmentsPerBlock short edges (polyline vertices).
+LineMap makeRoadGrid(uint32_t cells, uint32_t segmentsPerBlock, float jitter, uint32_t seed);
+
+// count random segments in [-1,1]^2 with length up to maxLen.
+LineMap makeRandomSegments(uint32_t count, float maxLen, uint32_t seed);
+
+// Zone partition of [-1,1]^2: a cells x cells grid of jittered quads, zone = cell index.
+// Neighbours share their edges exactly; every holeEvery-th zone (0 = none) has a square
+// hole that belongs to no zone. jitter = 0 keeps every edge axis-aligned (horizontal
+// edges, collinear vertices).
+PolygonSet makeZoneGrid(uint32_t cells, float jitter, uint32_t holeEvery, uint32_t seed);
+
+// count query points in [-1.1,1.1]^2; a fraction of them is degenerate: zone vertices,
+// edge midpoints, and random x at a vertex's y (rays through a vertex).
+std::vector<Point2> makePipQueries(const PolygonSet &zones, uint32_t count, float degenerate, uint32_t seed);
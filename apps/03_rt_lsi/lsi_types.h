@@ -0,0 +1,39 @@
+// lsi_types.h - data shared by the host side and rt_lsi.slang (layouts must match).
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct Point2 {
+  float x, y;
+};
+
+struct Edge {
+  uint32_t p1_idx, p2_idx, pad0, pad1;
+};
+
+struct HitRecord {
+  uint32_t queryEid;
+  uint32_t baseEid;
+  float hitx;
+  float hity;
+};
+
+// A set of segments: edges index into points.
+struct LineMap {
+  std::vector<Point2> points;
+  std::vector<Edge> edges;
+};
+
+// Non-owning view of a line map: a LineMap, or arrays of a memory-mapped file
+// (see lsi_mapfile.h). Consumers upload straight from these pointers.
+struct LineMapView {
+  const Point2 *points{};
+  uint64_t pointCount{};
+  const Edge *edges{};
+  uint64_t edgeCount{};
+
+  LineMapView() = default;
+  LineMapView(const LineMap &m)
+    : points(m.points.data()), pointCount(m.points.size()), edges(m.edges.data()), edgeCount(m.edges.size()) {}
+};
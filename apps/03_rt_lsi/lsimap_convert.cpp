@@ -0,0 +1,37 @@
+// lsimap_convert.cpp - text line map -> .lsimap (see lsi_mapfile.h).
+//
+// Usage: LsiMapConvert <in.txt> <out.lsimap> [--k=N]
+//   --k=N  also store the bucketed BLAS input for N edges per AABB, so loading the
+//          map as a base map needs no host-side sorting at all
+
+#include "lsi_bucket.h"
+#include "lsi_mapfile.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <in.txt> <out.lsimap> [--k=N]\n";
+    return 1;
+  }
+  uint32_t k = 0;
+  for (int i = 3; i < argc; i++)
+    if (std::strncmp(argv[i], "--k=", 4) == 0) k = (uint32_t) std::atoi(argv[i] + 4);
+
+  LineMap map = readLineMapText(argv[1]);
+  std::cout << argv[1] << ": " << map.points.size() << " points, " << map.edges.size() << " edges\n";
+
+  if (k) {
+    EdgeBuckets buckets = bucketEdges(map, k);
+    EdgeBucketsView view(buckets, k);
+    writeLineMap(argv[2], map, &view);
+    std::cout << "  + " << buckets.aabbs.size() << " AABBs (K=" << k << ")\n";
+  } else {
+    writeLineMap(argv[2], map, nullptr);
+  }
+  std::cout << "wrote " << argv[2] << "\n";
+  return 0;
+}
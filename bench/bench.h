@@ -0,0 +1,67 @@
+// bench.h - shared pieces of vkprimer_bench: options, repetition statistics, output.
+//
+// Every workload sweeps its parameters, runs each case warmup + reps times and reports
+// one record per (case, metric) with median / p99 / min / mean over the reps.
+#pragma once
+
+#include "vk_context.h"
+#include "vk_profiler.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchOptions {
+  uint32_t warmup = 2;
+  uint32_t reps = 10;
+  bool quick = false; // small sizes only (software ICDs, CI)
+  std::string only; // run workloads whose name contains this; empty = all
+};
+
+struct Summary {
+  uint32_t reps{};
+  double median{};
+  double p99{};
+  double min{};
+  double mean{};
+};
+
+// Nearest-rank percentiles.
+Summary summarize(std::vector<double> samples);
+
+using BenchParams = std::vector<std::pair<const char *, double>>;
+
+// ---- Report ----
+// JSON Lines (one object per line) or CSV (params folded into one "k=v;k=v" column).
+// Both are stable across runs so two reports can be diffed line by line.
+enum class ReportFormat { JsonLines, Csv };
+
+struct BenchReport {
+  std::ostream *os{};
+  ReportFormat format{};
+};
+
+void reportHeader(BenchReport &r, const VkCaps &caps, const BenchOptions &opts);
+void reportResult(BenchReport &r, const char *workload, const BenchParams &params,
+                  const char *metric, const char *unit, const Summary &s);
+void reportSkip(BenchReport &r, const char *workload, const char *reason);
+
+// ---- Timing ----
+struct WallTimer {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  double ms() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); }
+};
+
+// ---- Workloads ----
+// Each one checks the caps it needs and reports a skip otherwise.
+void benchVecAdd(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchRtTriangles(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsi(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsiBackend(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsiOutput(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsiRefit(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsiTiles(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
+void benchLsiPip(VkContext &ctx, const BenchOptions &opts, BenchReport &r);
@@ -0,0 +1,119 @@
+// bench_lsi.cpp - LSI engine (apps/03_rt_lsi): scene build, two-pass queries and
+// occlusion (any-hit) queries.
+//
+// Base maps are road grids (edge count ~ cells^2), queries random segments; the query
+// length sets the intersection density (hits per query edge). Two-pass queries are
+// also traced with every input in HOST_VISIBLE memory (LsiEngine::hostInputs) to show
+// what the DEVICE_LOCAL upload buys (trace_host_inputs_gpu_ms). Point in polygon is the
+// lsi_pip workload.
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include <vector>
+
+void benchLsi(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  if (!ctx.caps.rayTracingPipeline) {
+    reportSkip(r, "lsi", "no ray tracing pipeline support");
+    return;
+  }
+  const std::vector<uint32_t> cellCounts = opts.quick
+                                             ? std::vector<uint32_t>{32}
+                                             : std::vector<uint32_t>{64, 256};
+  const std::vector<uint32_t> queryCounts = opts.quick
+                                              ? std::vector<uint32_t>{1u << 14}
+                                              : std::vector<uint32_t>{1u << 16, 1u << 20};
+  const std::vector<float> queryLens = opts.quick
+                                         ? std::vector<float>{0.02f, 0.1f}
+                                         : std::vector<float>{0.005f, 0.02f, 0.08f};
+
+  LsiEngine engine{};
+  initLsiEngine(ctx, engine);
+  LsiEngine hostEngine{};
+  initLsiEngine(ctx, hostEngine);
+  hostEngine.hostInputs = true;
+
+  for (uint32_t cells: cellCounts) {
+    LineMap base = lsiBenchBase(cells);
+    const double baseEdges = (double) base.edges.size();
+
+    // ---- Build: the last scene is kept for the queries ----
+    LsiScene scene{};
+    std::vector<double> buildMs, buildWallMs;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      destroyLsiScene(ctx, scene);
+      WallTimer t;
+      scene = createLsiScene(ctx, engine, base);
+      const double wall = t.ms();
+      profilerClear(engine.prof);
+      if (rep < opts.warmup) continue;
+      buildMs.push_back(scene.buildMs);
+      buildWallMs.push_back(wall);
+    }
+    const BenchParams buildParams = {{"base_edges", baseEdges}};
+    if (engine.prof.timestamps) reportResult(r, "lsi", buildParams, "build_gpu_ms", "ms", summarize(buildMs));
+    reportResult(r, "lsi", buildParams, "build_wall_ms", "ms", summarize(buildWallMs));
+    LsiScene hostScene = createLsiScene(ctx, hostEngine, base);
+
+    // ---- Queries ----
+    for (uint32_t q: queryCounts) {
+      for (float qlen: queryLens) {
+        LineMap query = lsiBenchQueries(q, qlen);
+
+        std::vector<double> traceMs, wallMs;
+        uint64_t hits = 0;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          LsiQueryStats st{};
+          WallTimer t;
+          lsiIntersect(ctx, engine, scene, query, {}, &st);
+          const double wall = t.ms();
+          profilerClear(engine.prof);
+          hits = st.hitCount;
+          if (rep < opts.warmup) continue;
+          traceMs.push_back(st.traceMs);
+          wallMs.push_back(wall);
+        }
+
+        // Same queries, inputs left in host memory
+        std::vector<double> hostTraceMs;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          LsiQueryStats st{};
+          lsiIntersect(ctx, hostEngine, hostScene, query, {}, &st);
+          profilerClear(hostEngine.prof);
+          if (rep < opts.warmup) continue;
+          hostTraceMs.push_back(st.traceMs);
+        }
+
+        // Same queries, first hit only, one bit per query edge
+        std::vector<double> anyMs, anyWallMs;
+        uint64_t hitQueries = 0;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          LsiQueryStats st{};
+          WallTimer t;
+          lsiOcclusion(ctx, engine, scene, query, LsiQueryOrder::Input, &st);
+          const double wall = t.ms();
+          profilerClear(engine.prof);
+          hitQueries = st.hitCount;
+          if (rep < opts.warmup) continue;
+          anyMs.push_back(st.traceMs);
+          anyWallMs.push_back(wall);
+        }
+
+        const BenchParams params = {{"base_edges", baseEdges}, {"queries", q}, {"qlen", qlen}};
+        if (engine.prof.timestamps) reportResult(r, "lsi", params, "trace_gpu_ms", "ms", summarize(traceMs));
+        reportResult(r, "lsi", params, "query_wall_ms", "ms", summarize(wallMs));
+        reportResult(r, "lsi", params, "hits", "count", summarize({(double) hits}));
+        if (hostEngine.prof.timestamps)
+          reportResult(r, "lsi", params, "trace_host_inputs_gpu_ms", "ms", summarize(hostTraceMs));
+        if (engine.prof.timestamps) reportResult(r, "lsi", params, "any_trace_gpu_ms", "ms", summarize(anyMs));
+        reportResult(r, "lsi", params, "any_query_wall_ms", "ms", summarize(anyWallMs));
+        reportResult(r, "lsi", params, "hit_queries", "count", summarize({(double) hitQueries}));
+      }
+    }
+
+    destroyLsiScene(ctx, scene);
+    destroyLsiScene(ctx, hostScene);
+  }
+
+  destroyLsiEngine(ctx, hostEngine);
+  destroyLsiEngine(ctx, engine);
+}
@@ -0,0 +1,15 @@
+// bench_lsi.h - fixtures shared by the LSI workloads of vkprimer_bench.
+//
+// Base maps are road grids (edge count ~ cells^2 * LSI_BENCH_SEGMENTS), queries random
+// segments whose length sets the hit density. The same seeds everywhere, so two
+// workloads at the same size trace the same scene.
+#pragma once
+
+#include "lsi_engine.h"
+#include "lsi_synth.h"
+
+constexpr uint32_t LSI_BENCH_SEGMENTS = 8; // edges per street block
+constexpr uint32_t LSI_BENCH_K = 4; // base edges per AABB, where a workload does not sweep it
+
+inline LineMap lsiBenchBase(uint32_t cells) { return makeRoadGrid(cells, LSI_BENCH_SEGMENTS, 0.2f, 1); }
+inline LineMap lsiBenchQueries(uint32_t count, float qlen) { return makeRandomSegments(count, qlen, 2); }
@@ -0,0 +1,62 @@
+// bench_lsi_backend.cpp - RT pipeline vs ray query (compute) traversal of the same scene.
+//
+// One BLAS/TLAS build shared by the engines of every supported backend; each backend
+// traces the same queries with the two-pass and the append output. Params backend and
+// output are LsiBackend (0 RT pipeline, 1 ray query) and LsiOutput (0 two-pass,
+// 1 append). Hit counts must match between backends.
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include <vector>
+
+void benchLsiBackend(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  std::vector<LsiBackend> backends;
+  for (LsiBackend b: {LsiBackend::RtPipeline, LsiBackend::RayQuery})
+    if (lsiBackendSupported(ctx.caps, b)) backends.push_back(b);
+  if (backends.empty()) {
+    reportSkip(r, "lsi_backend", "no ray tracing pipeline or ray query support");
+    return;
+  }
+  const uint32_t cells = opts.quick ? 32 : 256;
+  const uint32_t queries = opts.quick ? 1u << 14 : 1u << 20;
+  const float qlen = 0.05f;
+
+  const LineMap base = lsiBenchBase(cells);
+  const LineMap query = lsiBenchQueries(queries, qlen);
+
+  // The scene only depends on the base map, so the first engine builds it for all.
+  std::vector<LsiEngine> engines(backends.size());
+  for (size_t i = 0; i < backends.size(); i++) initLsiEngine(ctx, engines[i], backends[i]);
+  LsiScene scene = createLsiScene(ctx, engines[0], base, LSI_BENCH_K);
+  profilerClear(engines[0].prof);
+
+  for (LsiOutput output: {LsiOutput::TwoPass, LsiOutput::Append}) {
+    LsiQueryOptions qo{};
+    qo.output = output;
+    for (size_t i = 0; i < backends.size(); i++) {
+      LsiEngine &engine = engines[i];
+      std::vector<double> traceMs, wallMs;
+      uint64_t hits = 0;
+      for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+        LsiQueryStats st{};
+        WallTimer t;
+        lsiIntersect(ctx, engine, scene, query, qo, &st);
+        const double wall = t.ms();
+        profilerClear(engine.prof);
+        hits = st.hitCount;
+        if (rep < opts.warmup) continue;
+        traceMs.push_back(st.traceMs);
+        wallMs.push_back(wall);
+      }
+
+      const BenchParams params = {{"base_edges", (double) base.edges.size()}, {"queries", queries}, {"qlen", qlen},
+                                  {"backend", (double) backends[i]}, {"output", (double) output}};
+      if (engine.prof.timestamps) reportResult(r, "lsi_backend", params, "trace_gpu_ms", "ms", summarize(traceMs));
+      reportResult(r, "lsi_backend", params, "query_wall_ms", "ms", summarize(wallMs));
+      reportResult(r, "lsi_backend", params, "hits", "count", summarize({(double) hits}));
+    }
+  }
+
+  destroyLsiScene(ctx, scene);
+  for (LsiEngine &e: engines) destroyLsiEngine(ctx, e);
+}
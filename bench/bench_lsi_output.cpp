@@ -0,0 +1,71 @@
+// bench_lsi_output.cpp - LSI output mode throughput against hit density.
+//
+// Longer query segments cross more base edges, so sweeping qlen sweeps the number of
+// hits per ray and with it the pressure on the global output counter. Every output mode
+// traces the same queries: two-pass, append (one atomic per hit), append-ray (one per
+// HIT_BATCH hits) and append-subgroup where the trace stage has subgroup arithmetic.
+// Append runs start with room for every hit (the two-pass count), so each is a single
+// trace without re-trace rounds. Params backend and output are LsiBackend and LsiOutput
+// (0 two-pass, 1 append, 2 append-ray, 3 append-subgroup); hit counts must not depend
+// on the output.
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include <algorithm>
+#include <vector>
+
+void benchLsiOutput(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  const LsiBackend backend = ctx.caps.rayTracingPipeline ? LsiBackend::RtPipeline : LsiBackend::RayQuery;
+  if (!lsiBackendSupported(ctx.caps, backend)) {
+    reportSkip(r, "lsi_output", "no ray tracing pipeline or ray query support");
+    return;
+  }
+  const uint32_t cells = opts.quick ? 32 : 256;
+  const uint32_t queries = opts.quick ? 1u << 14 : 1u << 20;
+  const std::vector<float> queryLens = opts.quick
+                                         ? std::vector<float>{0.02f, 0.1f}
+                                         : std::vector<float>{0.005f, 0.01f, 0.02f, 0.05f, 0.1f, 0.2f};
+
+  std::vector<LsiOutput> outputs = {LsiOutput::TwoPass, LsiOutput::Append, LsiOutput::AppendPerRay};
+  if (lsiSubgroupAppendSupported(ctx.caps, backend)) outputs.push_back(LsiOutput::AppendSubgroup);
+
+  LsiEngine engine{};
+  initLsiEngine(ctx, engine, backend);
+  const LineMap base = lsiBenchBase(cells);
+  LsiScene scene = createLsiScene(ctx, engine, base, LSI_BENCH_K);
+  profilerClear(engine.prof);
+
+  for (float qlen: queryLens) {
+    const LineMap query = lsiBenchQueries(queries, qlen);
+    for (LsiOutput output: outputs) {
+      LsiQueryOptions qo{};
+      qo.output = output;
+      std::vector<double> traceMs;
+      uint64_t hits = 0;
+      for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+        LsiQueryStats st{};
+        lsiIntersect(ctx, engine, scene, query, qo, &st);
+        profilerClear(engine.prof);
+        hits = st.hitCount;
+        if (rep < opts.warmup) continue;
+        traceMs.push_back(st.traceMs);
+      }
+      // Two-pass runs first: its count sizes the append buffer for the other modes.
+      if (output == LsiOutput::TwoPass) engine.initialOutHits = (uint32_t) std::max<uint64_t>(hits, 1);
+
+      const BenchParams params = {{"base_edges", (double) base.edges.size()}, {"queries", queries}, {"qlen", qlen},
+                                  {"backend", (double) backend}, {"output", (double) output}};
+      if (engine.prof.timestamps) {
+        reportResult(r, "lsi_output", params, "trace_gpu_ms", "ms", summarize(traceMs));
+        std::vector<double> mhits;
+        for (double ms: traceMs) mhits.push_back(ms > 0 ? hits / (ms * 1e3) : 0.0);
+        reportResult(r, "lsi_output", params, "mhits_per_s", "Mhits/s", summarize(mhits));
+      }
+      reportResult(r, "lsi_output", params, "hits", "count", summarize({(double) hits}));
+      reportResult(r, "lsi_output", params, "hits_per_ray", "hits", summarize({(double) hits / queries}));
+    }
+  }
+
+  destroyLsiScene(ctx, scene);
+  destroyLsiEngine(ctx, engine);
+}
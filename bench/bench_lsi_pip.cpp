@@ -0,0 +1,93 @@
+// bench_lsi_pip.cpp - point in polygon: GPU crossing parity vs the exact CPU row index.
+//
+// Zones are a jittered grid of quads with holes (shared edges between neighbours), the
+// query points random with 1% degenerate ones (vertices, edge midpoints, rays through
+// vertices). Reports the CPU classification on all threads (backend-independent, no
+// backend param), and per supported backend (param backend = LsiBackend) the GPU trace
+// time, the wall time including the host resolve of the points the GPU left unsure,
+// the number of those, and the results that differ from the CPU (must be 0).
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include "lsi_pip.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+void benchLsiPip(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  std::vector<LsiBackend> backends;
+  for (LsiBackend b: {LsiBackend::RtPipeline, LsiBackend::RayQuery})
+    if (lsiBackendSupported(ctx.caps, b)) backends.push_back(b);
+  if (backends.empty()) {
+    reportSkip(r, "lsi_pip", "no ray tracing pipeline or ray query support");
+    return;
+  }
+  const std::vector<uint32_t> cellCounts = opts.quick
+                                             ? std::vector<uint32_t>{32}
+                                             : std::vector<uint32_t>{64, 256};
+  const std::vector<uint32_t> pointCounts = opts.quick
+                                              ? std::vector<uint32_t>{1u << 14}
+                                              : std::vector<uint32_t>{1u << 16, 1u << 20};
+
+  ThreadPool pool;
+  initThreadPool(pool);
+  std::vector<LsiEngine> engines(backends.size());
+  for (size_t i = 0; i < backends.size(); i++) initLsiEngine(ctx, engines[i], backends[i]);
+
+  for (uint32_t cells: cellCounts) {
+    const PolygonSet zones = makeZoneGrid(cells, 0.2f, 7, 1);
+    const PipCpuIndex cpuIndex = createPipCpuIndex(pipEdges(zones));
+    std::vector<PipScene> scenes(backends.size());
+    for (size_t i = 0; i < backends.size(); i++) scenes[i] = createPipScene(ctx, engines[i], zones);
+
+    for (uint32_t q: pointCounts) {
+      const std::vector<Point2> points = makePipQueries(zones, q, 0.01f, 2);
+      const BenchParams cpuParams = {{"zone_edges", (double) zones.points.size()}, {"points", q}};
+
+      // ---- CPU reference ----
+      std::vector<uint32_t> expected(points.size());
+      std::vector<double> cpuMs;
+      for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+        WallTimer t;
+        pipClassifyCpu(cpuIndex, points.data(), points.size(), expected.data(), &pool);
+        const double wall = t.ms();
+        if (rep < opts.warmup) continue;
+        cpuMs.push_back(wall);
+      }
+      reportResult(r, "lsi_pip", cpuParams, "cpu_classify_ms", "ms", summarize(cpuMs));
+
+      // ---- GPU ----
+      for (size_t i = 0; i < backends.size(); i++) {
+        LsiEngine &engine = engines[i];
+        std::vector<double> traceMs, wallMs;
+        uint64_t resolved = 0, mismatch = 0;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          PipQueryStats st{};
+          WallTimer t;
+          const std::vector<uint32_t> result = lsiPointInPolygon(ctx, engine, scenes[i], points.data(),
+                                                                 points.size(), LsiQueryOrder::Morton, &st);
+          const double wall = t.ms();
+          profilerClear(engine.prof);
+          resolved = st.resolved;
+          mismatch = 0;
+          for (size_t p = 0; p < points.size(); p++) mismatch += result[p] != expected[p];
+          if (rep < opts.warmup) continue;
+          traceMs.push_back(st.traceMs);
+          wallMs.push_back(wall);
+        }
+
+        BenchParams params = cpuParams;
+        params.push_back({"backend", (double) backends[i]});
+        if (engine.prof.timestamps) reportResult(r, "lsi_pip", params, "trace_gpu_ms", "ms", summarize(traceMs));
+        reportResult(r, "lsi_pip", params, "query_wall_ms", "ms", summarize(wallMs));
+        reportResult(r, "lsi_pip", params, "resolved", "count", summarize({(double) resolved}));
+        reportResult(r, "lsi_pip", params, "mismatch", "count", summarize({(double) mismatch}));
+      }
+    }
+
+    for (size_t i = 0; i < backends.size(); i++) destroyPipScene(ctx, scenes[i]);
+  }
+
+  for (LsiEngine &e: engines) destroyLsiEngine(ctx, e);
+  destroyThreadPool(pool);
+}
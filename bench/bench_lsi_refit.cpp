@@ -0,0 +1,103 @@
+// bench_lsi_refit.cpp - refit vs rebuild of an edited LSI base map.
+//
+// Every step moves a random subset of base points by a small random offset (a random
+// walk, so the drift accumulates), applies it with updateLsiScene and traces the same
+// query batch. One rep runs the whole step sequence on a fresh scene, once per policy:
+// param policy 0 = refit only, 1 = rebuild only, 2 = the default RefitPolicy. Reports
+// the BLAS update and trace time summed over the steps, the trace time of the last step
+// (which grows as refits age the BVH) and the tracker's quality loss there. Hit counts
+// must match between policies at every step (hit_mismatch_steps = 0).
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+void benchLsiRefit(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  if (!ctx.caps.rayTracingPipeline) {
+    reportSkip(r, "lsi_refit", "no ray tracing pipeline support");
+    return;
+  }
+  const uint32_t cells = opts.quick ? 32 : 256;
+  const uint32_t queries = opts.quick ? 1u << 14 : 1u << 18;
+  const uint32_t steps = opts.quick ? 5 : 20;
+  const float movedFraction = 0.01f;
+  const float amp = 0.01f;
+
+  const LineMap base0 = lsiBenchBase(cells);
+  const LineMap query = lsiBenchQueries(queries, 0.05f);
+  const uint32_t movedPerStep = std::max(1u, (uint32_t) (movedFraction * base0.points.size()));
+
+  RefitPolicy refitOnly{};
+  refitOnly.maxQualityLoss = 1e30;
+  refitOnly.maxRefits = UINT32_MAX;
+  refitOnly.maxChangedFraction = 1.0;
+  RefitPolicy rebuildOnly{};
+  rebuildOnly.maxRefits = 0;
+  const RefitPolicy policies[] = {refitOnly, rebuildOnly, RefitPolicy{}};
+
+  std::vector<uint64_t> refHits(steps + 1, UINT64_MAX);
+  for (uint32_t p = 0; p < 3; p++) {
+    LsiEngine engine{};
+    initLsiEngine(ctx, engine);
+    engine.updatableBlas = true;
+    engine.refitPolicy = policies[p];
+
+    std::vector<double> blasMs, traceMs, lastTraceMs, lastLoss;
+    uint32_t rebuilds = 0, mismatches = 0;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      LineMap base = base0;
+      LsiScene scene = createLsiScene(ctx, engine, base, LSI_BENCH_K);
+      profilerClear(engine.prof);
+      std::mt19937 rng(7); // same edits for every policy and rep
+      std::uniform_int_distribution<uint32_t> pick(0, (uint32_t) base.points.size() - 1);
+      std::uniform_real_distribution<float> offset(-amp, amp);
+
+      double blas = 0, trace = 0, lastTrace = 0, loss = 0;
+      rebuilds = mismatches = 0;
+      std::vector<uint32_t> moved(movedPerStep);
+      for (uint32_t step = 0; step <= steps; step++) {
+        if (step > 0) {
+          for (uint32_t &m: moved) {
+            m = pick(rng);
+            base.points[m].x += offset(rng);
+            base.points[m].y += offset(rng);
+          }
+          LsiUpdateStats us{};
+          updateLsiScene(ctx, engine, scene, base, moved.data(), moved.size(), &us);
+          blas += us.blasMs;
+          loss = us.qualityLoss;
+          rebuilds += us.rebuilt;
+        }
+
+        LsiQueryStats st{};
+        lsiIntersect(ctx, engine, scene, query, {}, &st);
+        profilerClear(engine.prof);
+        trace += st.traceMs;
+        lastTrace = st.traceMs;
+
+        if (refHits[step] == UINT64_MAX) refHits[step] = st.hitCount;
+        else mismatches += st.hitCount != refHits[step];
+      }
+      destroyLsiScene(ctx, scene);
+      if (rep < opts.warmup) continue;
+      blasMs.push_back(blas);
+      traceMs.push_back(trace);
+      lastTraceMs.push_back(lastTrace);
+      lastLoss.push_back(loss);
+    }
+
+    const BenchParams params = {{"base_edges", (double) base0.edges.size()}, {"queries", queries},
+                                {"steps", steps}, {"moved", movedPerStep}, {"policy", p}};
+    if (engine.prof.timestamps) {
+      reportResult(r, "lsi_refit", params, "update_gpu_ms", "ms", summarize(blasMs));
+      reportResult(r, "lsi_refit", params, "trace_gpu_ms", "ms", summarize(traceMs));
+      reportResult(r, "lsi_refit", params, "last_trace_gpu_ms", "ms", summarize(lastTraceMs));
+    }
+    reportResult(r, "lsi_refit", params, "last_quality_loss", "ratio", summarize(lastLoss));
+    reportResult(r, "lsi_refit", params, "rebuilds", "count", summarize({(double) rebuilds}));
+    reportResult(r, "lsi_refit", params, "hit_mismatch_steps", "count", summarize({(double) mismatches}));
+    destroyLsiEngine(ctx, engine);
+  }
+}
@@ -0,0 +1,90 @@
+// bench_lsi_tiles.cpp - one BLAS vs spatially tiled BLASes for a large LSI base map.
+//
+// For every tile size (param tile_edges, max base edges per tile, 0 = untiled): tile
+// count, BLAS size, host bucketing + upload + build wall time, GPU build time, trace time
+// of the same query batch, and the cost of a local edit: the points in a small square of
+// the map move a little and the touched tiles are rebuilt (rebuild-only policy, so
+// untiled means a full rebuild). Every rep builds the scene from scratch. Hit counts
+// must not depend on the tiling.
+#include "bench.h"
+#include "bench_lsi.h"
+
+#include <vector>
+
+void benchLsiTiles(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  if (!ctx.caps.rayTracingPipeline) {
+    reportSkip(r, "lsi_tiles", "no ray tracing pipeline support");
+    return;
+  }
+  const uint32_t cells = opts.quick ? 32 : 256;
+  const uint32_t queries = opts.quick ? 1u << 14 : 1u << 18;
+  const std::vector<uint32_t> tileSizes = opts.quick
+                                            ? std::vector<uint32_t>{0, 1u << 12}
+                                            : std::vector<uint32_t>{0, 1u << 18, 1u << 16, 1u << 14};
+  const float editSize = 0.05f; // side of the edited square, map is [-1,1]^2
+
+  const LineMap base0 = lsiBenchBase(cells);
+  const LineMap query = lsiBenchQueries(queries, 0.05f);
+
+  // Local edit: every point in a small square near the center moves by 1% of its side
+  std::vector<uint32_t> moved;
+  for (uint32_t p = 0; p < base0.points.size(); p++)
+    if (base0.points[p].x >= 0 && base0.points[p].x < editSize && base0.points[p].y >= 0 &&
+        base0.points[p].y < editSize)
+      moved.push_back(p);
+
+  for (uint32_t tileEdges: tileSizes) {
+    LsiEngine engine{};
+    initLsiEngine(ctx, engine);
+    engine.maxTileEdges = tileEdges;
+    engine.updatableBlas = true;
+    engine.refitPolicy.maxRefits = 0; // edits always rebuild the touched tiles
+
+    std::vector<double> createMs, buildMs, traceMs, editMs;
+    double tiles = 0, blasBytes = 0, editTiles = 0;
+    uint64_t hits = 0;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      LineMap base = base0;
+      WallTimer t;
+      LsiScene scene = createLsiScene(ctx, engine, base, LSI_BENCH_K);
+      const double create = t.ms();
+
+      LsiQueryStats st{};
+      lsiIntersect(ctx, engine, scene, query, {}, &st);
+
+      for (uint32_t p: moved) {
+        base.points[p].x += 0.01f * editSize;
+        base.points[p].y += 0.01f * editSize;
+      }
+      LsiUpdateStats us{};
+      updateLsiScene(ctx, engine, scene, base, moved.data(), moved.size(), &us);
+      profilerClear(engine.prof);
+
+      tiles = (double) scene.tiles.size();
+      blasBytes = (double) lsiSceneBlasBytes(scene);
+      editTiles = us.rebuiltTiles;
+      hits = st.hitCount;
+      const double build = scene.buildMs;
+      destroyLsiScene(ctx, scene);
+      if (rep < opts.warmup) continue;
+      createMs.push_back(create);
+      buildMs.push_back(build);
+      traceMs.push_back(st.traceMs);
+      editMs.push_back(us.blasMs + us.tlasMs);
+    }
+
+    const BenchParams params = {{"base_edges", (double) base0.edges.size()}, {"queries", queries},
+                                {"tile_edges", tileEdges}, {"edited_points", (double) moved.size()}};
+    reportResult(r, "lsi_tiles", params, "tiles", "count", summarize({tiles}));
+    reportResult(r, "lsi_tiles", params, "blas_bytes", "B", summarize({blasBytes}));
+    reportResult(r, "lsi_tiles", params, "create_wall_ms", "ms", summarize(createMs));
+    if (engine.prof.timestamps) {
+      reportResult(r, "lsi_tiles", params, "build_gpu_ms", "ms", summarize(buildMs));
+      reportResult(r, "lsi_tiles", params, "trace_gpu_ms", "ms", summarize(traceMs));
+      reportResult(r, "lsi_tiles", params, "edit_gpu_ms", "ms", summarize(editMs));
+    }
+    reportResult(r, "lsi_tiles", params, "edit_tiles", "count", summarize({editTiles}));
+    reportResult(r, "lsi_tiles", params, "hits", "count", summarize({(double) hits}));
+    destroyLsiEngine(ctx, engine);
+  }
+}
@@ -0,0 +1,83 @@
+// bench_main.cpp - vkprimer_bench: parameter sweeps over all three samples.
+//
+// Usage: vkprimer_bench [--warmup=N] [--reps=N] [--quick] [--only=NAME]
+//                       [--format=jsonl|csv] [--out=FILE]
+//   --warmup/--reps  untimed and timed runs per case (default 2 / 10)
+//   --quick          small sizes only
+//   --only=NAME      workloads whose name contains NAME (vec_add, rt_triangles, lsi,
+//                    lsi_backend, lsi_output, lsi_refit, lsi_tiles, lsi_pip; "lsi"
+//                    selects every LSI workload)
+//   --format         JSON Lines (default) or CSV
+//   --out=FILE       report file; stdout otherwise (device caps then go to stdout too)
+//
+// Software ICD (no GPU): point the loader at lavapipe, e.g.
+//   VK_DRIVER_FILES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json vkprimer_bench --quick
+// (VK_ICD_FILENAMES on older loaders). Workloads the device cannot run - ray tracing on
+// most software ICDs - are reported as skipped; timestamps fall back to wall time only.
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv) {
+  BenchOptions opts{};
+  ReportFormat format = ReportFormat::JsonLines;
+  const char *outFile = nullptr;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (std::strncmp(a, "--warmup=", 9) == 0) opts.warmup = (uint32_t) std::atoi(a + 9);
+    else if (std::strncmp(a, "--reps=", 7) == 0) opts.reps = (uint32_t) std::max(std::atoi(a + 7), 1);
+    else if (std::strcmp(a, "--quick") == 0) opts.quick = true;
+    else if (std::strncmp(a, "--only=", 7) == 0) opts.only = a + 7;
+    else if (std::strncmp(a, "--out=", 6) == 0) outFile = a + 6;
+    else if (std::strcmp(a, "--format=csv") == 0) format = ReportFormat::Csv;
+    else if (std::strcmp(a, "--format=jsonl") == 0) format = ReportFormat::JsonLines;
+    else {
+      std::cerr << "unknown argument " << a << "\n";
+      return 1;
+    }
+  }
+
+  std::ofstream file;
+  if (outFile) {
+    file.open(outFile);
+    if (!file) {
+      std::cerr << "Cannot open " << outFile << "\n";
+      return 1;
+    }
+  }
+  BenchReport report{outFile ? (std::ostream *) &file : &std::cout, format};
+
+  VkContext &ctx = getContext();
+  if (outFile) printCaps(ctx.caps);
+  reportHeader(report, ctx.caps, opts);
+
+  struct Workload {
+    const char *name;
+    void (*run)(VkContext &, const BenchOptions &, BenchReport &);
+  };
+  const Workload workloads[] = {
+    {"vec_add", benchVecAdd},
+    {"rt_triangles", benchRtTriangles},
+    {"lsi", benchLsi},
+    {"lsi_backend", benchLsiBackend},
+    {"lsi_output", benchLsiOutput},
+    {"lsi_refit", benchLsiRefit},
+    {"lsi_tiles", benchLsiTiles},
+    {"lsi_pip", benchLsiPip},
+  };
+  for (const Workload &w: workloads) {
+    if (!opts.only.empty() && std::string(w.name).find(opts.only) == std::string::npos) continue;
+    if (outFile) std::cout << "running " << w.name << "...\n";
+    w.run(ctx, opts, report);
+  }
+
+  if (outFile) printPipelineCacheStats(ctx.pipelineCache);
+  releaseContext();
+  return 0;
+}
@@ -0,0 +1,87 @@
+// bench_report.cpp
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <ostream>
+
+Summary summarize(std::vector<double> samples) {
+  Summary s{};
+  s.reps = (uint32_t) samples.size();
+  if (samples.empty()) return s;
+
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&](double p) {
+    size_t k = (size_t) std::ceil(p * (double) samples.size());
+    return samples[std::clamp<size_t>(k, 1, samples.size()) - 1];
+  };
+  s.median = rank(0.5);
+  s.p99 = rank(0.99);
+  s.min = samples.front();
+  for (double v: samples) s.mean += v;
+  s.mean /= (double) samples.size();
+  return s;
+}
+
+static std::string jsonEscape(const char *s) {
+  std::string out;
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') out += '\\';
+    out += *s;
+  }
+  return out;
+}
+
+// Integral values (sizes, hit counts) print exactly, the rest with the stream precision.
+struct Num {
+  double v;
+};
+
+static std::ostream &operator<<(std::ostream &os, Num n) {
+  if (n.v == std::floor(n.v) && std::fabs(n.v) < 1e15) return os << (long long) n.v;
+  return os << n.v;
+}
+
+void reportHeader(BenchReport &r, const VkCaps &caps, const BenchOptions &opts) {
+  std::ostream &os = *r.os;
+  os << std::setprecision(6);
+  if (r.format == ReportFormat::Csv) {
+    os << "# device=" << caps.deviceName << " driver=" << caps.driverVersion
+        << " warmup=" << opts.warmup << " reps=" << opts.reps << (opts.quick ? " quick" : "") << "\n";
+    os << "workload,params,metric,unit,reps,median,p99,min,mean\n";
+    return;
+  }
+  os << "{\"type\":\"run\",\"time\":" << (long long) std::time(nullptr)
+      << ",\"device\":\"" << jsonEscape(caps.deviceName) << "\""
+      << ",\"deviceType\":" << (int) caps.deviceType
+      << ",\"apiVersion\":\"" << VK_API_VERSION_MAJOR(caps.apiVersion) << "." << VK_API_VERSION_MINOR(caps.apiVersion)
+      << "." << VK_API_VERSION_PATCH(caps.apiVersion) << "\""
+      << ",\"driverVersion\":" << caps.driverVersion
+      << ",\"warmup\":" << opts.warmup << ",\"reps\":" << opts.reps
+      << ",\"quick\":" << (opts.quick ? "true" : "false") << "}\n";
+}
+
+void reportResult(BenchReport &r, const char *workload, const BenchParams &params,
+                  const char *metric, const char *unit, const Summary &s) {
+  std::ostream &os = *r.os;
+  if (r.format == ReportFormat::Csv) {
+    os << workload << ',';
+    for (size_t i = 0; i < params.size(); i++) os << (i ? ";" : "") << params[i].first << '=' << Num{params[i].second};
+    os << ',' << metric << ',' << unit << ',' << s.reps << ','
+        << Num{s.median} << ',' << Num{s.p99} << ',' << Num{s.min} << ',' << Num{s.mean} << "\n";
+    return;
+  }
+  os << "{\"type\":\"result\",\"workload\":\"" << workload << "\",\"params\":{";
+  for (size_t i = 0; i < params.size(); i++) os << (i ? "," : "") << '"' << params[i].first << "\":" << Num{params[i].second};
+  os << "},\"metric\":\"" << metric << "\",\"unit\":\"" << unit << "\",\"reps\":" << s.reps
+      << ",\"median\":" << Num{s.median} << ",\"p99\":" << Num{s.p99} << ",\"min\":" << Num{s.min} << ",\"mean\":" << Num{s.mean} << "}\n";
+  os.flush();
+}
+
+void reportSkip(BenchReport &r, const char *workload, const char *reason) {
+  std::ostream &os = *r.os;
+  if (r.format == ReportFormat::Csv) os << "# skipped " << workload << ": " << reason << "\n";
+  else os << "{\"type\":\"skip\",\"workload\":\"" << workload << "\",\"reason\":\"" << jsonEscape(reason) << "\"}\n";
+}
@@ -0,0 +1,458 @@
+// bench_rt_triangles.cpp - BLAS/TLAS build and trace over triangle soups.
+//
+// T random triangles in [0,1]^2 x [0,1], sized so a ray crosses SOUP_DEPTH of them on
+// average whatever T is; rays on a square grid along -Z (shader/bench_rt.slang). Every
+// grid is traced in three modes: counting all hits through any-hit, closest hit only
+// over an OPAQUE copy of the BLAS with RAY_FLAG_FORCE_OPAQUE (trace_closest_* metrics),
+// and occlusion over the same copy, first hit ends the ray and sets one bit
+// (trace_occlusion_* metrics).
+#include "bench.h"
+
+#include "vk_accel.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static constexpr float SOUP_DEPTH = 4.0f;
+
+struct RtBenchPipeline {
+  VkDescriptorSetLayout dsl{};
+  VkPipelineLayout layout{};
+  VkDescriptorPool dpool{};
+  VkDescriptorSet dset{};
+  VkShaderModule modules[4]{};
+  VkPipeline pipeline{};
+  Buffer sbt;
+  VkStridedDeviceAddressRegionKHR rgenRegion{}, missRegion{}, hitRegion{}, callRegion{};
+};
+
+static RtBenchPipeline createRtBenchPipeline(VkContext &ctx) {
+  VkDevice dev = ctx.dev;
+  RtBenchPipeline p{};
+
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+  VkDescriptorSetLayoutCreateInfo dslci{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  dslci.bindingCount = 2;
+  dslci.pBindings = bindings;
+  VK_CHECK(vkCreateDescriptorSetLayout(dev, &dslci, nullptr, &p.dsl));
+
+  VkPushConstantRange pcr{VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR, 0, sizeof(uint32_t) * 3};
+  VkPipelineLayoutCreateInfo plci{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  plci.setLayoutCount = 1;
+  plci.pSetLayouts = &p.dsl;
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
+  VK_CHECK(vkCreatePipelineLayout(dev, &plci, nullptr, &p.layout));
+
+  VkDescriptorPoolSize ps[2] = {
+    {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+  };
+  VkDescriptorPoolCreateInfo dpci{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  dpci.maxSets = 1;
+  dpci.poolSizeCount = 2;
+  dpci.pPoolSizes = ps;
+  VK_CHECK(vkCreateDescriptorPool(dev, &dpci, nullptr, &p.dpool));
+
+  VkDescriptorSetAllocateInfo dsai{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  dsai.descriptorPool = p.dpool;
+  dsai.descriptorSetCount = 1;
+  dsai.pSetLayouts = &p.dsl;
+  VK_CHECK(vkAllocateDescriptorSets(dev, &dsai, &p.dset));
+
+  std::string shaderDir = SHADER_DIR;
+  const char *files[4] = {"bench_rt_raygen.spv", "bench_rt_miss.spv", "bench_rt_ahit.spv", "bench_rt_chit.spv"};
+  const char *entries[4] = {"raygenMain", "missMain", "aHitMain", "chitMain"};
+  const VkShaderStageFlagBits stageBits[4] = {
+    VK_SHADER_STAGE_RAYGEN_BIT_KHR, VK_SHADER_STAGE_MISS_BIT_KHR, VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
+    VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR
+  };
+  VkPipelineShaderStageCreateInfo stages[4]{};
+  for (int i = 0; i < 4; i++) {
+    p.modules[i] = createShaderModule(dev, loadSpv((shaderDir + "/" + files[i]).c_str()));
+    stages[i] = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+    stages[i].stage = stageBits[i];
+    stages[i].module = p.modules[i];
+    stages[i].pName = entries[i];
+  }
+
+  // 0: raygen, 1: miss, 2: triangle hit group (any-hit + closest-hit)
+  VkRayTracingShaderGroupCreateInfoKHR groups[3]{};
+  for (uint32_t i = 0; i < 3; i++) {
+    groups[i] = {VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
+    groups[i].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+    groups[i].generalShader = i;
+    groups[i].closestHitShader = VK_SHADER_UNUSED_KHR;
+    groups[i].anyHitShader = VK_SHADER_UNUSED_KHR;
+    groups[i].intersectionShader = VK_SHADER_UNUSED_KHR;
+  }
+  groups[2].type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+  groups[2].generalShader = VK_SHADER_UNUSED_KHR;
+  groups[2].anyHitShader = 2;
+  groups[2].closestHitShader = 3;
+
+  VkRayTracingPipelineCreateInfoKHR rpci{VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR};
+  rpci.stageCount = 4;
+  rpci.pStages = stages;
+  rpci.groupCount = 3;
+  rpci.pGroups = groups;
+  rpci.maxPipelineRayRecursionDepth = 1;
+  rpci.layout = p.layout;
+  p.pipeline = createRayTracingPipeline(ctx, rpci, "bench_rt");
+
+  // SBT: one record per region, every region starts on shaderGroupBaseAlignment.
+  const uint32_t handleSize = ctx.caps.shaderGroupHandleSize;
+  const VkDeviceSize stride = alignUp(handleSize, ctx.caps.shaderGroupHandleAlignment);
+  const VkDeviceSize regionSize = alignUp(stride, ctx.caps.shaderGroupBaseAlignment);
+  std::vector<uint8_t> handles(3 * handleSize);
+  VK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(dev, p.pipeline, 0, 3, handles.size(), handles.data()));
+
+  p.sbt = createBuffer(ctx, 3 * regionSize,
+                       VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                       true, ctx.caps.shaderGroupBaseAlignment);
+  uint8_t *sbtMap = (uint8_t *) mapBuffer(ctx, p.sbt);
+  for (uint32_t i = 0; i < 3; i++) std::memcpy(sbtMap + i * regionSize, handles.data() + i * handleSize, handleSize);
+  unmapBuffer(ctx, p.sbt);
+
+  VkStridedDeviceAddressRegionKHR *regions[3] = {&p.rgenRegion, &p.missRegion, &p.hitRegion};
+  for (uint32_t i = 0; i < 3; i++) {
+    regions[i]->deviceAddress = p.sbt.addr + i * regionSize;
+    regions[i]->stride = stride;
+    regions[i]->size = stride;
+  }
+  return p;
+}
+
+static void destroyRtBenchPipeline(VkContext &ctx, RtBenchPipeline &p) {
+  VkDevice dev = ctx.dev;
+  destroyBuffer(ctx, p.sbt);
+  vkDestroyPipeline(dev, p.pipeline, nullptr);
+  for (VkShaderModule m: p.modules) vkDestroyShaderModule(dev, m, nullptr);
+  vkDestroyDescriptorPool(dev, p.dpool, nullptr);
+  vkDestroyPipelineLayout(dev, p.layout, nullptr);
+  vkDestroyDescriptorSetLayout(dev, p.dsl, nullptr);
+  p = {};
+}
+
+// Equilateral triangles with random orientation, 9 floats each.
+static std::vector<float> makeTriangleSoup(uint32_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> u01(0.f, 1.f);
+  // area of an equilateral triangle with circumradius R: (3 sqrt(3) / 4) R^2
+  const float R = std::sqrt(SOUP_DEPTH / (count * 1.299038f));
+  const float TWO_PI_3 = 2.0943951f;
+
+  std::vector<float> v;
+  v.reserve((size_t) count * 9);
+  for (uint32_t t = 0; t < count; t++) {
+    float cx = u01(rng), cy = u01(rng), z = u01(rng), a = u01(rng) * 3.0f * TWO_PI_3;
+    for (int k = 0; k < 3; k++) {
+      v.push_back(cx + R * std::cos(a + k * TWO_PI_3));
+      v.push_back(cy + R * std::sin(a + k * TWO_PI_3));
+      v.push_back(z);
+    }
+  }
+  return v;
+}
+
+static void beginOneTime(VkCommandBuffer cmd) {
+  VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+}
+
+void benchRtTriangles(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  if (!ctx.caps.rayTracingPipeline) {
+    reportSkip(r, "rt_triangles", "no ray tracing pipeline support");
+    return;
+  }
+  const std::vector<uint32_t> triCounts = opts.quick
+                                            ? std::vector<uint32_t>{256, 1u << 12, 1u << 16}
+                                            : std::vector<uint32_t>{1u << 10, 1u << 16, 1u << 20};
+  const std::vector<uint32_t> gridSides = opts.quick
+                                            ? std::vector<uint32_t>{128, 256}
+                                            : std::vector<uint32_t>{256, 1024};
+  const std::vector<uint32_t> instanceCounts = opts.quick
+                                                 ? std::vector<uint32_t>{1, 1024}
+                                                 : std::vector<uint32_t>{1, 1024, 1u << 16};
+  VkDevice dev = ctx.dev;
+
+  VkCommandPool pool = createCmdPool(dev, ctx.qfam);
+  VkCommandBuffer cmd = createCmdBuffer(dev, pool);
+  GpuProfiler prof;
+  initProfiler(ctx, prof);
+  RtBenchPipeline pipe = createRtBenchPipeline(ctx);
+
+  for (uint32_t T: triCounts) {
+    std::vector<float> verts = makeTriangleSoup(T, T);
+    std::vector<uint32_t> indices(3 * (size_t) T);
+    for (uint32_t i = 0; i < indices.size(); i++) indices[i] = i;
+
+    const VkBufferUsageFlags inputUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    Buffer vbo = createDeviceLocalBuffer(ctx, verts.data(), sizeof(float) * verts.size(), inputUsage, true);
+    Buffer ibo = createDeviceLocalBuffer(ctx, indices.data(), sizeof(uint32_t) * indices.size(), inputUsage, true);
+
+    // ---- Build: BLAS + TLAS from scratch every rep; the last one is traced ----
+    Accel blas{}, tlas{};
+    std::vector<double> buildMs;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      destroyAccel(ctx, tlas);
+      destroyAccel(ctx, blas);
+      beginOneTime(cmd);
+      uint32_t scope = profilerBegin(prof, cmd, "blas_build");
+      blas = createBLAS_Triangles(ctx, cmd, vbo, 3 * T, sizeof(float) * 3, ibo, 3 * T);
+      profilerEnd(prof, cmd, scope);
+      scope = profilerBegin(prof, cmd, "tlas_build");
+      AccelInstance inst{};
+      inst.blas = blas.addr;
+      tlas = createTLAS(ctx, cmd, &inst, 1);
+      profilerEnd(prof, cmd, scope);
+      submitAndWait(dev, ctx.queue, cmd);
+      const double ms = profilerSumMs(prof, profilerResolve(ctx, prof));
+      profilerClear(prof);
+      if (rep >= opts.warmup) buildMs.push_back(ms);
+    }
+    if (prof.timestamps) reportResult(r, "rt_triangles", {{"triangles", T}}, "build_gpu_ms", "ms", summarize(buildMs));
+    reportResult(r, "rt_triangles", {{"triangles", T}}, "blas_bytes", "B",
+                 summarize({(double) blas.backing.size}));
+
+    // ---- Compaction: compactable build + compactAccels, the BLAS above stays as built ----
+    std::vector<double> compactMs;
+    VkDeviceSize compactedBytes = 0;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      beginOneTime(cmd);
+      Accel c = createBLAS_Triangles(ctx, cmd, vbo, 3 * T, sizeof(float) * 3, ibo, 3 * T, 0, ACCEL_BUILD_COMPACTABLE);
+      submitAndWait(dev, ctx.queue, cmd);
+      AccelCompactStats cs{};
+      compactAccels(ctx, cmd, &c, 1, &cs);
+      destroyAccel(ctx, c);
+      compactedBytes = cs.bytesAfter;
+      if (rep >= opts.warmup) compactMs.push_back(cs.ms);
+    }
+    reportResult(r, "rt_triangles", {{"triangles", T}}, "blas_compacted_bytes", "B",
+                 summarize({(double) compactedBytes}));
+    reportResult(r, "rt_triangles", {{"triangles", T}}, "compact_wall_ms", "ms", summarize(compactMs));
+
+    // Opaque copy for the closest-hit and occlusion traces
+    beginOneTime(cmd);
+    Accel opaqueBlas = createBLAS_Triangles(ctx, cmd, vbo, 3 * T, sizeof(float) * 3, ibo, 3 * T,
+                                            VK_GEOMETRY_OPAQUE_BIT_KHR);
+    AccelInstance opaqueInst{};
+    opaqueInst.blas = opaqueBlas.addr;
+    Accel opaqueTlas = createTLAS(ctx, cmd, &opaqueInst, 1);
+    submitAndWait(dev, ctx.queue, cmd);
+
+    // ---- Trace: all hits, closest hit only, occlusion ----
+    const char *gpuMetric[3] = {"trace_gpu_ms", "trace_closest_gpu_ms", "trace_occlusion_gpu_ms"};
+    const char *wallMetric[3] = {"trace_wall_ms", "trace_closest_wall_ms", "trace_occlusion_wall_ms"};
+    const char *hitMetric[3] = {"hits", "closest_hits", "occluded_rays"};
+    for (uint32_t side: gridSides) {
+      const uint32_t rays = side * side;
+      Buffer hits = createBuffer(ctx, sizeof(uint32_t) * rays,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+      VkDescriptorBufferInfo hitsInfo{hits.buf, 0, VK_WHOLE_SIZE};
+      VkWriteDescriptorSet hw{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      hw.dstSet = pipe.dset;
+      hw.dstBinding = 1;
+      hw.descriptorCount = 1;
+      hw.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      hw.pBufferInfo = &hitsInfo;
+      vkUpdateDescriptorSets(dev, 1, &hw, 0, nullptr);
+
+      for (uint32_t mode = 0; mode < 3; mode++) {
+        const bool occlusion = mode == 2;
+        VkWriteDescriptorSetAccelerationStructureKHR asWrite{
+          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR
+        };
+        asWrite.accelerationStructureCount = 1;
+        asWrite.pAccelerationStructures = mode ? &opaqueTlas.as : &tlas.as;
+        VkWriteDescriptorSet w{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        w.pNext = &asWrite;
+        w.dstSet = pipe.dset;
+        w.dstBinding = 0;
+        w.descriptorCount = 1;
+        w.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        vkUpdateDescriptorSets(dev, 1, &w, 0, nullptr);
+
+        const uint32_t push[3] = {side, side, mode};
+        std::vector<double> gpuMs, wallMs;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          beginOneTime(cmd);
+          if (occlusion) {
+            vkCmdFillBuffer(cmd, hits.buf, 0, VK_WHOLE_SIZE, 0);
+            cmdMemoryBarrier(cmd,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+          }
+          vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipe.pipeline);
+          vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipe.layout, 0, 1, &pipe.dset, 0,
+                                  nullptr);
+          vkCmdPushConstants(cmd, pipe.layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR, 0,
+                             sizeof(push), push);
+          uint32_t scope = profilerBegin(prof, cmd, "trace");
+          vkCmdTraceRaysKHR(cmd, &pipe.rgenRegion, &pipe.missRegion, &pipe.hitRegion, &pipe.callRegion, side, side,
+                            1);
+          profilerEnd(prof, cmd, scope);
+
+          WallTimer t;
+          submitAndWait(dev, ctx.queue, cmd);
+          const double wall = t.ms();
+          const double gpu = profilerSumMs(prof, profilerResolve(ctx, prof));
+          profilerClear(prof);
+          if (rep < opts.warmup) continue;
+          gpuMs.push_back(gpu);
+          wallMs.push_back(wall);
+        }
+
+        // All hits: mean crossings per ray should sit near SOUP_DEPTH for every size.
+        // Closest only and occlusion: rays that hit anything, so both must agree.
+        Buffer readback = createBuffer(ctx, sizeof(uint32_t) * rays, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                       false);
+        beginOneTime(cmd);
+        cmdMemoryBarrier(cmd,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        VkBufferCopy copy{0, 0, sizeof(uint32_t) * rays};
+        vkCmdCopyBuffer(cmd, hits.buf, readback.buf, 1, &copy);
+        cmdMemoryBarrier(cmd,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+        submitAndWait(dev, ctx.queue, cmd);
+        const uint32_t *h = (const uint32_t *) mapBuffer(ctx, readback);
+        uint64_t totalHits = 0;
+        if (occlusion)
+          for (uint32_t i = 0; i < (rays + 31) / 32; i++) totalHits += (uint64_t) std::popcount(h[i]);
+        else
+          for (uint32_t i = 0; i < rays; i++) totalHits += h[i];
+        unmapBuffer(ctx, readback);
+        destroyBuffer(ctx, readback);
+
+        const BenchParams params = {{"triangles", T}, {"rays", rays}};
+        if (prof.timestamps) reportResult(r, "rt_triangles", params, gpuMetric[mode], "ms", summarize(gpuMs));
+        reportResult(r, "rt_triangles", params, wallMetric[mode], "ms", summarize(wallMs));
+        reportResult(r, "rt_triangles", params, hitMetric[mode], "count", summarize({(double) totalHits}));
+      }
+
+      destroyBuffer(ctx, hits);
+    }
+    destroyAccel(ctx, opaqueTlas);
+    destroyAccel(ctx, opaqueBlas);
+
+    // ---- Per-frame TLAS rebuild: N instances of the smallest BLAS, moved every frame ----
+    if (T == triCounts.front()) {
+      for (uint32_t N: instanceCounts) {
+        const uint32_t side = (uint32_t) std::ceil(std::sqrt((double) N));
+        std::vector<AccelInstance> insts(N);
+        for (uint32_t i = 0; i < N; i++) {
+          insts[i].blas = blas.addr;
+          insts[i].transform[0][3] = (float) (i % side);
+          insts[i].transform[1][3] = (float) (i / side);
+          insts[i].customIndex = i;
+        }
+        beginOneTime(cmd);
+        Accel frameTlas = createTLAS(ctx, cmd, insts.data(), N);
+        submitAndWait(dev, ctx.queue, cmd);
+
+        std::vector<double> gpuMs, wallMs;
+        for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+          for (AccelInstance &in: insts) in.transform[2][3] = 0.01f * (float) rep;
+          WallTimer t; // instance upload included
+          beginOneTime(cmd);
+          uint32_t scope = profilerBegin(prof, cmd, "tlas_rebuild");
+          rebuildTLAS(ctx, cmd, frameTlas, insts.data(), N);
+          profilerEnd(prof, cmd, scope);
+          submitAndWait(dev, ctx.queue, cmd);
+          const double wall = t.ms();
+          const double gpu = profilerSumMs(prof, profilerResolve(ctx, prof));
+          profilerClear(prof);
+          if (rep < opts.warmup) continue;
+          gpuMs.push_back(gpu);
+          wallMs.push_back(wall);
+        }
+        if (prof.timestamps)
+          reportResult(r, "rt_triangles", {{"instances", N}}, "tlas_rebuild_gpu_ms", "ms", summarize(gpuMs));
+        reportResult(r, "rt_triangles", {{"instances", N}}, "tlas_rebuild_wall_ms", "ms", summarize(wallMs));
+        destroyAccel(ctx, frameTlas);
+      }
+    }
+
+    destroyAccel(ctx, tlas);
+    destroyAccel(ctx, blas);
+    destroyBuffer(ctx, vbo);
+    destroyBuffer(ctx, ibo);
+  }
+
+  // ---- Many small BLASes: one createBLAS_Triangles each vs one createBLASBatch ----
+  {
+    const uint32_t T = 64; // triangles per mesh, all meshes share the buffers
+    std::vector<float> verts = makeTriangleSoup(T, 7);
+    std::vector<uint32_t> indices(3 * T);
+    for (uint32_t i = 0; i < indices.size(); i++) indices[i] = i;
+    const VkBufferUsageFlags inputUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    Buffer vbo = createDeviceLocalBuffer(ctx, verts.data(), sizeof(float) * verts.size(), inputUsage, true);
+    Buffer ibo = createDeviceLocalBuffer(ctx, indices.data(), sizeof(uint32_t) * indices.size(), inputUsage, true);
+    const BlasBuild mesh = blasTriangles(vbo, 3 * T, sizeof(float) * 3, ibo, 3 * T);
+
+    for (uint32_t M: opts.quick ? std::vector<uint32_t>{256, 1024} : std::vector<uint32_t>{1024, 4096}) {
+      std::vector<BlasBuild> builds(M, mesh);
+      std::vector<Accel> accels(M);
+      std::vector<double> singleMs, batchMs;
+      for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+        beginOneTime(cmd);
+        uint32_t scope = profilerBegin(prof, cmd, "blas_single");
+        for (uint32_t i = 0; i < M; i++)
+          accels[i] = createBLAS_Triangles(ctx, cmd, vbo, 3 * T, sizeof(float) * 3, ibo, 3 * T);
+        profilerEnd(prof, cmd, scope);
+        submitAndWait(dev, ctx.queue, cmd);
+        const double single = profilerSumMs(prof, profilerResolve(ctx, prof));
+        for (Accel &a: accels) destroyAccel(ctx, a);
+
+        Buffer scratch;
+        beginOneTime(cmd);
+        scope = profilerBegin(prof, cmd, "blas_batch");
+        createBLASBatch(ctx, cmd, builds.data(), M, accels.data(), scratch);
+        profilerEnd(prof, cmd, scope);
+        submitAndWait(dev, ctx.queue, cmd);
+        const double batch = profilerSumMs(prof, profilerResolve(ctx, prof));
+        destroyBuffer(ctx, scratch);
+        for (Accel &a: accels) destroyAccel(ctx, a);
+
+        profilerClear(prof);
+        if (rep < opts.warmup) continue;
+        singleMs.push_back(single);
+        batchMs.push_back(batch);
+      }
+      if (prof.timestamps) {
+        reportResult(r, "rt_triangles", {{"meshes", M}, {"triangles", T}}, "blas_single_gpu_ms", "ms",
+                     summarize(singleMs));
+        reportResult(r, "rt_triangles", {{"meshes", M}, {"triangles", T}}, "blas_batch_gpu_ms", "ms",
+                     summarize(batchMs));
+      }
+    }
+    destroyBuffer(ctx, vbo);
+    destroyBuffer(ctx, ibo);
+  }
+
+  destroyRtBenchPipeline(ctx, pipe);
+  destroyProfiler(ctx, prof);
+  vkDestroyCommandPool(dev, pool, nullptr);
+}
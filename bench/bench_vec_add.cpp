@@ -0,0 +1,161 @@
+// bench_vec_add.cpp - Out = A + B (apps/01_vec_add shader) over growing N.
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void benchVecAdd(VkContext &ctx, const BenchOptions &opts, BenchReport &r) {
+  const std::vector<uint32_t> sizes = opts.quick
+                                        ? std::vector<uint32_t>{1u << 10, 1u << 14, 1u << 18}
+                                        : std::vector<uint32_t>{1u << 10, 1u << 16, 1u << 20, 1u << 24};
+  const uint32_t threadsPerGroup = 1024; // [numthreads] of add_10k.slang
+  VkDevice dev = ctx.dev;
+
+  VkCommandPool pool = createCmdPool(dev, ctx.qfam);
+  VkCommandBuffer cmd = createCmdBuffer(dev, pool);
+  GpuProfiler prof;
+  initProfiler(ctx, prof);
+
+  // ---- Pipeline: 3 SSBOs + {N, totalThreads} ----
+  VkDescriptorSetLayoutBinding bindings[3]{};
+  for (uint32_t i = 0; i < 3; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo dslci{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  dslci.bindingCount = 3;
+  dslci.pBindings = bindings;
+  VkDescriptorSetLayout dsl{};
+  VK_CHECK(vkCreateDescriptorSetLayout(dev, &dslci, nullptr, &dsl));
+
+  VkPushConstantRange pcr{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * 2};
+  VkPipelineLayoutCreateInfo plci{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  plci.setLayoutCount = 1;
+  plci.pSetLayouts = &dsl;
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
+  VkPipelineLayout layout{};
+  VK_CHECK(vkCreatePipelineLayout(dev, &plci, nullptr, &layout));
+
+  VkDescriptorPoolSize ps{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+  VkDescriptorPoolCreateInfo dpci{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  dpci.maxSets = 1;
+  dpci.poolSizeCount = 1;
+  dpci.pPoolSizes = &ps;
+  VkDescriptorPool dpool{};
+  VK_CHECK(vkCreateDescriptorPool(dev, &dpci, nullptr, &dpool));
+
+  VkDescriptorSetAllocateInfo dsai{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  dsai.descriptorPool = dpool;
+  dsai.descriptorSetCount = 1;
+  dsai.pSetLayouts = &dsl;
+  VkDescriptorSet dset{};
+  VK_CHECK(vkAllocateDescriptorSets(dev, &dsai, &dset));
+
+  VkShaderModule shader = createShaderModule(dev, loadSpv((std::string(SHADER_DIR) + "/vec_add.spv").c_str()));
+  VkComputePipelineCreateInfo cpci{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  cpci.stage.module = shader;
+  cpci.stage.pName = "main";
+  cpci.layout = layout;
+  VkPipeline pipeline = createComputePipeline(ctx, cpci, "bench_vec_add");
+
+  for (uint32_t N: sizes) {
+    std::vector<float> a(N), b(N);
+    for (uint32_t i = 0; i < N; i++) {
+      a[i] = float(i % 1000);
+      b[i] = float(i % 7) * 10.0f;
+    }
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    Buffer buf[3] = {
+      createDeviceLocalBuffer(ctx, a.data(), sizeof(float) * N, usage, false),
+      createDeviceLocalBuffer(ctx, b.data(), sizeof(float) * N, usage, false),
+      createBuffer(ctx, sizeof(float) * N, usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false),
+    };
+
+    VkDescriptorBufferInfo dbi[3]{};
+    VkWriteDescriptorSet writes[3]{};
+    for (uint32_t i = 0; i < 3; i++) {
+      dbi[i] = {buf[i].buf, 0, VK_WHOLE_SIZE};
+      writes[i] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      writes[i].dstSet = dset;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo = &dbi[i];
+    }
+    vkUpdateDescriptorSets(dev, 3, writes, 0, nullptr);
+
+    // Grid-stride loop in the shader: cap the grid, large N loops.
+    const uint32_t groups = std::min((N + threadsPerGroup - 1) / threadsPerGroup, 65535u);
+    const uint32_t push[2] = {N, groups * threadsPerGroup};
+
+    std::vector<double> gpuMs, wallMs;
+    for (uint32_t rep = 0; rep < opts.warmup + opts.reps; rep++) {
+      VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+      bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &dset, 0, nullptr);
+      vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push);
+      uint32_t scope = profilerBegin(prof, cmd, "dispatch");
+      vkCmdDispatch(cmd, groups, 1, 1);
+      profilerEnd(prof, cmd, scope);
+
+      WallTimer t;
+      submitAndWait(dev, ctx.queue, cmd);
+      const double wall = t.ms();
+      const double gpu = profilerSumMs(prof, profilerResolve(ctx, prof));
+      profilerClear(prof);
+      if (rep < opts.warmup) continue;
+      gpuMs.push_back(gpu);
+      wallMs.push_back(wall);
+    }
+
+    // Check the last rep's output once, outside the timed loop.
+    Buffer readback = createBuffer(ctx, sizeof(float) * N, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
+    VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+    cmdMemoryBarrier(cmd,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    VkBufferCopy copy{0, 0, sizeof(float) * N};
+    vkCmdCopyBuffer(cmd, buf[2].buf, readback.buf, 1, &copy);
+    cmdMemoryBarrier(cmd,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    submitAndWait(dev, ctx.queue, cmd);
+
+    const float *out = (const float *) mapBuffer(ctx, readback);
+    for (uint32_t i = 0; i < N; i++) {
+      if (out[i] != a[i] + b[i]) {
+        std::cerr << "vec_add: wrong result at " << i << " (N=" << N << ")\n";
+        std::exit(1);
+      }
+    }
+    unmapBuffer(ctx, readback);
+    destroyBuffer(ctx, readback);
+
+    const BenchParams params = {{"n", N}};
+    if (prof.timestamps) reportResult(r, "vec_add", params, "gpu_ms", "ms", summarize(gpuMs));
+    reportResult(r, "vec_add", params, "wall_ms", "ms", summarize(wallMs));
+
+    for (auto &bb: buf) destroyBuffer(ctx, bb);
+  }
+
+  vkDestroyPipeline(dev, pipeline, nullptr);
+  vkDestroyShaderModule(dev, shader, nullptr);
+  vkDestroyDescriptorPool(dev, dpool, nullptr);
+  vkDestroyPipelineLayout(dev, layout, nullptr);
+  vkDestroyDescriptorSetLayout(dev, dsl, nullptr);
+  destroyProfiler(ctx, prof);
+  vkDestroyCommandPool(dev, pool, nullptr);
+}
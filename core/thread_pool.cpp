@@ -0,0 +1,71 @@
+// thread_pool.cpp
+#include "thread_pool.h"
+
+#include <algorithm>
+
+static void runChunks(ThreadPool &p, uint32_t worker) {
+  for (;;) {
+    uint64_t begin = p.cursor.fetch_add(p.grain, std::memory_order_relaxed);
+    if (begin >= p.count) return;
+    (*p.body)(begin, std::min(begin + p.grain, p.count), worker);
+  }
+}
+
+static void workerMain(ThreadPool &p, uint32_t worker) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(p.mutex);
+      p.wake.wait(lock, [&] { return p.stop || p.generation != seen; });
+      if (p.stop) return;
+      seen = p.generation;
+    }
+    runChunks(p, worker);
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (--p.busy == 0) p.idle.notify_one();
+  }
+}
+
+void initThreadPool(ThreadPool &p, uint32_t threads) {
+  if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+  p.stop = false;
+  for (uint32_t i = 0; i + 1 < threads; i++) p.workers.emplace_back(workerMain, std::ref(p), i);
+}
+
+void destroyThreadPool(ThreadPool &p) {
+  {
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.stop = true;
+  }
+  p.wake.notify_all();
+  for (auto &t: p.workers) t.join();
+  p.workers.clear();
+}
+
+uint32_t threadCount(const ThreadPool &p) { return (uint32_t) p.workers.size() + 1; }
+
+void parallelFor(ThreadPool &p, uint64_t count, uint64_t grain, const ParallelBody &body) {
+  if (count == 0) return;
+  grain = std::max<uint64_t>(grain, 1);
+  const uint32_t caller = (uint32_t) p.workers.size();
+  if (caller == 0 || count <= grain) {
+    for (uint64_t b = 0; b < count; b += grain) body(b, std::min(b + grain, count), caller);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.body = &body;
+    p.cursor.store(0, std::memory_order_relaxed);
+    p.count = count;
+    p.grain = grain;
+    p.busy = caller;
+    p.generation++;
+  }
+  p.wake.notify_all();
+  runChunks(p, caller);
+
+  std::unique_lock<std::mutex> lock(p.mutex);
+  p.idle.wait(lock, [&] { return p.busy == 0; });
+  p.body = nullptr;
+}
@@ -0,0 +1,40 @@
+// thread_pool.h - fixed set of worker threads for data-parallel host loops.
+//
+// One job at a time: parallelFor hands out [begin, end) chunks of an index range from
+// an atomic cursor to the workers and the calling thread, and returns once every chunk
+// ran. Workers sleep on a condition variable between jobs.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// begin, end, worker index in [0, threadCount)
+using ParallelBody = std::function<void(uint64_t begin, uint64_t end, uint32_t worker)>;
+
+struct ThreadPool {
+  std::vector<std::thread> workers; // threadCount - 1; the caller is the last worker
+  std::mutex mutex;
+  std::condition_variable wake; // new job or stop
+  std::condition_variable idle; // last worker left the job
+  const ParallelBody *body{};
+  std::atomic<uint64_t> cursor{};
+  uint64_t count{};
+  uint64_t grain{};
+  uint64_t generation{}; // bumped per job
+  uint32_t busy{}; // workers still inside the current job
+  bool stop{};
+};
+
+// threads = 0: std::thread::hardware_concurrency().
+void initThreadPool(ThreadPool &p, uint32_t threads = 0);
+void destroyThreadPool(ThreadPool &p);
+
+uint32_t threadCount(const ThreadPool &p);
+
+// Runs body over [0, count) in chunks of at most grain indices. Not reentrant.
+void parallelFor(ThreadPool &p, uint64_t count, uint64_t grain, const ParallelBody &body);
@@ -0,0 +1,457 @@
+// vk_accel.cpp
+#include "vk_accel.h"
+#include "vk_context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+VkDeviceAddress getASAddress(VkDevice dev, VkAccelerationStructureKHR as) {
+  VkAccelerationStructureDeviceAddressInfoKHR ai{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
+  ai.accelerationStructure = as;
+  return vkGetAccelerationStructureDeviceAddressKHR(dev, &ai);
+}
+
+void cmdASBuildBarrier(const VkCaps &caps, VkCommandBuffer cmd) {
+  // AS builds too: a TLAS built later in the same command buffer reads the BLASes.
+  VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+  if (caps.rayTracingPipeline) dstStages |= VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+  if (caps.rayQuery) dstStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+  VkMemoryBarrier mb{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  mb.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  mb.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       dstStages,
+                       0, 1, &mb, 0, nullptr, 0, nullptr);
+}
+
+// Earlier builds / copies -> AS reads and writes (incl. scratch) of later ones
+static void cmdASToASBarrier(VkCommandBuffer cmd) {
+  cmdMemoryBarrier(cmd,
+                   VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                   VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                   VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+}
+
+// AS object and its backing buffer
+static Accel allocAccel(VkContext &ctx, VkAccelerationStructureTypeKHR type, VkDeviceSize size) {
+  Accel out{};
+  out.backing = createBuffer(ctx, size,
+                             VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+
+  VkAccelerationStructureCreateInfoKHR asci{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+  asci.type = type;
+  asci.size = size;
+  asci.buffer = out.backing.buf;
+  VK_CHECK(vkCreateAccelerationStructureKHR(ctx.dev, &asci, nullptr, &out.as));
+  out.type = type;
+  return out;
+}
+
+// Sizes (for up to maxPrimCount primitives), allocates and records the build of one AS
+// with a single geometry.
+static Accel buildAccel(
+  VkContext &ctx, VkCommandBuffer cmd,
+  VkAccelerationStructureTypeKHR type,
+  const VkAccelerationStructureGeometryKHR &geom, uint32_t primCount,
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT, uint32_t maxPrimCount = 0) {
+  VkDevice dev = ctx.dev;
+
+  VkAccelerationStructureBuildGeometryInfoKHR bgi{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  bgi.type = type;
+  bgi.flags = buildFlags;
+  bgi.geometryCount = 1;
+  bgi.pGeometries = &geom;
+
+  const uint32_t sizedCount = std::max(primCount, maxPrimCount);
+  VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(dev, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bgi, &sizedCount,
+                                          &sizes);
+
+  Accel out = allocAccel(ctx, type, sizes.accelerationStructureSize);
+
+  // Updatable: the scratch is kept for refits (see refitAccel).
+  VkDeviceSize scratchSize = sizes.buildScratchSize;
+  if (buildFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)
+    scratchSize = std::max(scratchSize, sizes.updateScratchSize);
+  out.scratch = createBuffer(ctx, scratchSize,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true,
+                             ctx.caps.minAccelerationStructureScratchOffsetAlignment);
+
+  bgi.dstAccelerationStructure = out.as;
+  bgi.scratchData.deviceAddress = out.scratch.addr;
+
+  VkAccelerationStructureBuildRangeInfoKHR range{};
+  range.primitiveCount = primCount;
+  const VkAccelerationStructureBuildRangeInfoKHR *pRange = &range;
+
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &bgi, &pRange);
+  cmdASBuildBarrier(ctx.caps, cmd);
+
+  out.addr = getASAddress(dev, out.as);
+  out.geom = geom;
+  out.primCount = primCount;
+  out.buildFlags = buildFlags;
+  return out;
+}
+
+BlasBuild blasTriangles(
+  const Buffer &vbo, uint32_t vertexCount, VkDeviceSize vertexStride,
+  const Buffer &ibo, uint32_t indexCount,
+  VkGeometryFlagsKHR geomFlags, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  VkAccelerationStructureGeometryTrianglesDataKHR tri{
+    VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR
+  };
+  tri.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+  tri.vertexData.deviceAddress = vbo.addr;
+  tri.vertexStride = vertexStride;
+  tri.maxVertex = vertexCount;
+  tri.indexType = VK_INDEX_TYPE_UINT32;
+  tri.indexData.deviceAddress = ibo.addr;
+
+  VkAccelerationStructureGeometryKHR geom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geom.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+  geom.flags = geomFlags;
+  geom.geometry.triangles = tri;
+  return {geom, indexCount / 3, buildFlags};
+}
+
+BlasBuild blasAABBs(VkDeviceAddress aabbAddr, uint32_t aabbCount,
+                    VkGeometryFlagsKHR geomFlags, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  VkAccelerationStructureGeometryAabbsDataKHR aabbs{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR};
+  aabbs.data.deviceAddress = aabbAddr;
+  aabbs.stride = sizeof(VkAabbPositionsKHR);
+
+  VkAccelerationStructureGeometryKHR geom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geom.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
+  geom.flags = geomFlags;
+  geom.geometry.aabbs = aabbs;
+  return {geom, aabbCount, buildFlags};
+}
+
+Accel createBLAS_Triangles(
+  VkContext &ctx, VkCommandBuffer cmd,
+  const Buffer &vbo, uint32_t vertexCount, VkDeviceSize vertexStride,
+  const Buffer &ibo, uint32_t indexCount,
+  VkGeometryFlagsKHR geomFlags, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  const BlasBuild b = blasTriangles(vbo, vertexCount, vertexStride, ibo, indexCount, geomFlags, buildFlags);
+  return buildAccel(ctx, cmd, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, b.geom, b.primCount, b.buildFlags);
+}
+
+Accel createBLAS_AABBs(
+  VkContext &ctx, VkCommandBuffer cmd,
+  const Buffer &aabbBuf, uint32_t aabbCount,
+  VkGeometryFlagsKHR geomFlags, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  return createBLAS_AABBs(ctx, cmd, aabbBuf.addr, aabbCount, geomFlags, buildFlags);
+}
+
+Accel createBLAS_AABBs(
+  VkContext &ctx, VkCommandBuffer cmd,
+  VkDeviceAddress aabbAddr, uint32_t aabbCount,
+  VkGeometryFlagsKHR geomFlags, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  const BlasBuild b = blasAABBs(aabbAddr, aabbCount, geomFlags, buildFlags);
+  return buildAccel(ctx, cmd, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, b.geom, b.primCount, b.buildFlags);
+}
+
+// ---- Batched BLAS builds ----
+void createBLASBatch(VkContext &ctx, VkCommandBuffer cmd, const BlasBuild *builds, uint32_t count, Accel *out,
+                     Buffer &scratch, VkDeviceSize maxScratchBytes, BlasBatchStats *stats) {
+  scratch = {};
+  if (!count) return;
+  VkDevice dev = ctx.dev;
+  const VkDeviceSize align = std::max<VkDeviceSize>(ctx.caps.minAccelerationStructureScratchOffsetAlignment, 1);
+
+  // 1. Sizes, AS objects and each build's aligned share of the arena
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> bgis(count);
+  std::vector<VkDeviceSize> scratchSizes(count);
+  VkDeviceSize scratchSum = 0, scratchMax = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    VkAccelerationStructureBuildGeometryInfoKHR &bgi = bgis[i];
+    bgi = {VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+    bgi.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    bgi.flags = builds[i].buildFlags;
+    bgi.geometryCount = 1;
+    bgi.pGeometries = &builds[i].geom;
+
+    VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+    vkGetAccelerationStructureBuildSizesKHR(dev, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bgi,
+                                            &builds[i].primCount, &sizes);
+    out[i] = allocAccel(ctx, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes.accelerationStructureSize);
+    out[i].geom = builds[i].geom;
+    out[i].primCount = builds[i].primCount;
+    out[i].buildFlags = builds[i].buildFlags;
+    bgi.dstAccelerationStructure = out[i].as;
+
+    scratchSizes[i] = (std::max<VkDeviceSize>(sizes.buildScratchSize, 1) + align - 1) / align * align;
+    scratchSum += scratchSizes[i];
+    scratchMax = std::max(scratchMax, scratchSizes[i]);
+  }
+
+  // 2. One arena: every build at once if it fits the budget, else the budget (at least
+  // the largest build), reused by consecutive calls.
+  const VkDeviceSize arenaSize = maxScratchBytes ? std::max(std::min(scratchSum, maxScratchBytes), scratchMax)
+                                                 : scratchSum;
+  scratch = createBuffer(ctx, arenaSize,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, align);
+
+  std::vector<VkAccelerationStructureBuildRangeInfoKHR> ranges(count);
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR *> pRanges(count);
+  for (uint32_t i = 0; i < count; i++) {
+    ranges[i].primitiveCount = builds[i].primCount;
+    pRanges[i] = &ranges[i];
+  }
+
+  // 3. Greedy runs of builds that fit the arena side by side, one call per run
+  BlasBatchStats st{};
+  st.scratchBytes = arenaSize;
+  for (uint32_t first = 0; first < count;) {
+    VkDeviceSize offset = 0;
+    uint32_t end = first;
+    while (end < count && offset + scratchSizes[end] <= arenaSize) {
+      bgis[end].scratchData.deviceAddress = scratch.addr + offset;
+      offset += scratchSizes[end];
+      end++;
+    }
+    if (st.buildCalls) cmdASToASBarrier(cmd); // the previous run still owns the arena
+    vkCmdBuildAccelerationStructuresKHR(cmd, end - first, bgis.data() + first, pRanges.data() + first);
+    st.buildCalls++;
+    first = end;
+  }
+  cmdASBuildBarrier(ctx.caps, cmd);
+
+  for (uint32_t i = 0; i < count; i++) {
+    out[i].addr = getASAddress(dev, out[i].as);
+    st.asBytes += out[i].backing.size;
+  }
+  if (stats) *stats = st;
+}
+
+static VkAccelerationStructureInstanceKHR toVkInstance(const AccelInstance &in) {
+  VkAccelerationStructureInstanceKHR out{};
+  std::memcpy(out.transform.matrix, in.transform, sizeof(in.transform));
+  out.instanceCustomIndex = in.customIndex & 0xFFFFFF;
+  out.mask = in.mask;
+  out.instanceShaderBindingTableRecordOffset = in.sbtOffset & 0xFFFFFF;
+  out.flags = in.flags;
+  out.accelerationStructureReference = in.blas;
+  return out;
+}
+
+// Instances -> the TLAS instance buffer (device-local; in place on UMA/ReBAR)
+static void uploadInstances(VkContext &ctx, const Buffer &dst, const AccelInstance *instances, uint32_t count) {
+  std::vector<VkAccelerationStructureInstanceKHR> vk(count);
+  for (uint32_t i = 0; i < count; i++) vk[i] = toVkInstance(instances[i]);
+  // Only earlier TLAS builds read the instance buffer
+  if (count)
+    updateDeviceLocalBuffer(ctx, dst, 0, vk.data(), sizeof(VkAccelerationStructureInstanceKHR) * count,
+                            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0);
+}
+
+static uint32_t instanceCapacity(const Accel &tlas) {
+  return (uint32_t) (tlas.instances.size / sizeof(VkAccelerationStructureInstanceKHR));
+}
+
+Accel createTLAS(VkContext &ctx, VkCommandBuffer cmd, const AccelInstance *instances, uint32_t count,
+                 uint32_t maxInstances, VkBuildAccelerationStructureFlagsKHR buildFlags) {
+  const uint32_t capacity = std::max({count, maxInstances, 1u});
+
+  // Instance data must be 16-byte aligned
+  Buffer instBuf = createDeviceLocalBuffer(ctx, nullptr, sizeof(VkAccelerationStructureInstanceKHR) * capacity,
+                                           VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                                           true, 16);
+  uploadInstances(ctx, instBuf, instances, count);
+
+  VkAccelerationStructureGeometryInstancesDataKHR idata{
+    VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR
+  };
+  idata.arrayOfPointers = VK_FALSE;
+  idata.data.deviceAddress = instBuf.addr;
+
+  VkAccelerationStructureGeometryKHR geom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geom.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geom.geometry.instances = idata;
+
+  Accel out = buildAccel(ctx, cmd, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, geom, count, buildFlags, capacity);
+  out.instances = instBuf;
+  return out;
+}
+
+void rebuildTLAS(VkContext &ctx, VkCommandBuffer cmd, Accel &tlas, const AccelInstance *instances, uint32_t count) {
+  if (count > instanceCapacity(tlas)) {
+    std::cerr << "rebuildTLAS: " << count << " instances exceed the capacity of " << instanceCapacity(tlas) << "\n";
+    std::exit(1);
+  }
+  uploadInstances(ctx, tlas.instances, instances, count);
+  tlas.primCount = count;
+
+  VkAccelerationStructureBuildGeometryInfoKHR bgi{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  bgi.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  bgi.flags = tlas.buildFlags;
+  bgi.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  bgi.geometryCount = 1;
+  bgi.pGeometries = &tlas.geom;
+  bgi.dstAccelerationStructure = tlas.as;
+  bgi.scratchData.deviceAddress = tlas.scratch.addr;
+
+  VkAccelerationStructureBuildRangeInfoKHR range{};
+  range.primitiveCount = count;
+  const VkAccelerationStructureBuildRangeInfoKHR *pRange = &range;
+
+  // Traces of the previous frame read this TLAS; the last build used the scratch.
+  VkMemoryBarrier mb{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  mb.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  mb.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       0, 1, &mb, 0, nullptr, 0, nullptr);
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &bgi, &pRange);
+  cmdASBuildBarrier(ctx.caps, cmd);
+}
+
+void destroyAccel(VkContext &ctx, Accel &a) {
+  if (a.as) vkDestroyAccelerationStructureKHR(ctx.dev, a.as, nullptr);
+  destroyBuffer(ctx, a.backing);
+  destroyBuffer(ctx, a.scratch);
+  destroyBuffer(ctx, a.instances);
+  a = {};
+}
+
+// ---- Compaction ----
+static void beginCmd(VkCommandBuffer cmd) {
+  VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+}
+
+void compactAccels(VkContext &ctx, VkCommandBuffer cmd, Accel *accels, uint32_t count, AccelCompactStats *stats) {
+  if (!count) return;
+  VkDevice dev = ctx.dev;
+  auto t0 = std::chrono::steady_clock::now();
+
+  // 1. Compacted sizes (only known once the builds executed)
+  VkQueryPoolCreateInfo qpci{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  qpci.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+  qpci.queryCount = count;
+  VkQueryPool pool{};
+  VK_CHECK(vkCreateQueryPool(dev, &qpci, nullptr, &pool));
+
+  std::vector<VkAccelerationStructureKHR> src(count);
+  for (uint32_t i = 0; i < count; i++) src[i] = accels[i].as;
+
+  beginCmd(cmd);
+  vkCmdResetQueryPool(cmd, pool, 0, count);
+  cmdASToASBarrier(cmd);
+  vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, count, src.data(),
+                                                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, pool, 0);
+  submitAndWait(dev, ctx.queue, cmd);
+
+  std::vector<VkDeviceSize> sizes(count);
+  VK_CHECK(vkGetQueryPoolResults(dev, pool, 0, count, sizeof(VkDeviceSize) * count, sizes.data(),
+                                 sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  vkDestroyQueryPool(dev, pool, nullptr);
+
+  // 2. Copy each AS into a right-sized buffer
+  std::vector<Accel> compacted(count);
+  beginCmd(cmd);
+  cmdASToASBarrier(cmd);
+  for (uint32_t i = 0; i < count; i++) {
+    Accel &c = compacted[i];
+    c = allocAccel(ctx, accels[i].type, sizes[i]);
+
+    VkCopyAccelerationStructureInfoKHR copy{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR};
+    copy.src = accels[i].as;
+    copy.dst = c.as;
+    copy.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+    vkCmdCopyAccelerationStructureKHR(cmd, &copy);
+  }
+  cmdASBuildBarrier(ctx.caps, cmd);
+  submitAndWait(dev, ctx.queue, cmd);
+
+  // 3. Swap in the compacted copies
+  AccelCompactStats st{};
+  for (uint32_t i = 0; i < count; i++) {
+    st.bytesBefore += accels[i].backing.size;
+    st.bytesAfter += compacted[i].backing.size;
+
+    compacted[i].addr = getASAddress(dev, compacted[i].as);
+    compacted[i].geom = accels[i].geom;
+    compacted[i].primCount = accels[i].primCount;
+    compacted[i].buildFlags = accels[i].buildFlags;
+    destroyAccel(ctx, accels[i]);
+    accels[i] = compacted[i];
+  }
+  st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  if (stats) *stats = st;
+}
+
+// ---- Refit ----
+void refitAccel(VkContext &ctx, VkCommandBuffer cmd, Accel &a) {
+  if (!(a.buildFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)) {
+    std::cerr << "refitAccel: acceleration structure was not built with ALLOW_UPDATE\n";
+    std::exit(1);
+  }
+
+  VkAccelerationStructureBuildGeometryInfoKHR bgi{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  bgi.type = a.type;
+  bgi.flags = a.buildFlags;
+  bgi.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+  bgi.geometryCount = 1;
+  bgi.pGeometries = &a.geom;
+  bgi.srcAccelerationStructure = a.as;
+  bgi.dstAccelerationStructure = a.as;
+
+  // compactAccels frees the build scratch: allocate an update-sized one on the first refit.
+  if (!a.scratch.buf) {
+    VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+    vkGetAccelerationStructureBuildSizesKHR(ctx.dev, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bgi,
+                                            &a.primCount, &sizes);
+    a.scratch = createBuffer(ctx, sizes.updateScratchSize,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true,
+                             ctx.caps.minAccelerationStructureScratchOffsetAlignment);
+  }
+  bgi.scratchData.deviceAddress = a.scratch.addr;
+
+  VkAccelerationStructureBuildRangeInfoKHR range{};
+  range.primitiveCount = a.primCount;
+  const VkAccelerationStructureBuildRangeInfoKHR *pRange = &range;
+
+  // The previous build / refit of a (and its scratch) must be done before this one.
+  cmdASToASBarrier(cmd);
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &bgi, &pRange);
+  cmdASBuildBarrier(ctx.caps, cmd);
+}
+
+double aabbMargin(const VkAabbPositionsKHR &b) {
+  return (double) (b.maxX - b.minX) + (b.maxY - b.minY) + (b.maxZ - b.minZ);
+}
+
+void resetRefitTracker(RefitTracker &t, const VkAabbPositionsKHR *boxes, uint32_t count) {
+  t = {};
+  for (uint32_t i = 0; i < count; i++) t.buildMargin += aabbMargin(boxes[i]);
+}
+
+bool shouldRebuild(const RefitPolicy &p, RefitTracker &t, const VkAabbPositionsKHR *oldBoxes,
+                   const VkAabbPositionsKHR *newBoxes, uint32_t changed, uint32_t primCount) {
+  double growth = 0;
+  for (uint32_t i = 0; i < changed; i++) {
+    const VkAabbPositionsKHR &o = oldBoxes[i], &n = newBoxes[i];
+    VkAabbPositionsKHR u{
+      std::min(o.minX, n.minX), std::min(o.minY, n.minY), std::min(o.minZ, n.minZ),
+      std::max(o.maxX, n.maxX), std::max(o.maxY, n.maxY), std::max(o.maxZ, n.maxZ)
+    };
+    growth += aabbMargin(u) - aabbMargin(o);
+  }
+  t.qualityLoss += t.buildMargin > 0 ? growth / t.buildMargin : 0.0;
+
+  const bool rebuild = t.qualityLoss > p.maxQualityLoss || t.refits >= p.maxRefits ||
+                       changed > p.maxChangedFraction * primCount;
+  if (!rebuild) t.refits++;
+  return rebuild;
+}
@@ -0,0 +1,177 @@
+// vk_accel.h - acceleration structure builds (BLAS/TLAS) shared by the RT apps.
+//
+// Builds are recorded into the caller's command buffer, followed by a barrier that
+// makes them visible to later AS builds (a TLAS over them) and to ray tracing and ray
+// query shaders. Nothing is submitted here, except by compactAccels, which needs the
+// built size on the host.
+#pragma once
+
+#include "vk_util.h"
+
+#include <cstdint>
+
+struct VkCaps;
+
+// Accel = one BLAS or TLAS (not a whole tree)
+struct Accel {
+  VkAccelerationStructureKHR as{};
+  Buffer backing;
+  VkDeviceAddress addr{};
+  // Build inputs the GPU reads during the build. They share allocator blocks with other
+  // buffers, so they must stay alive until the build has executed (freed by destroyAccel).
+  Buffer scratch;
+  Buffer instances; // TLAS only
+
+  // Build inputs by address (not contents), for refitAccel
+  VkAccelerationStructureTypeKHR type{};
+  VkAccelerationStructureGeometryKHR geom{};
+  uint32_t primCount{};
+  VkBuildAccelerationStructureFlagsKHR buildFlags{};
+};
+
+VkDeviceAddress getASAddress(VkDevice dev, VkAccelerationStructureKHR as);
+
+// AS build writes -> AS builds and ray tracing shader / ray query (compute) reads, as
+// far as the device supports them.
+void cmdASBuildBarrier(const VkCaps &caps, VkCommandBuffer cmd);
+
+constexpr VkBuildAccelerationStructureFlagsKHR ACCEL_BUILD_DEFAULT =
+    VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+// For compactAccels
+constexpr VkBuildAccelerationStructureFlagsKHR ACCEL_BUILD_COMPACTABLE =
+    ACCEL_BUILD_DEFAULT | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+// For refitAccel (may be combined with ACCEL_BUILD_COMPACTABLE)
+constexpr VkBuildAccelerationStructureFlagsKHR ACCEL_BUILD_UPDATABLE =
+    ACCEL_BUILD_DEFAULT | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+// Indexed triangle list: R32G32B32_SFLOAT positions, uint32 indices.
+Accel createBLAS_Triangles(
+  VkContext &ctx, VkCommandBuffer cmd,
+  const Buffer &vbo, uint32_t vertexCount, VkDeviceSize vertexStride,
+  const Buffer &ibo, uint32_t indexCount,
+  VkGeometryFlagsKHR geomFlags = 0,
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+
+// Procedural geometry: one VkAabbPositionsKHR per primitive.
+Accel createBLAS_AABBs(
+  VkContext &ctx, VkCommandBuffer cmd,
+  const Buffer &aabbBuf, uint32_t aabbCount,
+  VkGeometryFlagsKHR geomFlags = 0,
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+
+// Same over aabbCount boxes starting at a device address (8-byte aligned), e.g. one
+// range of a larger AABB buffer.
+Accel createBLAS_AABBs(
+  VkContext &ctx, VkCommandBuffer cmd,
+  VkDeviceAddress aabbAddr, uint32_t aabbCount,
+  VkGeometryFlagsKHR geomFlags = 0,
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+
+// ---- Batched BLAS builds ----
+// Inputs of one BLAS build. The buffers are referenced by address and must outlive the build.
+struct BlasBuild {
+  VkAccelerationStructureGeometryKHR geom{};
+  uint32_t primCount{};
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT;
+};
+
+BlasBuild blasTriangles(
+  const Buffer &vbo, uint32_t vertexCount, VkDeviceSize vertexStride,
+  const Buffer &ibo, uint32_t indexCount,
+  VkGeometryFlagsKHR geomFlags = 0,
+  VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+BlasBuild blasAABBs(VkDeviceAddress aabbAddr, uint32_t aabbCount,
+                    VkGeometryFlagsKHR geomFlags = 0,
+                    VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+
+// Many BLASes (out[i] from builds[i]) in one vkCmdBuildAccelerationStructuresKHR call,
+// so the driver can overlap them, and one barrier instead of one of each per BLAS.
+// Each BLAS gets its own AS buffer; their build scratch is a single arena with one
+// slice per build, aligned to minAccelerationStructureScratchOffsetAlignment.
+// maxScratchBytes caps the arena (0 = sum of all slices, at least the largest slice):
+// builds that do not fit side by side go into further calls that reuse it, with a
+// barrier in between. The arena is returned in scratch and must stay alive until the
+// submission has finished; the Accels own no scratch (refitAccel allocates one).
+struct BlasBatchStats {
+  uint32_t buildCalls{};
+  VkDeviceSize scratchBytes{}; // arena
+  VkDeviceSize asBytes{}; // all AS buffers
+};
+
+void createBLASBatch(VkContext &ctx, VkCommandBuffer cmd, const BlasBuild *builds, uint32_t count, Accel *out,
+                     Buffer &scratch, VkDeviceSize maxScratchBytes = 0, BlasBatchStats *stats = nullptr);
+
+// ---- TLAS ----
+// One instance of a BLAS: row-major 3x4 object-to-world transform, mask tested against
+// the ray's cull mask, custom index (InstanceID() in shaders, 24 bits) and hit group
+// offset into the SBT (24 bits).
+struct AccelInstance {
+  VkDeviceAddress blas{}; // Accel::addr
+  float transform[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+  uint32_t customIndex{};
+  uint8_t mask = 0xFF;
+  uint32_t sbtOffset{};
+  VkGeometryInstanceFlagsKHR flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+};
+
+// TLAS over instances[0, count), sized for up to maxInstances (>= count) so it can be
+// rebuilt with more instances later. The instance buffer is device-local.
+Accel createTLAS(VkContext &ctx, VkCommandBuffer cmd, const AccelInstance *instances, uint32_t count,
+                 uint32_t maxInstances = 0, VkBuildAccelerationStructureFlagsKHR buildFlags = ACCEL_BUILD_DEFAULT);
+
+// Per-frame rebuild with new instances (count <= capacity): reuses the AS, its backing,
+// scratch and instance buffer, so nothing is allocated. The instance upload is done
+// before returning (in place on UMA/ReBAR): earlier submissions must no longer read the
+// TLAS's instance buffer. A full rebuild of the top level is cheap next to BLAS work.
+void rebuildTLAS(VkContext &ctx, VkCommandBuffer cmd, Accel &tlas, const AccelInstance *instances, uint32_t count);
+
+void destroyAccel(VkContext &ctx, Accel &a);
+
+// ---- Compaction ----
+// Opt-in for static geometry: build with ACCEL_BUILD_COMPACTABLE and submit, then
+// compactAccels reads back the compacted sizes, copies each BLAS into a right-sized
+// buffer and frees the original and its scratch. Typically 30-50% less AS memory for
+// one size readback and one copy submission (both on cmd, which must not be recording).
+// Accel::addr changes: build the TLAS over compacted BLASes afterwards.
+struct AccelCompactStats {
+  VkDeviceSize bytesBefore{}; // AS buffers as built
+  VkDeviceSize bytesAfter{};
+  double ms{}; // wall time of the whole compaction, readback included
+};
+
+void compactAccels(VkContext &ctx, VkCommandBuffer cmd, Accel *accels, uint32_t count,
+                   AccelCompactStats *stats = nullptr);
+
+// ---- Refit ----
+// In-place MODE_UPDATE of an ACCEL_BUILD_UPDATABLE build whose inputs changed: same
+// buffers, same primitive count, new vertex / AABB contents. The input writes must be
+// visible to AS builds (staging uploads are). Keeps the tree of the last full build, so
+// it is much cheaper than a rebuild but traversal slows down as primitives drift.
+void refitAccel(VkContext &ctx, VkCommandBuffer cmd, Accel &a);
+
+// Refit or rebuild. Every moved primitive inflates the boxes of the nodes above it, which
+// a refit never undoes. The tracker accumulates that growth as quality loss: per changed
+// primitive, what its box gained (union of old and new minus old) relative to the total
+// primitive box size of the last full build. Box size is the margin dx+dy+dz, which
+// unlike surface area stays meaningful for flat 2D boxes.
+struct RefitPolicy {
+  double maxQualityLoss = 0.2; // accumulated over all refits since the last build
+  uint32_t maxRefits = 32;
+  double maxChangedFraction = 0.25; // larger edits are rebuilt right away
+};
+
+struct RefitTracker {
+  double buildMargin{}; // sum over primitives at the last full build
+  double qualityLoss{};
+  uint32_t refits{};
+};
+
+double aabbMargin(const VkAabbPositionsKHR &b);
+
+// After a full build over boxes[0, count).
+void resetRefitTracker(RefitTracker &t, const VkAabbPositionsKHR *boxes, uint32_t count);
+
+// Adds the loss of changing oldBoxes[i] into newBoxes[i] (changed primitives only) and
+// tells whether the edit should be applied by a rebuild. Counts a refit otherwise.
+bool shouldRebuild(const RefitPolicy &p, RefitTracker &t, const VkAabbPositionsKHR *oldBoxes,
+                   const VkAabbPositionsKHR *newBoxes, uint32_t changed, uint32_t primCount);
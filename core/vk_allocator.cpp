@@ -0,0 +1,215 @@
+// vk_allocator.cpp
+#include "vk_allocator.h"
+#include "vk_util.h"
+
+#include <algorithm>
+
+static VkDeviceSize poolBlockSize(const MemoryAllocator &a, uint32_t memType) {
+  // Don't let one block eat a small heap (e.g. the 256 MiB BAR window).
+  VkDeviceSize heapSize = a.memProps.memoryHeaps[a.memProps.memoryTypes[memType].heapIndex].size;
+  return std::max<VkDeviceSize>(std::min(a.blockSize, heapSize / 8), 1ull << 20);
+}
+
+static bool isHostVisible(const MemoryAllocator &a, uint32_t memType) {
+  return a.memProps.memoryTypes[memType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static VkDeviceMemory allocateDeviceMemory(MemoryAllocator &a, VkDeviceSize size, uint32_t memType, void **mapped) {
+  VkMemoryAllocateFlagsInfo flags{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+  flags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+  VkMemoryAllocateInfo ai{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  ai.allocationSize = size;
+  ai.memoryTypeIndex = memType;
+  if (a.deviceAddress) ai.pNext = &flags;
+
+  VkDeviceMemory mem{};
+  VK_CHECK(vkAllocateMemory(a.dev, &ai, nullptr, &mem));
+
+  *mapped = nullptr;
+  if (isHostVisible(a, memType))
+    VK_CHECK(vkMapMemory(a.dev, mem, 0, VK_WHOLE_SIZE, 0, mapped));
+
+  a.stats.deviceMemoryCount++;
+  a.stats.bytesReserved += size;
+  return mem;
+}
+
+static void freeDeviceMemory(MemoryAllocator &a, VkDeviceMemory mem, VkDeviceSize size) {
+  vkFreeMemory(a.dev, mem, nullptr); // implicitly unmaps
+  a.stats.deviceMemoryCount--;
+  a.stats.bytesReserved -= size;
+}
+
+// First fit. On success fills offset/rangeBegin and removes the range from the free list.
+static bool allocateFromBlock(MemoryBlock &blk, VkDeviceSize size, VkDeviceSize align, Allocation &out) {
+  for (auto it = blk.freeRanges.begin(); it != blk.freeRanges.end(); ++it) {
+    VkDeviceSize begin = it->first;
+    VkDeviceSize end = it->first + it->second;
+    VkDeviceSize aligned = alignUp(begin, align);
+    if (aligned + size > end) continue;
+
+    blk.freeRanges.erase(it);
+    if (aligned + size < end) blk.freeRanges[aligned + size] = end - (aligned + size);
+
+    out.rangeBegin = begin;
+    out.offset = aligned;
+    return true;
+  }
+  return false;
+}
+
+static void releaseRange(MemoryBlock &blk, VkDeviceSize begin, VkDeviceSize end) {
+  auto next = blk.freeRanges.lower_bound(begin);
+  if (next != blk.freeRanges.end() && next->first == end) {
+    end += next->second;
+    next = blk.freeRanges.erase(next);
+  }
+  if (next != blk.freeRanges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == begin) {
+      prev->second = end - prev->first;
+      return;
+    }
+  }
+  blk.freeRanges[begin] = end - begin;
+}
+
+void initAllocator(MemoryAllocator &a, VkDevice dev, VkPhysicalDevice phys, bool deviceAddress,
+                   VkDeviceSize blockSize) {
+  a.dev = dev;
+  a.phys = phys;
+  a.blockSize = blockSize;
+  a.deviceAddress = deviceAddress;
+  vkGetPhysicalDeviceMemoryProperties(phys, &a.memProps);
+  a.pools.assign(a.memProps.memoryTypeCount * 2, {});
+  a.stats = {};
+}
+
+void destroyAllocator(MemoryAllocator &a) {
+  std::lock_guard<std::mutex> lock(a.mutex);
+  if (a.stats.allocationCount)
+    std::cerr << "Allocator destroyed with " << a.stats.allocationCount << " live allocations\n";
+
+  for (auto &pool: a.pools)
+    for (auto &blk: pool.blocks)
+      if (blk.mem) freeDeviceMemory(a, blk.mem, blk.size);
+  a.pools.clear();
+}
+
+Allocation allocateMemory(MemoryAllocator &a, const VkMemoryRequirements &mr, VkMemoryPropertyFlags props,
+                          AllocKind kind) {
+  std::lock_guard<std::mutex> lock(a.mutex);
+
+  Allocation out{};
+  out.memType = findMemoryType(a.phys, mr.memoryTypeBits, props);
+  out.size = mr.size;
+
+  const VkDeviceSize blockSize = poolBlockSize(a, out.memType);
+  const VkDeviceSize align = std::max<VkDeviceSize>(mr.alignment, 1);
+
+  // Big resources: own VkDeviceMemory, no point in pooling them.
+  if (mr.size > blockSize / 2) {
+    out.mem = allocateDeviceMemory(a, mr.size, out.memType, &out.mapped);
+    out.pool = -1;
+    a.stats.dedicatedCount++;
+    a.stats.allocationCount++;
+    a.stats.bytesRequested += mr.size;
+    return out;
+  }
+
+  out.pool = (int32_t) (out.memType * 2 + (uint32_t) kind);
+  MemoryPool &pool = a.pools[out.pool];
+
+  uint32_t freeSlot = UINT32_MAX;
+  bool found = false;
+  for (uint32_t b = 0; b < pool.blocks.size() && !found; b++) {
+    if (!pool.blocks[b].mem) {
+      freeSlot = std::min(freeSlot, b);
+      continue;
+    }
+    if (allocateFromBlock(pool.blocks[b], mr.size, align, out)) {
+      out.block = b;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    if (freeSlot == UINT32_MAX) {
+      freeSlot = (uint32_t) pool.blocks.size();
+      pool.blocks.emplace_back();
+    }
+    MemoryBlock &blk = pool.blocks[freeSlot];
+    blk.size = blockSize;
+    blk.mem = allocateDeviceMemory(a, blockSize, out.memType, &blk.mapped);
+    blk.freeRanges.clear();
+    blk.freeRanges[0] = blockSize;
+    blk.liveAllocs = 0;
+    a.stats.blockCount++;
+
+    allocateFromBlock(blk, mr.size, align, out);
+    out.block = freeSlot;
+  }
+
+  MemoryBlock &blk = pool.blocks[out.block];
+  blk.liveAllocs++;
+  out.mem = blk.mem;
+  out.mapped = blk.mapped ? (uint8_t *) blk.mapped + out.offset : nullptr;
+
+  a.stats.allocationCount++;
+  a.stats.bytesRequested += mr.size;
+  a.stats.bytesAlignmentWaste += out.offset - out.rangeBegin;
+  return out;
+}
+
+void freeMemory(MemoryAllocator &a, Allocation &alloc) {
+  if (!alloc.mem) return;
+  std::lock_guard<std::mutex> lock(a.mutex);
+
+  a.stats.allocationCount--;
+  a.stats.bytesRequested -= alloc.size;
+
+  if (alloc.pool < 0) {
+    freeDeviceMemory(a, alloc.mem, alloc.size);
+    a.stats.dedicatedCount--;
+    alloc = {};
+    return;
+  }
+
+  MemoryBlock &blk = a.pools[alloc.pool].blocks[alloc.block];
+  releaseRange(blk, alloc.rangeBegin, alloc.offset + alloc.size);
+  blk.liveAllocs--;
+  a.stats.bytesAlignmentWaste -= alloc.offset - alloc.rangeBegin;
+  alloc = {};
+}
+
+VkDeviceSize trimAllocator(MemoryAllocator &a) {
+  std::lock_guard<std::mutex> lock(a.mutex);
+
+  VkDeviceSize released = 0;
+  for (auto &pool: a.pools) {
+    for (auto &blk: pool.blocks) {
+      if (!blk.mem || blk.liveAllocs) continue;
+      freeDeviceMemory(a, blk.mem, blk.size);
+      released += blk.size;
+      a.stats.blockCount--;
+      blk = {};
+    }
+    while (!pool.blocks.empty() && !pool.blocks.back().mem) pool.blocks.pop_back();
+  }
+  return released;
+}
+
+AllocatorStats allocatorStats(MemoryAllocator &a) {
+  std::lock_guard<std::mutex> lock(a.mutex);
+  return a.stats;
+}
+
+void printAllocatorStats(const AllocatorStats &s) {
+  std::cout << "Memory: " << s.deviceMemoryCount << " VkDeviceMemory ("
+      << s.blockCount << " blocks, " << s.dedicatedCount << " dedicated), "
+      << s.allocationCount << " allocations\n";
+  std::cout << "  reserved=" << s.bytesReserved << " B"
+      << " requested=" << s.bytesRequested << " B"
+      << " alignmentWaste=" << s.bytesAlignmentWaste << " B\n";
+}
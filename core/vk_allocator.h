@@ -0,0 +1,84 @@
+// vk_allocator.h - block sub-allocator for VkDeviceMemory.
+//
+// One pool per (memory type, resource kind). Each pool owns large VkDeviceMemory
+// blocks and hands out aligned ranges from a first-fit free list, so thousands of
+// small buffers cost a handful of vkAllocateMemory calls instead of one each
+// (and stay far below maxMemoryAllocationCount).
+// Host-visible blocks are mapped once at creation and stay mapped.
+#pragma once
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Buffers and linear images vs optimal-tiling images. Kept in separate pools so
+// neighbours never violate bufferImageGranularity.
+enum class AllocKind : uint32_t { Linear = 0, Optimal = 1 };
+
+struct Allocation {
+  VkDeviceMemory mem{};
+  VkDeviceSize offset{}; // aligned offset to bind at
+  VkDeviceSize size{}; // requested size
+  void *mapped{}; // host pointer at offset, nullptr if not host-visible
+  uint32_t memType{};
+  int32_t pool{-1}; // -1: dedicated VkDeviceMemory
+  uint32_t block{};
+  VkDeviceSize rangeBegin{}; // start of the reserved range (offset - alignment padding)
+};
+
+struct MemoryBlock {
+  VkDeviceMemory mem{}; // null once trimmed; the slot is reused
+  VkDeviceSize size{};
+  void *mapped{};
+  std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size, coalesced
+  uint32_t liveAllocs{};
+};
+
+struct MemoryPool {
+  std::vector<MemoryBlock> blocks;
+};
+
+struct AllocatorStats {
+  uint64_t deviceMemoryCount{}; // live VkDeviceMemory objects (blocks + dedicated)
+  uint64_t blockCount{};
+  uint64_t dedicatedCount{};
+  uint64_t allocationCount{}; // live sub-allocations
+  VkDeviceSize bytesReserved{}; // bytes held from the driver
+  VkDeviceSize bytesRequested{}; // bytes handed out (sum of Allocation::size)
+  VkDeviceSize bytesAlignmentWaste{}; // padding in front of allocations to honour alignment
+};
+
+struct MemoryAllocator {
+  VkDevice dev{};
+  VkPhysicalDevice phys{};
+  VkPhysicalDeviceMemoryProperties memProps{};
+  VkDeviceSize blockSize{}; // preferred block size; small heaps get smaller blocks
+  bool deviceAddress{}; // allocate blocks with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+  std::vector<MemoryPool> pools; // index = memType * 2 + kind
+  AllocatorStats stats{};
+  std::mutex mutex;
+};
+
+void initAllocator(MemoryAllocator &a, VkDevice dev, VkPhysicalDevice phys, bool deviceAddress,
+                   VkDeviceSize blockSize = 64ull << 20);
+
+// Frees every block. All allocations must have been released.
+void destroyAllocator(MemoryAllocator &a);
+
+// Allocations larger than half a block get their own VkDeviceMemory.
+Allocation allocateMemory(MemoryAllocator &a, const VkMemoryRequirements &mr, VkMemoryPropertyFlags props,
+                          AllocKind kind);
+
+void freeMemory(MemoryAllocator &a, Allocation &alloc);
+
+// Returns empty blocks to the driver. Returns the number of bytes released.
+// Live allocations are never moved: they are referenced by device address
+// (AS geometry, SBT), so relocating them would invalidate those addresses.
+VkDeviceSize trimAllocator(MemoryAllocator &a);
+
+AllocatorStats allocatorStats(MemoryAllocator &a);
+
+void printAllocatorStats(const AllocatorStats &s);
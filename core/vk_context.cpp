@@ -0,0 +1,362 @@
+// vk_context.cpp
+#define VOLK_IMPLEMENTATION
+#include "vk_context.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+static std::mutex g_ctxMutex;
+static VkContext *g_ctx = nullptr;
+
+static bool hasExtension(const std::vector<VkExtensionProperties> &exts, const char *name) {
+  for (auto &e: exts)
+    if (std::strcmp(e.extensionName, name) == 0) return true;
+  return false;
+}
+
+static std::vector<VkExtensionProperties> deviceExtensions(VkPhysicalDevice pd) {
+  uint32_t n = 0;
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(pd, nullptr, &n, nullptr));
+  std::vector<VkExtensionProperties> exts(n);
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(pd, nullptr, &n, exts.data()));
+  return exts;
+}
+
+static bool supportsRayTracing(VkPhysicalDevice pd) {
+  auto exts = deviceExtensions(pd);
+  if (!hasExtension(exts, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME)) return false;
+
+  VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtFeat{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR
+  };
+  VkPhysicalDeviceFeatures2 feats{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  feats.pNext = &rtFeat;
+  vkGetPhysicalDeviceFeatures2(pd, &feats);
+  return rtFeat.rayTracingPipeline;
+}
+
+// Prefer an RT-capable device; otherwise fall back to the first one (compute-only workloads).
+static VkPhysicalDevice pickPhysicalDevice(VkInstance instance) {
+  uint32_t pdCount = 0;
+  VK_CHECK(vkEnumeratePhysicalDevices(instance, &pdCount, nullptr));
+  if (!pdCount) {
+    std::cerr << "No GPU\n";
+    std::exit(1);
+  }
+
+  std::vector<VkPhysicalDevice> pds(pdCount);
+  VK_CHECK(vkEnumeratePhysicalDevices(instance, &pdCount, pds.data()));
+
+  for (auto pd: pds)
+    if (supportsRayTracing(pd)) return pd;
+  return pds[0];
+}
+
+static uint32_t findComputeQueueFamily(VkPhysicalDevice phys) {
+  uint32_t qfCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, nullptr);
+  std::vector<VkQueueFamilyProperties> qfs(qfCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, qfs.data());
+
+  for (uint32_t i = 0; i < qfCount; i++)
+    if (qfs[i].queueFlags & VK_QUEUE_COMPUTE_BIT) return i;
+
+  std::cerr << "No compute queue found\n";
+  std::exit(1);
+}
+
+static VkQueueFamilyProperties queueFamilyProps(VkPhysicalDevice phys, uint32_t qfam) {
+  uint32_t qfCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, nullptr);
+  std::vector<VkQueueFamilyProperties> qfs(qfCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(phys, &qfCount, qfs.data());
+  return qfs[qfam];
+}
+
+static void fillMemoryCaps(VkPhysicalDevice phys, VkCaps &caps) {
+  vkGetPhysicalDeviceMemoryProperties(phys, &caps.memProps);
+  const auto &mp = caps.memProps;
+
+  VkDeviceSize largestLocalHeap = 0;
+  for (uint32_t h = 0; h < mp.memoryHeapCount; h++) {
+    if (mp.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      caps.deviceLocalBytes += mp.memoryHeaps[h].size;
+      largestLocalHeap = std::max(largestLocalHeap, mp.memoryHeaps[h].size);
+    }
+  }
+
+  // UMA, or ReBAR: a DEVICE_LOCAL|HOST_VISIBLE|HOST_COHERENT type sits on (almost) the whole
+  // VRAM heap, not just the legacy 256 MiB BAR window.
+  const VkMemoryPropertyFlags dlhv = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  const bool uma = caps.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+                   caps.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+  for (uint32_t i = 0; i < mp.memoryTypeCount; i++) {
+    if ((mp.memoryTypes[i].propertyFlags & dlhv) != dlhv) continue;
+    if (uma || mp.memoryHeaps[mp.memoryTypes[i].heapIndex].size >= largestLocalHeap / 10 * 9) {
+      caps.deviceLocalHostVisible = true;
+      break;
+    }
+  }
+}
+
+static VkContext *createContext() {
+  auto *ctx = new VkContext{};
+  VkCaps &caps = ctx->caps;
+
+  VK_CHECK(volkInitialize());
+
+  // ---- Instance ----
+  VkApplicationInfo app{VK_STRUCTURE_TYPE_APPLICATION_INFO};
+  app.pApplicationName = "vkprimer";
+  app.apiVersion = VK_API_VERSION_1_3;
+
+  const char *instExts[] = {VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME};
+
+  VkInstanceCreateInfo ici{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
+  ici.pApplicationInfo = &app;
+  ici.enabledExtensionCount = 1;
+  ici.ppEnabledExtensionNames = instExts;
+
+  VK_CHECK(vkCreateInstance(&ici, nullptr, &ctx->instance));
+  volkLoadInstance(ctx->instance);
+
+  // ---- Physical device + queue family ----
+  ctx->phys = pickPhysicalDevice(ctx->instance);
+  ctx->qfam = findComputeQueueFamily(ctx->phys);
+  VkPhysicalDevice phys = ctx->phys;
+
+  VkPhysicalDeviceProperties basic{};
+  vkGetPhysicalDeviceProperties(phys, &basic);
+  if (basic.apiVersion < VK_API_VERSION_1_2) {
+    std::cerr << "Vulkan 1.2 device required\n";
+    std::exit(1);
+  }
+  const bool is13 = basic.apiVersion >= VK_API_VERSION_1_3;
+
+  auto exts = deviceExtensions(phys);
+  const bool hasAS = hasExtension(exts, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
+                     hasExtension(exts, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+  const bool hasRT = hasAS && hasExtension(exts, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+  const bool hasRQ = hasAS && hasExtension(exts, VK_KHR_RAY_QUERY_EXTENSION_NAME);
+
+  // ---- Properties ----
+  VkPhysicalDeviceSubgroupProperties sgp{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES};
+  VkPhysicalDeviceSubgroupSizeControlProperties sgsc{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES
+  };
+  VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtp{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR
+  };
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asp{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR
+  };
+
+  VkPhysicalDeviceIDProperties idp{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+
+  VkPhysicalDeviceProperties2 p2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  p2.pNext = &sgp;
+  sgp.pNext = &idp;
+  void **tail = &idp.pNext;
+  if (is13) {
+    *tail = &sgsc;
+    tail = &sgsc.pNext;
+  }
+  if (hasRT) {
+    *tail = &rtp;
+    tail = &rtp.pNext;
+  }
+  if (hasAS) {
+    *tail = &asp;
+    tail = &asp.pNext;
+  }
+  vkGetPhysicalDeviceProperties2(phys, &p2);
+
+  const VkPhysicalDeviceProperties &props = p2.properties;
+  caps.apiVersion = props.apiVersion;
+  caps.driverVersion = props.driverVersion;
+  std::memcpy(caps.deviceName, props.deviceName, sizeof(caps.deviceName));
+  caps.deviceType = props.deviceType;
+  caps.vendorID = props.vendorID;
+  caps.deviceID = props.deviceID;
+  std::memcpy(caps.deviceUUID, idp.deviceUUID, VK_UUID_SIZE);
+  std::memcpy(caps.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+  caps.maxMemoryAllocationCount = props.limits.maxMemoryAllocationCount;
+  caps.minStorageBufferOffsetAlignment = props.limits.minStorageBufferOffsetAlignment;
+  caps.nonCoherentAtomSize = props.limits.nonCoherentAtomSize;
+  caps.timestampPeriod = props.limits.timestampPeriod;
+  caps.timestampValidBits = queueFamilyProps(phys, ctx->qfam).timestampValidBits;
+
+  caps.subgroupSize = sgp.subgroupSize;
+  caps.subgroupOps = sgp.supportedOperations;
+  caps.subgroupStages = sgp.supportedStages;
+  caps.minSubgroupSize = sgsc.minSubgroupSize ? sgsc.minSubgroupSize : sgp.subgroupSize;
+  caps.maxSubgroupSize = sgsc.maxSubgroupSize ? sgsc.maxSubgroupSize : sgp.subgroupSize;
+
+  if (hasRT) {
+    caps.shaderGroupHandleSize = rtp.shaderGroupHandleSize;
+    caps.shaderGroupHandleAlignment = rtp.shaderGroupHandleAlignment;
+    caps.shaderGroupBaseAlignment = rtp.shaderGroupBaseAlignment;
+    caps.maxRayRecursionDepth = rtp.maxRayRecursionDepth;
+    caps.maxRayDispatchInvocationCount = rtp.maxRayDispatchInvocationCount;
+    // Spec limit per dimension: maxComputeWorkGroupCount * maxComputeWorkGroupSize
+    for (int i = 0; i < 3; i++)
+      caps.maxTraceRaysDimensions[i] = (uint32_t) std::min<uint64_t>(
+        (uint64_t) props.limits.maxComputeWorkGroupCount[i] * props.limits.maxComputeWorkGroupSize[i], UINT32_MAX);
+  }
+  if (hasAS)
+    caps.minAccelerationStructureScratchOffsetAlignment = asp.minAccelerationStructureScratchOffsetAlignment;
+
+  fillMemoryCaps(phys, caps);
+
+  // ---- Feature chain: query everything, then enable what is supported ----
+  VkPhysicalDeviceVulkan12Features f12{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  VkPhysicalDeviceVulkan13Features f13{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+  VkPhysicalDeviceAccelerationStructureFeaturesKHR asf{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR
+  };
+  VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtf{
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR
+  };
+  VkPhysicalDeviceRayQueryFeaturesKHR rqf{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR};
+
+  // a linked list of features.
+  VkPhysicalDeviceFeatures2 feats{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  feats.pNext = &f12;
+  tail = &f12.pNext;
+  if (is13) {
+    *tail = &f13;
+    tail = &f13.pNext;
+  }
+  if (hasAS) {
+    *tail = &asf;
+    tail = &asf.pNext;
+  }
+  if (hasRT) {
+    *tail = &rtf;
+    tail = &rtf.pNext;
+  }
+  if (hasRQ) {
+    *tail = &rqf;
+    tail = &rqf.pNext;
+  }
+  vkGetPhysicalDeviceFeatures2(phys, &feats);
+
+  // Supported != wanted: these cost performance and nobody here needs them.
+  feats.features.robustBufferAccess = VK_FALSE;
+  f12.bufferDeviceAddressCaptureReplay = VK_FALSE;
+  f12.bufferDeviceAddressMultiDevice = VK_FALSE;
+  asf.accelerationStructureCaptureReplay = VK_FALSE;
+  rtf.rayTracingPipelineShaderGroupHandleCaptureReplay = VK_FALSE;
+  rtf.rayTracingPipelineShaderGroupHandleCaptureReplayMixed = VK_FALSE;
+
+  caps.bufferDeviceAddress = f12.bufferDeviceAddress;
+  caps.accelerationStructure = hasAS && asf.accelerationStructure && caps.bufferDeviceAddress;
+  caps.rayTracingPipeline = hasRT && rtf.rayTracingPipeline && caps.accelerationStructure;
+  caps.rayQuery = hasRQ && rqf.rayQuery && caps.accelerationStructure;
+  caps.subgroupSizeControl = f13.subgroupSizeControl;
+  caps.pipelineStatisticsQuery = feats.features.pipelineStatisticsQuery;
+  caps.pipelineCreationFeedback = is13;
+
+  std::vector<const char *> devExts;
+  if (hasAS) {
+    devExts.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+    devExts.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+  }
+  if (hasRT) devExts.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+  if (hasRQ) devExts.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+
+  // ---- Device + queue ----
+  float qprio = 1.0f;
+  VkDeviceQueueCreateInfo qci{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+  qci.queueFamilyIndex = ctx->qfam;
+  qci.queueCount = 1;
+  qci.pQueuePriorities = &qprio;
+
+  VkDeviceCreateInfo dci{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+  dci.queueCreateInfoCount = 1;
+  dci.pQueueCreateInfos = &qci;
+  dci.enabledExtensionCount = (uint32_t) devExts.size();
+  dci.ppEnabledExtensionNames = devExts.data();
+  dci.pNext = &feats;
+
+  VK_CHECK(vkCreateDevice(phys, &dci, nullptr, &ctx->dev));
+  volkLoadDevice(ctx->dev);
+
+  vkGetDeviceQueue(ctx->dev, ctx->qfam, 0, &ctx->queue);
+
+  initAllocator(ctx->allocator, ctx->dev, phys, caps.bufferDeviceAddress);
+  initPipelineCache(*ctx, ctx->pipelineCache);
+  return ctx;
+}
+
+VkContext &getContext() {
+  std::lock_guard<std::mutex> lock(g_ctxMutex);
+  if (!g_ctx) g_ctx = createContext();
+  return *g_ctx;
+}
+
+void releaseContext() {
+  std::lock_guard<std::mutex> lock(g_ctxMutex);
+  if (!g_ctx) return;
+
+  vkDeviceWaitIdle(g_ctx->dev);
+  destroyStagingRing(*g_ctx, g_ctx->staging);
+  destroyPipelineCache(*g_ctx, g_ctx->pipelineCache);
+  destroyAllocator(g_ctx->allocator);
+  vkDestroyDevice(g_ctx->dev, nullptr);
+  vkDestroyInstance(g_ctx->instance, nullptr);
+  delete g_ctx;
+  g_ctx = nullptr;
+}
+
+VkExtent3D traceRaysExtent(const VkCaps &caps, uint64_t count, uint64_t *covered) {
+  const uint64_t limit = caps.maxRayDispatchInvocationCount ? caps.maxRayDispatchInvocationCount : UINT32_MAX;
+  const uint64_t W = std::max(caps.maxTraceRaysDimensions[0], 1u);
+  const uint64_t H = std::max(caps.maxTraceRaysDimensions[1], 1u);
+  const uint64_t D = std::max(caps.maxTraceRaysDimensions[2], 1u);
+  const uint64_t n = std::min(count, limit);
+
+  VkExtent3D e{1, 1, 1};
+  if (n <= W) {
+    e.width = (uint32_t) n;
+  } else if ((n + W - 1) / W <= H) {
+    // Rows of full width; the last one is partly padding
+    e.width = (uint32_t) W;
+    e.height = (uint32_t) std::min((n + W - 1) / W, limit / W);
+  } else {
+    e.width = (uint32_t) W;
+    e.height = (uint32_t) H;
+    e.depth = (uint32_t) std::max<uint64_t>(std::min({(n + W * H - 1) / (W * H), limit / (W * H), D}), 1);
+  }
+  if (covered) *covered = std::min(n, (uint64_t) e.width * e.height * e.depth);
+  return e;
+}
+
+void printCaps(const VkCaps &caps) {
+  auto yn = [](bool b) { return b ? "yes" : "no"; };
+  std::cout << "Device: " << caps.deviceName
+      << " (Vulkan " << VK_API_VERSION_MAJOR(caps.apiVersion) << "." << VK_API_VERSION_MINOR(caps.apiVersion) << ")\n";
+  std::cout << "  rayTracingPipeline=" << yn(caps.rayTracingPipeline)
+      << " rayQuery=" << yn(caps.rayQuery)
+      << " accelerationStructure=" << yn(caps.accelerationStructure) << "\n";
+  if (caps.rayTracingPipeline)
+    std::cout << "  maxRayDispatchInvocationCount=" << caps.maxRayDispatchInvocationCount
+        << " maxTraceRays=" << caps.maxTraceRaysDimensions[0] << "x" << caps.maxTraceRaysDimensions[1]
+        << "x" << caps.maxTraceRaysDimensions[2] << "\n";
+  std::cout << "  subgroupSize=" << caps.subgroupSize
+      << " [" << caps.minSubgroupSize << ", " << caps.maxSubgroupSize << "]"
+      << " sizeControl=" << yn(caps.subgroupSizeControl) << "\n";
+  std::cout << "  deviceLocal=" << (caps.deviceLocalBytes >> 20) << " MiB"
+      << " hostVisibleDeviceLocal=" << yn(caps.deviceLocalHostVisible) << "\n";
+  std::cout << "  timestampPeriod=" << caps.timestampPeriod << " ns"
+      << " timestampBits=" << caps.timestampValidBits
+      << " pipelineStatistics=" << yn(caps.pipelineStatisticsQuery) << "\n";
+  for (uint32_t h = 0; h < caps.memProps.memoryHeapCount; h++) {
+    const auto &heap = caps.memProps.memoryHeaps[h];
+    std::cout << "  heap[" << h << "] " << (heap.size >> 20) << " MiB"
+        << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " DEVICE_LOCAL" : "") << "\n";
+  }
+}
@@ -0,0 +1,93 @@
+// vk_context.h - process-wide Vulkan instance/device/queue.
+//
+// The context is created once on first use of getContext() and shared by every
+// workload in the process, so device creation and extension probing are paid once.
+// Every optional feature the device supports (RT pipeline, ray query, ...) is
+// enabled up front; workloads look at VkContext::caps to pick a path at runtime.
+#pragma once
+
+#include "vk_allocator.h"
+#include "vk_pipeline_cache.h"
+#include "vk_staging.h"
+#include "vk_util.h"
+
+#include <cstdint>
+#include <vector>
+
+// What the selected device can do. Filled once at context creation.
+struct VkCaps {
+  uint32_t apiVersion{};
+  uint32_t driverVersion{};
+  char deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE]{};
+  VkPhysicalDeviceType deviceType{};
+  uint32_t vendorID{};
+  uint32_t deviceID{};
+  uint8_t deviceUUID[VK_UUID_SIZE]{};
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE]{}; // must match a pipeline cache blob's header
+
+  // Features (only true when the extension is present AND the feature was enabled)
+  bool bufferDeviceAddress{};
+  bool accelerationStructure{};
+  bool rayTracingPipeline{};
+  bool rayQuery{};
+  bool pipelineStatisticsQuery{};
+  bool pipelineCreationFeedback{}; // Vulkan 1.3: per-pipeline cache hit/miss
+
+  // Subgroups
+  uint32_t subgroupSize{};
+  uint32_t minSubgroupSize{};
+  uint32_t maxSubgroupSize{};
+  VkSubgroupFeatureFlags subgroupOps{};
+  VkShaderStageFlags subgroupStages{}; // stages that may use subgroupOps
+  bool subgroupSizeControl{};
+
+  // Ray tracing pipeline properties (zero when rayTracingPipeline == false)
+  uint32_t shaderGroupHandleSize{};
+  uint32_t shaderGroupHandleAlignment{};
+  uint32_t shaderGroupBaseAlignment{};
+  uint32_t maxRayRecursionDepth{};
+  uint32_t maxRayDispatchInvocationCount{};
+  uint32_t maxTraceRaysDimensions[3]{}; // vkCmdTraceRaysKHR width/height/depth limits
+
+  // Acceleration structure properties
+  uint32_t minAccelerationStructureScratchOffsetAlignment{};
+
+  // Memory
+  VkPhysicalDeviceMemoryProperties memProps{};
+  VkDeviceSize deviceLocalBytes{}; // sum of DEVICE_LOCAL heaps
+  bool deviceLocalHostVisible{}; // UMA or ReBAR: CPU can write device-local (coherent) memory directly
+  uint32_t maxMemoryAllocationCount{};
+
+  // Limits
+  VkDeviceSize minStorageBufferOffsetAlignment{};
+  VkDeviceSize nonCoherentAtomSize{};
+  float timestampPeriod{};
+  uint32_t timestampValidBits{}; // of the context's queue family, 0 = no timestamps
+};
+
+struct VkContext {
+  VkInstance instance{};
+  VkPhysicalDevice phys{};
+  VkDevice dev{};
+  uint32_t qfam{};
+  VkQueue queue{};
+  VkCaps caps{};
+  MemoryAllocator allocator; // backs every Buffer / Image / Accel of the process
+  StagingRing staging; // host -> DEVICE_LOCAL uploads, created on first use
+  PipelineCache pipelineCache; // persistent, see vk_pipeline_cache.h
+};
+
+// Returns the shared context, creating it on the first call. Exits if no Vulkan device exists.
+VkContext &getContext();
+
+// Destroys the shared context. Call once at process exit, after all workloads finished.
+void releaseContext();
+
+void printCaps(const VkCaps &caps);
+
+// Launch extent for a batch of count rays: up to the width limit first, then rows, then
+// slices, so batches larger than one dimension allows still go out in one launch. The
+// raygen shader flattens DispatchRaysIndex() back with (z * height + y) * width + x and
+// skips indices >= covered. *covered gets how many of the count rays the launch holds
+// (bounded by maxRayDispatchInvocationCount); the rest needs more launches at an offset.
+VkExtent3D traceRaysExtent(const VkCaps &caps, uint64_t count, uint64_t *covered = nullptr);
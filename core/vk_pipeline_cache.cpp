@@ -0,0 +1,177 @@
+// vk_pipeline_cache.cpp
+#include "vk_pipeline_cache.h"
+#include "vk_context.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static std::string cacheDir() {
+  if (const char *d = std::getenv("VKPRIMER_CACHE_DIR")) return d; // "" = no file
+  if (const char *x = std::getenv("XDG_CACHE_HOME"); x && *x) return std::string(x) + "/vkprimer";
+  if (const char *h = std::getenv("HOME"); h && *h) return std::string(h) + "/.cache/vkprimer";
+  return {};
+}
+
+static std::string cacheFileName(const VkCaps &caps) {
+  std::string name = "pipelines-";
+  char hex[3];
+  for (uint8_t b: caps.deviceUUID) {
+    std::snprintf(hex, sizeof(hex), "%02x", b);
+    name += hex;
+  }
+  char ver[16];
+  std::snprintf(ver, sizeof(ver), "-%08x.bin", caps.driverVersion);
+  return name + ver;
+}
+
+// The driver validates the blob as well; checking here tells a stale file from a cold start.
+static bool headerMatches(const VkCaps &caps, const std::vector<char> &data) {
+  VkPipelineCacheHeaderVersionOne h{};
+  if (data.size() < sizeof(h)) return false;
+  std::memcpy(&h, data.data(), sizeof(h));
+  return h.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         h.vendorID == caps.vendorID && h.deviceID == caps.deviceID &&
+         std::memcmp(h.pipelineCacheUUID, caps.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void initPipelineCache(VkContext &ctx, PipelineCache &pc) {
+  const std::string dir = cacheDir();
+  std::vector<char> data;
+  if (!dir.empty()) {
+    pc.path = dir + "/" + cacheFileName(ctx.caps);
+    std::ifstream f(pc.path, std::ios::binary);
+    if (f) data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    if (!data.empty() && !headerMatches(ctx.caps, data)) {
+      std::cerr << "Ignoring pipeline cache " << pc.path << " made for another device/driver\n";
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo ci{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  ci.initialDataSize = data.size();
+  ci.pInitialData = data.empty() ? nullptr : data.data();
+  if (vkCreatePipelineCache(ctx.dev, &ci, nullptr, &pc.cache) != VK_SUCCESS) {
+    // Rejected blob: start empty instead of failing the run.
+    ci.initialDataSize = 0;
+    ci.pInitialData = nullptr;
+    data.clear();
+    VK_CHECK(vkCreatePipelineCache(ctx.dev, &ci, nullptr, &pc.cache));
+  }
+  pc.loadedBytes = data.size();
+}
+
+// Temp file in the same directory + rename: readers see the old or the new file, never a torn one.
+static void writeCacheFile(const std::string &path, const std::vector<char> &data) {
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+  const std::string tmp = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (!f.write(data.data(), (std::streamsize) data.size()) || !f.flush()) {
+      std::cerr << "Failed to write " << tmp << "\n";
+      std::filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::cerr << "Failed to replace " << path << ": " << ec.message() << "\n";
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+void destroyPipelineCache(VkContext &ctx, PipelineCache &pc) {
+  if (!pc.cache) return;
+
+  // Nothing new was compiled: keep the file as it is.
+  bool changed = pc.loadedBytes == 0;
+  for (const PipelineCreateRecord &r: pc.records) changed |= r.result != PipelineCacheResult::Hit;
+
+  if (!pc.path.empty() && changed) {
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(ctx.dev, pc.cache, &size, nullptr));
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(ctx.dev, pc.cache, &size, data.data()));
+    data.resize(size);
+    if (size) writeCacheFile(pc.path, data);
+  }
+
+  vkDestroyPipelineCache(ctx.dev, pc.cache, nullptr);
+  pc.cache = VK_NULL_HANDLE;
+  pc.records.clear();
+}
+
+static void record(VkContext &ctx, const char *name, std::chrono::steady_clock::time_point t0,
+                   const VkPipelineCreationFeedback &fb) {
+  PipelineCreateRecord r;
+  r.name = name;
+  r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  if (ctx.caps.pipelineCreationFeedback && (fb.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT))
+    r.result = (fb.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+                 ? PipelineCacheResult::Hit
+                 : PipelineCacheResult::Miss;
+
+  std::lock_guard<std::mutex> lock(ctx.pipelineCache.mutex);
+  ctx.pipelineCache.records.push_back(std::move(r));
+}
+
+VkPipeline createComputePipeline(VkContext &ctx, const VkComputePipelineCreateInfo &ci, const char *name) {
+  VkPipelineCreationFeedback fb{};
+  VkPipelineCreationFeedbackCreateInfo fci{VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+  fci.pPipelineCreationFeedback = &fb;
+  fci.pNext = ci.pNext;
+
+  VkComputePipelineCreateInfo info = ci;
+  if (ctx.caps.pipelineCreationFeedback) info.pNext = &fci;
+
+  auto t0 = std::chrono::steady_clock::now();
+  VkPipeline p{};
+  VK_CHECK(vkCreateComputePipelines(ctx.dev, ctx.pipelineCache.cache, 1, &info, nullptr, &p));
+  record(ctx, name, t0, fb);
+  return p;
+}
+
+VkPipeline createRayTracingPipeline(VkContext &ctx, const VkRayTracingPipelineCreateInfoKHR &ci, const char *name) {
+  VkPipelineCreationFeedback fb{};
+  VkPipelineCreationFeedbackCreateInfo fci{VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+  fci.pPipelineCreationFeedback = &fb;
+  fci.pNext = ci.pNext;
+
+  VkRayTracingPipelineCreateInfoKHR info = ci;
+  if (ctx.caps.pipelineCreationFeedback) info.pNext = &fci;
+
+  auto t0 = std::chrono::steady_clock::now();
+  VkPipeline p{};
+  VK_CHECK(vkCreateRayTracingPipelinesKHR(ctx.dev, VK_NULL_HANDLE, ctx.pipelineCache.cache, 1, &info, nullptr, &p));
+  record(ctx, name, t0, fb);
+  return p;
+}
+
+void printPipelineCacheStats(const PipelineCache &pc) {
+  uint32_t hits = 0, misses = 0;
+  double totalMs = 0;
+  for (const PipelineCreateRecord &r: pc.records) {
+    hits += r.result == PipelineCacheResult::Hit;
+    misses += r.result == PipelineCacheResult::Miss;
+    totalMs += r.ms;
+  }
+
+  std::cout << "Pipeline cache: " << pc.records.size() << " pipelines in " << totalMs << " ms, "
+      << hits << " hits, " << misses << " misses";
+  if (hits + misses < pc.records.size()) std::cout << ", " << pc.records.size() - hits - misses << " unknown";
+  std::cout << "\n  file=" << (pc.path.empty() ? "(none)" : pc.path)
+      << (pc.loadedBytes ? " loaded " + std::to_string(pc.loadedBytes) + " B" : std::string(" cold")) << "\n";
+  for (const PipelineCreateRecord &r: pc.records) {
+    const char *res = r.result == PipelineCacheResult::Hit ? "hit"
+                      : r.result == PipelineCacheResult::Miss ? "miss" : "?";
+    std::cout << "  " << r.name << ": " << r.ms << " ms (" << res << ")\n";
+  }
+}
@@ -0,0 +1,51 @@
+// vk_pipeline_cache.h - persistent VkPipelineCache shared by every pipeline of the process.
+//
+// The context loads the cache from <dir>/pipelines-<deviceUUID>-<driverVersion>.bin when
+// it is created and writes it back when it is released, so later runs skip most of the
+// shader compilation in vkCreate*Pipelines (RT pipelines above all). A new driver gets a
+// new file; files whose header does not match the device are ignored. The write goes to
+// a temp file that is renamed over the old one, so a crash never leaves a torn cache.
+//
+// dir: $VKPRIMER_CACHE_DIR, else $XDG_CACHE_HOME/vkprimer, else $HOME/.cache/vkprimer.
+// VKPRIMER_CACHE_DIR="" keeps the cache in memory only.
+//
+// Pipelines created through createComputePipeline / createRayTracingPipeline are timed
+// and, where pipeline creation feedback exists (Vulkan 1.3), recorded as cache hit or miss.
+#pragma once
+
+#include "vk_util.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct VkContext;
+
+enum class PipelineCacheResult { Unknown, Hit, Miss };
+
+struct PipelineCreateRecord {
+  std::string name;
+  double ms{}; // host time of the vkCreate*Pipelines call
+  PipelineCacheResult result{};
+};
+
+struct PipelineCache {
+  VkPipelineCache cache{};
+  std::string path; // empty: not persisted
+  size_t loadedBytes{}; // of a valid file, 0 = cold start
+  std::vector<PipelineCreateRecord> records;
+  std::mutex mutex; // guards records
+};
+
+// Called by the context; workloads use ctx.pipelineCache.
+void initPipelineCache(VkContext &ctx, PipelineCache &pc);
+// Writes the cache file (if any), then destroys the cache.
+void destroyPipelineCache(VkContext &ctx, PipelineCache &pc);
+
+// vkCreate*Pipelines with ctx.pipelineCache, timed and recorded under name. Exits on failure.
+VkPipeline createComputePipeline(VkContext &ctx, const VkComputePipelineCreateInfo &ci, const char *name);
+VkPipeline createRayTracingPipeline(VkContext &ctx, const VkRayTracingPipelineCreateInfoKHR &ci, const char *name);
+
+// One line per pipeline plus totals: hits, misses, creation ms, cache file.
+void printPipelineCacheStats(const PipelineCache &pc);
@@ -0,0 +1,189 @@
+// vk_profiler.cpp
+#include "vk_profiler.h"
+#include "vk_context.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+
+void initProfiler(VkContext &ctx, GpuProfiler &p, uint32_t maxScopes) {
+  p = {};
+  if (!ctx.caps.timestampValidBits) return;
+
+  p.maxScopes = maxScopes;
+  p.nsPerTick = ctx.caps.timestampPeriod;
+  p.tickMask = ctx.caps.timestampValidBits >= 64 ? ~0ull : (1ull << ctx.caps.timestampValidBits) - 1;
+
+  VkQueryPoolCreateInfo qpci{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  qpci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  qpci.queryCount = 2 * maxScopes;
+  VK_CHECK(vkCreateQueryPool(ctx.dev, &qpci, nullptr, &p.timestamps));
+
+  if (ctx.caps.pipelineStatisticsQuery) {
+    qpci.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    qpci.queryCount = maxScopes;
+    qpci.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+    VK_CHECK(vkCreateQueryPool(ctx.dev, &qpci, nullptr, &p.statistics));
+  }
+}
+
+void destroyProfiler(VkContext &ctx, GpuProfiler &p) {
+  if (p.timestamps) vkDestroyQueryPool(ctx.dev, p.timestamps, nullptr);
+  if (p.statistics) vkDestroyQueryPool(ctx.dev, p.statistics, nullptr);
+  p = {};
+}
+
+uint32_t profilerBegin(GpuProfiler &p, VkCommandBuffer cmd, const char *name, bool statistics) {
+  if (!p.timestamps) return PROFILER_NO_SCOPE;
+  if (p.pending.size() >= p.maxScopes) {
+    p.dropped++;
+    return PROFILER_NO_SCOPE;
+  }
+
+  const uint32_t slot = (uint32_t) p.pending.size();
+  statistics = statistics && p.statistics;
+  p.pending.push_back({name, statistics});
+
+  // Both stamps at BOTTOM_OF_PIPE: the begin stamp lands once earlier work drained, so
+  // back-to-back scopes don't overlap.
+  vkCmdResetQueryPool(cmd, p.timestamps, 2 * slot, 2);
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, p.timestamps, 2 * slot);
+  if (statistics) {
+    vkCmdResetQueryPool(cmd, p.statistics, slot, 1);
+    vkCmdBeginQuery(cmd, p.statistics, slot, 0);
+  }
+  return slot;
+}
+
+void profilerEnd(GpuProfiler &p, VkCommandBuffer cmd, uint32_t scope) {
+  if (scope == PROFILER_NO_SCOPE) return;
+  if (p.pending[scope].statistics) vkCmdEndQuery(cmd, p.statistics, scope);
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, p.timestamps, 2 * scope + 1);
+}
+
+// Drops the oldest records when n more would pass maxRecords.
+static void makeRoom(GpuProfiler &p, size_t n) {
+  if (!n || p.records.size() + n <= p.maxRecords) return;
+  // Halve rather than trim to the limit, so a full profiler does not shift every resolve
+  const size_t room = n < p.maxRecords ? p.maxRecords - n : 0;
+  const size_t keep = std::min({p.records.size(), p.maxRecords / 2, room});
+  p.discarded += p.records.size() - keep;
+  p.records.erase(p.records.begin(), p.records.end() - (std::ptrdiff_t) keep);
+}
+
+size_t profilerResolve(VkContext &ctx, GpuProfiler &p) {
+  const uint32_t n = (uint32_t) p.pending.size();
+  makeRoom(p, n);
+  const size_t first = p.records.size();
+  if (!n) return first;
+
+  std::vector<uint64_t> ts(2 * n);
+  VK_CHECK(vkGetQueryPoolResults(ctx.dev, p.timestamps, 0, 2 * n, ts.size() * sizeof(uint64_t), ts.data(),
+                                 sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+  for (uint32_t i = 0; i < n; i++) {
+    ProfileRecord r{};
+    r.name = p.pending[i].name;
+    r.ms = (double) ((ts[2 * i + 1] - ts[2 * i]) & p.tickMask) * p.nsPerTick * 1e-6;
+    if (p.pending[i].statistics) {
+      // Slots without statistics were never reset, so read them one by one.
+      VK_CHECK(vkGetQueryPoolResults(ctx.dev, p.statistics, i, 1, sizeof(uint64_t), &r.computeInvocations,
+                                     sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+      r.hasStatistics = true;
+    }
+    p.records.push_back(std::move(r));
+  }
+  p.pending.clear();
+  return first;
+}
+
+void profilerClear(GpuProfiler &p) {
+  p.records.clear();
+}
+
+void profilerMoveRecords(GpuProfiler &dst, GpuProfiler &src) {
+  // More than dst can hold at all: only the newest fit
+  const size_t skip = src.records.size() > dst.maxRecords ? src.records.size() - dst.maxRecords : 0;
+  dst.discarded += skip + src.discarded;
+  makeRoom(dst, src.records.size() - skip);
+  dst.records.insert(dst.records.end(), std::make_move_iterator(src.records.begin() + (std::ptrdiff_t) skip),
+                     std::make_move_iterator(src.records.end()));
+  dst.dropped += src.dropped;
+  src.records.clear();
+  src.discarded = 0;
+  src.dropped = 0;
+}
+
+double profilerSumMs(const GpuProfiler &p, size_t first, const char *prefix) {
+  const size_t len = std::strlen(prefix);
+  double ms = 0;
+  for (size_t i = first; i < p.records.size(); i++)
+    if (p.records[i].name.compare(0, len, prefix) == 0) ms += p.records[i].ms;
+  return ms;
+}
+
+// ---- Output ----
+static std::string jsonString(const char *s) {
+  std::string out = "\"";
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') out += '\\';
+    out += *s;
+  }
+  return out + "\"";
+}
+
+void writeProfileJson(std::ostream &os, const VkCaps &caps, const GpuProfiler &p) {
+  os << std::setprecision(6) << std::fixed;
+  os << "{\n";
+  os << "  \"time\": " << (long long) std::time(nullptr) << ",\n";
+  os << "  \"device\": " << jsonString(caps.deviceName) << ",\n";
+  os << "  \"apiVersion\": \"" << VK_API_VERSION_MAJOR(caps.apiVersion) << "." << VK_API_VERSION_MINOR(caps.apiVersion)
+      << "." << VK_API_VERSION_PATCH(caps.apiVersion) << "\",\n";
+  os << "  \"driverVersion\": " << caps.driverVersion << ",\n";
+  os << "  \"dropped\": " << p.dropped << ",\n";
+  os << "  \"discarded\": " << p.discarded << ",\n";
+  os << "  \"scopes\": [";
+  for (size_t i = 0; i < p.records.size(); i++) {
+    const ProfileRecord &r = p.records[i];
+    os << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(r.name.c_str()) << ", \"ms\": " << r.ms;
+    if (r.hasStatistics) os << ", \"computeInvocations\": " << r.computeInvocations;
+    os << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+void writeProfileCsv(std::ostream &os, const VkCaps &caps, const GpuProfiler &p) {
+  os << std::setprecision(6) << std::fixed;
+  os << "device,driver_version,scope,ms,compute_invocations\n";
+  for (const ProfileRecord &r: p.records) {
+    os << '"' << caps.deviceName << "\"," << caps.driverVersion << ',' << r.name << ',' << r.ms << ',';
+    if (r.hasStatistics) os << r.computeInvocations;
+    os << '\n';
+  }
+}
+
+void writeProfile(const char *path, const VkCaps &caps, const GpuProfiler &p) {
+  std::ofstream f(path);
+  if (!f) {
+    std::cerr << "Failed to open " << path << "\n";
+    std::exit(1);
+  }
+  const size_t len = std::strlen(path);
+  if (len >= 4 && std::strcmp(path + len - 4, ".csv") == 0) writeProfileCsv(f, caps, p);
+  else writeProfileJson(f, caps, p);
+}
+
+void printProfile(const GpuProfiler &p) {
+  std::cout << "GPU profile (" << p.records.size() << " scopes";
+  if (p.dropped) std::cout << ", " << p.dropped << " dropped";
+  if (p.discarded) std::cout << ", " << p.discarded << " oldest discarded";
+  std::cout << "):\n";
+  for (const ProfileRecord &r: p.records) {
+    std::cout << "  " << std::left << std::setw(16) << r.name << std::right << std::setw(12) << r.ms << " ms";
+    if (r.hasStatistics) std::cout << "  " << r.computeInvocations << " invocations";
+    std::cout << "\n";
+  }
+}
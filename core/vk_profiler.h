@@ -0,0 +1,84 @@
+// vk_profiler.h - GPU timestamps (and pipeline statistics) per named scope.
+//
+// Scopes are recorded into command buffers and resolved on the host after their
+// submissions completed. Resolved scopes pile up as records, which are written as
+// JSON or CSV so BLAS build / trace times can be compared across runs and drivers.
+// Long-lived profilers keep at most maxRecords (oldest dropped first); loops that only
+// want per-iteration times call profilerClear between iterations.
+//
+//   uint32_t s = profilerBegin(p, cmd, "blas_build");
+//   vkCmdBuildAccelerationStructuresKHR(cmd, ...);
+//   profilerEnd(p, cmd, s);
+//   submitAndWait(dev, queue, cmd);
+//   profilerResolve(ctx, p);
+#pragma once
+
+#include "vk_util.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct VkCaps;
+
+struct ProfileRecord {
+  std::string name;
+  double ms{};
+  bool hasStatistics{};
+  uint64_t computeInvocations{}; // only when hasStatistics
+};
+
+struct GpuProfiler {
+  VkQueryPool timestamps{}; // 2 per scope slot
+  VkQueryPool statistics{}; // 1 per scope slot; null without pipelineStatisticsQuery
+  uint32_t maxScopes{};
+  double nsPerTick{};
+  uint64_t tickMask{};
+
+  struct Scope {
+    std::string name;
+    bool statistics;
+  };
+
+  std::vector<Scope> pending; // recorded but not resolved; index = query slot
+  std::vector<ProfileRecord> records;
+  size_t maxRecords = 1u << 16; // profilerResolve drops the oldest half of records past this
+  uint32_t dropped{}; // scopes skipped because every slot was pending
+  uint64_t discarded{}; // resolved records dropped to stay under maxRecords
+};
+
+constexpr uint32_t PROFILER_NO_SCOPE = UINT32_MAX;
+
+// The profiler is a no-op (every scope is PROFILER_NO_SCOPE) when the queue has no timestamps.
+void initProfiler(VkContext &ctx, GpuProfiler &p, uint32_t maxScopes = 1024);
+void destroyProfiler(VkContext &ctx, GpuProfiler &p);
+
+// statistics: also count compute shader invocations (dispatch scopes only; statistics
+// scopes must not nest). Ignored when the device lacks pipelineStatisticsQuery.
+uint32_t profilerBegin(GpuProfiler &p, VkCommandBuffer cmd, const char *name, bool statistics = false);
+void profilerEnd(GpuProfiler &p, VkCommandBuffer cmd, uint32_t scope);
+
+// Reads back every pending scope; all their submissions must have completed.
+// Returns the index of the first record it added (valid until the next resolve or clear).
+size_t profilerResolve(VkContext &ctx, GpuProfiler &p);
+
+// Forgets every resolved record (pending scopes stay).
+void profilerClear(GpuProfiler &p);
+
+// Appends src's records to dst under dst's maxRecords, then clears them from src; its
+// dropped / discarded counts move along. For short-lived or per-slot profilers whose
+// records belong to a longer-lived one.
+void profilerMoveRecords(GpuProfiler &dst, GpuProfiler &src);
+
+// Sum of records[first..] whose name starts with prefix.
+double profilerSumMs(const GpuProfiler &p, size_t first, const char *prefix = "");
+
+// ---- Output ----
+// One object / one row per record, tagged with device and driver.
+void writeProfileJson(std::ostream &os, const VkCaps &caps, const GpuProfiler &p);
+void writeProfileCsv(std::ostream &os, const VkCaps &caps, const GpuProfiler &p);
+
+// Picks the format from the extension (.csv, else JSON). Exits if the file can't be written.
+void writeProfile(const char *path, const VkCaps &caps, const GpuProfiler &p);
+void printProfile(const GpuProfiler &p);
@@ -0,0 +1,117 @@
+// vk_scan.cpp
+#include "vk_scan.h"
+#include "vk_context.h"
+
+#include <algorithm>
+#include <string>
+
+static constexpr uint32_t SCAN_BLOCK = 1024; // elements per workgroup, see shader/scan.slang
+static constexpr VkDeviceSize CARRY_SIZE = 16; // carry flag at the start of scratch
+
+struct ScanPush {
+  VkDeviceAddress data;
+  VkDeviceAddress blockSums;
+  VkDeviceAddress carry;
+  uint32_t count;
+  uint32_t writeBlockSums;
+  uint32_t groupsX;
+};
+
+static uint32_t blockCount(uint32_t count) { return (uint32_t) (((uint64_t) count + SCAN_BLOCK - 1) / SCAN_BLOCK); }
+
+static VkPipeline createScanPipeline(VkContext &ctx, VkPipelineLayout layout, VkShaderModule m, const char *entry) {
+  VkComputePipelineCreateInfo cpci{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  cpci.stage.module = m;
+  cpci.stage.pName = entry;
+  cpci.layout = layout;
+  return createComputePipeline(ctx, cpci, entry);
+}
+
+void initExclusiveScan(VkContext &ctx, ExclusiveScan &scan) {
+  VkDevice dev = ctx.dev;
+
+  VkPushConstantRange pcr{};
+  pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pcr.offset = 0;
+  pcr.size = sizeof(ScanPush);
+
+  VkPipelineLayoutCreateInfo plci{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
+  VK_CHECK(vkCreatePipelineLayout(dev, &plci, nullptr, &scan.layout));
+
+  std::string shaderDir = CORE_SHADER_DIR;
+  scan.mBlocks = createShaderModule(dev, loadSpv((shaderDir + "/scan_blocks.spv").c_str()));
+  scan.mAdd = createShaderModule(dev, loadSpv((shaderDir + "/scan_add.spv").c_str()));
+  scan.scanBlocks = createScanPipeline(ctx, scan.layout, scan.mBlocks, "scanBlocksMain");
+  scan.addOffsets = createScanPipeline(ctx, scan.layout, scan.mAdd, "addOffsetsMain");
+}
+
+void destroyExclusiveScan(VkContext &ctx, ExclusiveScan &scan) {
+  vkDestroyPipeline(ctx.dev, scan.scanBlocks, nullptr);
+  vkDestroyPipeline(ctx.dev, scan.addOffsets, nullptr);
+  vkDestroyShaderModule(ctx.dev, scan.mBlocks, nullptr);
+  vkDestroyShaderModule(ctx.dev, scan.mAdd, nullptr);
+  vkDestroyPipelineLayout(ctx.dev, scan.layout, nullptr);
+  scan = {};
+}
+
+VkDeviceSize exclusiveScanScratchSize(uint32_t count) {
+  VkDeviceSize size = CARRY_SIZE;
+  for (uint32_t n = blockCount(count); n > 1; n = blockCount(n))
+    size += alignUp(n * sizeof(uint32_t), 16);
+  return size;
+}
+
+static void cmdComputeBarrier(VkCommandBuffer cmd) {
+  cmdMemoryBarrier(cmd,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+// Scans one level; recurses on the block sums when more than one block is needed.
+static void cmdScanLevel(ExclusiveScan &scan, VkCommandBuffer cmd,
+                         VkDeviceAddress data, uint32_t count, VkDeviceAddress scratch, VkDeviceAddress carry) {
+  // Rows of up to 65535 workgroups
+  const uint32_t blocks = blockCount(count);
+  const uint32_t groupsX = std::min(blocks, 65535u);
+  const uint32_t groupsY = (blocks + groupsX - 1) / groupsX;
+
+  ScanPush push{};
+  push.data = data;
+  push.blockSums = scratch;
+  push.carry = carry;
+  push.count = count;
+  push.writeBlockSums = blocks > 1;
+  push.groupsX = groupsX;
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scan.scanBlocks);
+  vkCmdPushConstants(cmd, scan.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(cmd, groupsX, groupsY, 1);
+  if (blocks == 1) return;
+
+  cmdComputeBarrier(cmd);
+  cmdScanLevel(scan, cmd, scratch, blocks, scratch + alignUp(blocks * sizeof(uint32_t), 16), carry);
+  cmdComputeBarrier(cmd);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scan.addOffsets);
+  vkCmdPushConstants(cmd, scan.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(cmd, groupsX, groupsY, 1);
+}
+
+void cmdExclusiveScan(ExclusiveScan &scan, VkCommandBuffer cmd,
+                      const Buffer &data, uint32_t count, const Buffer &scratch) {
+  vkCmdFillBuffer(cmd, scratch.buf, 0, CARRY_SIZE, 0);
+  cmdMemoryBarrier(cmd,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  if (!count) return;
+  // Element indices of the last block must not wrap in the shader
+  if (count > UINT32_MAX - SCAN_BLOCK) {
+    std::cerr << "cmdExclusiveScan: " << count << " elements exceed 32-bit indexing\n";
+    std::exit(1);
+  }
+  cmdScanLevel(scan, cmd, data.addr, count, scratch.addr + CARRY_SIZE, scratch.addr);
+}
@@ -0,0 +1,33 @@
+// vk_scan.h - device-side exclusive prefix sum over uint32 buffers.
+//
+// Used to turn per-item counts into output offsets without a host round trip.
+// Buffers are addressed through buffer device address (push constants only).
+#pragma once
+
+#include "vk_util.h"
+
+#include <cstdint>
+
+struct ExclusiveScan {
+  VkPipelineLayout layout{};
+  VkShaderModule mBlocks{};
+  VkShaderModule mAdd{};
+  VkPipeline scanBlocks{};
+  VkPipeline addOffsets{};
+};
+
+void initExclusiveScan(VkContext &ctx, ExclusiveScan &scan);
+void destroyExclusiveScan(VkContext &ctx, ExclusiveScan &scan);
+
+// Scratch (carry flag, then block sums of every level) needed to scan count elements.
+// The first uint32 of scratch ends up 1 if the total exceeded 32 bits (offsets wrapped), else 0.
+VkDeviceSize exclusiveScanScratchSize(uint32_t count);
+
+// Records an in-place exclusive scan of data[0, count). data and scratch need
+// STORAGE_BUFFER usage and a device address, scratch also TRANSFER_DST (the carry
+// flag is cleared with a fill); scratch must hold
+// exclusiveScanScratchSize(count) bytes and stay alive until the command executed.
+// The caller orders the producer before and the consumer after this call
+// (compute shader stage, shader read/write).
+void cmdExclusiveScan(ExclusiveScan &scan, VkCommandBuffer cmd,
+                      const Buffer &data, uint32_t count, const Buffer &scratch);
@@ -0,0 +1,127 @@
+// vk_staging.cpp
+#include "vk_staging.h"
+#include "vk_context.h"
+
+#include <algorithm>
+#include <cstring>
+
+void initStagingRing(VkContext &ctx, StagingRing &ring, VkDeviceSize slotSize, uint32_t slotCount) {
+  ring.slotSize = slotSize;
+  ring.slotCount = slotCount;
+  ring.next = 0;
+  ring.buf = createBuffer(ctx, slotSize * slotCount,
+                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          false);
+  ring.pool = createCmdPool(ctx.dev, ctx.qfam);
+
+  ring.cmds.resize(slotCount);
+  ring.fences.resize(slotCount);
+  for (uint32_t i = 0; i < slotCount; i++) {
+    ring.cmds[i] = createCmdBuffer(ctx.dev, ring.pool);
+
+    VkFenceCreateInfo fci{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    fci.flags = VK_FENCE_CREATE_SIGNALED_BIT; // every slot starts free
+    VK_CHECK(vkCreateFence(ctx.dev, &fci, nullptr, &ring.fences[i]));
+  }
+}
+
+void destroyStagingRing(VkContext &ctx, StagingRing &ring) {
+  if (!ring.pool) return;
+  stagingFlush(ctx, ring);
+  for (VkFence f: ring.fences) vkDestroyFence(ctx.dev, f, nullptr);
+  vkDestroyCommandPool(ctx.dev, ring.pool, nullptr); // frees the command buffers
+  destroyBuffer(ctx, ring.buf);
+  ring.cmds.clear();
+  ring.fences.clear();
+  ring.pool = VK_NULL_HANDLE;
+}
+
+void stagingUpload(VkContext &ctx, StagingRing &ring,
+                   const Buffer &dst, VkDeviceSize dstOffset, const void *src, VkDeviceSize size,
+                   VkPipelineStageFlags srcStage, VkAccessFlags srcAccess) {
+  std::lock_guard<std::mutex> lock(ring.mutex);
+  if (!ring.pool) initStagingRing(ctx, ring); // first upload of the process
+  const uint8_t *bytes = (const uint8_t *) src;
+  uint8_t *ringMap = (uint8_t *) mapBuffer(ctx, ring.buf);
+
+  while (size) {
+    const uint32_t slot = ring.next;
+    ring.next = (ring.next + 1) % ring.slotCount;
+
+    // Wait until the GPU is done with the previous copy out of this slot.
+    VK_CHECK(vkWaitForFences(ctx.dev, 1, &ring.fences[slot], VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(ctx.dev, 1, &ring.fences[slot]));
+
+    const VkDeviceSize chunk = std::min(size, ring.slotSize);
+    const VkDeviceSize slotOffset = slot * ring.slotSize;
+    std::memcpy(ringMap + slotOffset, bytes, chunk);
+
+    VkCommandBuffer cmd = ring.cmds[slot];
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+    VkCommandBufferBeginInfo bi{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &bi));
+
+    // Earlier work still reading or writing dst (WAR / WAW against the copy)
+    if (srcStage != VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)
+      cmdMemoryBarrier(cmd,
+                       srcStage, srcAccess,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferCopy region{};
+    region.srcOffset = slotOffset;
+    region.dstOffset = dstOffset;
+    region.size = chunk;
+    vkCmdCopyBuffer(cmd, ring.buf.buf, dst.buf, 1, &region);
+
+    // Make the copy visible to whatever is submitted after it (AS builds, shaders).
+    cmdMemoryBarrier(cmd,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkSubmitInfo si{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &cmd;
+    VK_CHECK(vkQueueSubmit(ctx.queue, 1, &si, ring.fences[slot]));
+
+    bytes += chunk;
+    dstOffset += chunk;
+    size -= chunk;
+  }
+}
+
+void stagingFlush(VkContext &ctx, StagingRing &ring) {
+  std::lock_guard<std::mutex> lock(ring.mutex);
+  if (ring.fences.empty()) return;
+  VK_CHECK(vkWaitForFences(ctx.dev, (uint32_t) ring.fences.size(), ring.fences.data(), VK_TRUE, UINT64_MAX));
+}
+
+Buffer createDeviceLocalBuffer(VkContext &ctx, const void *data, VkDeviceSize size,
+                               VkBufferUsageFlags usage, bool deviceAddress, VkDeviceSize minAlignment) {
+  if (ctx.caps.deviceLocalHostVisible) {
+    Buffer b = createBuffer(ctx, size, usage,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            deviceAddress, minAlignment);
+    if (data) std::memcpy(mapBuffer(ctx, b), data, size);
+    return b;
+  }
+
+  Buffer b = createBuffer(ctx, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceAddress, minAlignment);
+  if (data) stagingUpload(ctx, ctx.staging, b, 0, data, size, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+  return b;
+}
+
+void updateDeviceLocalBuffer(VkContext &ctx, const Buffer &dst, VkDeviceSize offset,
+                             const void *data, VkDeviceSize size,
+                             VkPipelineStageFlags srcStage, VkAccessFlags srcAccess) {
+  if (ctx.caps.deviceLocalHostVisible) {
+    std::memcpy((uint8_t *) mapBuffer(ctx, dst) + offset, data, size);
+    return;
+  }
+  stagingUpload(ctx, ctx.staging, dst, offset, data, size, srcStage, srcAccess);
+}
@@ -0,0 +1,63 @@
+// vk_staging.h - host -> DEVICE_LOCAL uploads through a persistent staging ring.
+//
+// The ring is one persistently mapped HOST_VISIBLE buffer cut into slots. Each slot
+// has its own command buffer and fence: an upload memcpy's into the next free slot,
+// records a vkCmdCopyBuffer and submits without waiting. A slot is only reused once
+// its fence signalled, so several uploads are in flight while the CPU fills the next.
+// Uploads larger than a slot are split across slots.
+//
+// On UMA / ReBAR devices (VkCaps::deviceLocalHostVisible) the CPU can write device-local
+// memory directly; createDeviceLocalBuffer() then skips the ring entirely.
+//
+// The ring submits to ctx.queue itself and only ring.mutex guards it: uploads must come
+// from the thread that owns ctx.queue (VkQueue access is externally synchronized), never
+// concurrently with another vkQueueSubmit on it.
+#pragma once
+
+#include "vk_util.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct StagingRing {
+  Buffer buf; // HOST_VISIBLE | HOST_COHERENT, TRANSFER_SRC
+  VkDeviceSize slotSize{};
+  uint32_t slotCount{};
+  uint32_t next{}; // slot the next upload goes to
+  VkCommandPool pool{};
+  std::vector<VkCommandBuffer> cmds; // one per slot
+  std::vector<VkFence> fences; // one per slot, signalled = slot free
+  std::mutex mutex; // the ring's slots only, not ctx.queue
+};
+
+// Called lazily by the first stagingUpload() with the default sizes.
+void initStagingRing(VkContext &ctx, StagingRing &ring,
+                     VkDeviceSize slotSize = 16ull << 20, uint32_t slotCount = 4);
+void destroyStagingRing(VkContext &ctx, StagingRing &ring);
+
+// Copies size bytes from src into dst at dstOffset. Returns once src may be reused;
+// the copy itself may still be in flight (see stagingFlush). dst needs TRANSFER_DST.
+// The copy waits for srcStage / srcAccess of earlier submissions (whatever still reads
+// or writes dst; TOP_OF_PIPE for a fresh buffer) and is followed by a barrier, so later
+// submissions on ctx.queue see the data.
+void stagingUpload(VkContext &ctx, StagingRing &ring,
+                   const Buffer &dst, VkDeviceSize dstOffset, const void *src, VkDeviceSize size,
+                   VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                   VkAccessFlags srcAccess = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+
+// Blocks until every pending upload has executed.
+void stagingFlush(VkContext &ctx, StagingRing &ring);
+
+// DEVICE_LOCAL buffer filled with data (left undefined if data is null). Written in place
+// on UMA/ReBAR, through ctx.staging otherwise. usage gets TRANSFER_DST added as needed.
+Buffer createDeviceLocalBuffer(VkContext &ctx, const void *data, VkDeviceSize size,
+                               VkBufferUsageFlags usage, bool deviceAddress, VkDeviceSize minAlignment = 0);
+
+// Overwrites [offset, offset + size) of a createDeviceLocalBuffer() buffer the same way it
+// was filled. Staged copies wait for srcStage / srcAccess of earlier submissions; in
+// place (UMA/ReBAR) the GPU must not be using that range.
+void updateDeviceLocalBuffer(VkContext &ctx, const Buffer &dst, VkDeviceSize offset,
+                             const void *data, VkDeviceSize size,
+                             VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             VkAccessFlags srcAccess = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
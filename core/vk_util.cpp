@@ -0,0 +1,130 @@
+// vk_util.cpp
+#include "vk_util.h"
+#include "vk_context.h"
+
+#include <algorithm>
+#include <fstream>
+
+std::vector<uint32_t> loadSpv(const char *path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    std::cerr << "Failed to open " << path << "\n";
+    std::exit(1);
+  }
+
+  f.seekg(0, std::ios::end);
+  size_t sz = (size_t) f.tellg();
+  f.seekg(0, std::ios::beg);
+  if (sz % 4) {
+    std::cerr << "Bad SPV size " << path << "\n";
+    std::exit(1);
+  }
+  std::vector<uint32_t> out(sz / 4);
+  f.read((char *) out.data(), (std::streamsize) sz);
+  return out;
+}
+
+uint32_t findMemoryType(VkPhysicalDevice phys, uint32_t typeBits, VkMemoryPropertyFlags req) {
+  VkPhysicalDeviceMemoryProperties mp{};
+  vkGetPhysicalDeviceMemoryProperties(phys, &mp);
+  for (uint32_t i = 0; i < mp.memoryTypeCount; i++)
+    if ((typeBits & (1u << i)) && (mp.memoryTypes[i].propertyFlags & req) == req)
+      return i;
+  std::cerr << "No suitable memory type\n";
+  std::exit(1);
+}
+
+Buffer createBuffer(
+  VkContext &ctx,
+  VkDeviceSize size, VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags memProps,
+  bool deviceAddress,
+  VkDeviceSize minAlignment) {
+  VkDevice dev = ctx.dev;
+  Buffer b{};
+  b.size = size;
+
+  VkBufferCreateInfo ci{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  ci.size = size;
+  ci.usage = usage | (deviceAddress ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+  ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK(vkCreateBuffer(dev, &ci, nullptr, &b.buf));
+
+  VkMemoryRequirements mr{};
+  vkGetBufferMemoryRequirements(dev, b.buf, &mr);
+  mr.alignment = std::max(mr.alignment, minAlignment);
+
+  b.alloc = allocateMemory(ctx.allocator, mr, memProps, AllocKind::Linear);
+  VK_CHECK(vkBindBufferMemory(dev, b.buf, b.alloc.mem, b.alloc.offset));
+
+  if (deviceAddress) {
+    VkBufferDeviceAddressInfo bai{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+    bai.buffer = b.buf;
+    b.addr = vkGetBufferDeviceAddress(dev, &bai);
+  }
+  return b;
+}
+
+void *mapBuffer([[maybe_unused]] VkContext &ctx, const Buffer &b) {
+  if (!b.alloc.mapped) {
+    std::cerr << "mapBuffer: buffer is not host-visible\n";
+    std::exit(1);
+  }
+  return b.alloc.mapped;
+}
+
+void unmapBuffer([[maybe_unused]] VkContext &ctx, [[maybe_unused]] const Buffer &b) {
+  // Persistently mapped HOST_COHERENT memory: nothing to do.
+}
+
+void destroyBuffer(VkContext &ctx, Buffer &b) {
+  if (b.buf) vkDestroyBuffer(ctx.dev, b.buf, nullptr);
+  freeMemory(ctx.allocator, b.alloc);
+  b = {};
+}
+
+VkCommandPool createCmdPool(VkDevice dev, uint32_t qfam) {
+  VkCommandPoolCreateInfo ci{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  ci.queueFamilyIndex = qfam;
+  ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  VkCommandPool pool{};
+  VK_CHECK(vkCreateCommandPool(dev, &ci, nullptr, &pool));
+  return pool;
+}
+
+VkCommandBuffer createCmdBuffer(VkDevice dev, VkCommandPool pool) {
+  VkCommandBufferAllocateInfo ai{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  ai.commandPool = pool;
+  ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  ai.commandBufferCount = 1;
+  VkCommandBuffer cmd{};
+  VK_CHECK(vkAllocateCommandBuffers(dev, &ai, &cmd));
+  return cmd;
+}
+
+void cmdMemoryBarrier(VkCommandBuffer cmd,
+                      VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                      VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+  VkMemoryBarrier mb{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  mb.srcAccessMask = srcAccess;
+  mb.dstAccessMask = dstAccess;
+  vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 1, &mb, 0, nullptr, 0, nullptr);
+}
+
+void submitAndWait([[maybe_unused]] VkDevice dev, VkQueue q, VkCommandBuffer cmd) {
+  VK_CHECK(vkEndCommandBuffer(cmd)); // End Recoding Command
+  VkSubmitInfo si{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  si.commandBufferCount = 1;
+  si.pCommandBuffers = &cmd;
+  VK_CHECK(vkQueueSubmit(q, 1, &si, VK_NULL_HANDLE)); // Submit to Queue
+  VK_CHECK(vkQueueWaitIdle(q)); // Wait for Completion
+}
+
+VkShaderModule createShaderModule(VkDevice dev, const std::vector<uint32_t> &code) {
+  VkShaderModuleCreateInfo smci{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  smci.codeSize = code.size() * 4;
+  smci.pCode = code.data();
+  VkShaderModule m{};
+  VK_CHECK(vkCreateShaderModule(dev, &smci, nullptr, &m));
+  return m;
+}
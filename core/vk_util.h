@@ -0,0 +1,59 @@
+// vk_util.h - small Vulkan helpers shared by all apps
+// (buffers, command buffers, SPIR-V loading).
+#pragma once
+
+#include <volk/volk.h>
+
+#include "vk_allocator.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#define VK_CHECK(x) do { VkResult _r = (x); if (_r != VK_SUCCESS) { \
+  std::cerr << "Vulkan error " << _r << " at " << __FILE__ << ":" << __LINE__ << "\n"; std::exit(1); } } while(0)
+
+struct VkContext;
+
+static inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) { return (v + a - 1) & ~(a - 1); }
+
+std::vector<uint32_t> loadSpv(const char *path);
+
+uint32_t findMemoryType(VkPhysicalDevice phys, uint32_t typeBits, VkMemoryPropertyFlags req);
+
+// ---- Buffers ----
+struct Buffer {
+  VkBuffer buf{}; // low-level handler
+  Allocation alloc; // range of a shared VkDeviceMemory block (see vk_allocator.h)
+  VkDeviceAddress addr{}; // device memory address
+  VkDeviceSize size{};
+};
+
+// minAlignment: extra alignment on top of the driver's requirement, e.g. for AS build
+// scratch (minAccelerationStructureScratchOffsetAlignment), since buffers now share blocks.
+Buffer createBuffer(
+  VkContext &ctx,
+  VkDeviceSize size, VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags memProps,
+  bool deviceAddress,
+  VkDeviceSize minAlignment = 0);
+
+// Host-visible buffers are persistently mapped; map/unmap only hand out the pointer.
+void *mapBuffer(VkContext &ctx, const Buffer &b);
+void unmapBuffer(VkContext &ctx, const Buffer &b);
+void destroyBuffer(VkContext &ctx, Buffer &b);
+
+// ---- Commands ----
+VkCommandPool createCmdPool(VkDevice dev, uint32_t qfam);
+VkCommandBuffer createCmdBuffer(VkDevice dev, VkCommandPool pool);
+
+// Global memory barrier (no image layout transitions).
+void cmdMemoryBarrier(VkCommandBuffer cmd,
+                      VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                      VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+// Ends cmd, submits it to q and blocks until the queue is idle.
+void submitAndWait(VkDevice dev, VkQueue q, VkCommandBuffer cmd);
+
+VkShaderModule createShaderModule(VkDevice dev, const std::vector<uint32_t> &code);